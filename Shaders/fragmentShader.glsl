@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////////////////////////////////
+// fragmentShader.glsl
+// ===================
+// Phong lighting with per-object materials read from a uniform block, shading
+// only the lights binned into the fragment's cluster
+//
+//  Built once per combination of the TEXTURED and LIT defines, which
+//  ShaderVariants inserts after the #version line.
+///////////////////////////////////////////////////////////////////////////////
+#version 440 core
+
+// must match MAX_MATERIALS in SceneManager.cpp
+#define MAX_MATERIALS 64
+// must match LightClusters::GRID_X, GRID_Y and GRID_Z
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+
+out vec4 outFragmentColor;
+
+in vec3 fragmentPosition;
+in float fragmentViewDepth;
+in vec3 fragmentVertexNormal;
+in vec2 fragmentTextureCoordinate;
+flat in int fragmentMaterialIndex;
+flat in int fragmentTextureLayer;
+flat in vec4 fragmentColor;
+
+// std140 layout, mirrored by SceneManager::GPU_MATERIAL
+struct Material
+{
+    vec3 ambientColor;
+    float ambientStrength;
+    vec3 diffuseColor;
+    float opacity;
+    vec3 specularColor;
+    float shininess;
+};
+
+// std430 layout, mirrored by LightClusters::GPU_LIGHT
+struct LightSource
+{
+    vec3 position;
+    float range;
+    vec3 ambientColor;
+    float focalStrength;
+    vec3 diffuseColor;
+    float specularIntensity;
+    vec3 specularColor;
+};
+
+// material table uploaded once by SceneManager
+layout (std140, binding = 0) uniform MaterialBlock
+{
+    Material materials[MAX_MATERIALS];
+};
+
+// every scene light, uploaded by LightClusters
+layout (std430, binding = 1) readonly buffer LightBlock
+{
+    LightSource lights[];
+};
+
+// first entry of lightIndices and light count of each cluster
+layout (std430, binding = 2) readonly buffer ClusterBlock
+{
+    uvec2 clusters[];
+};
+
+layout (std430, binding = 3) readonly buffer LightIndexBlock
+{
+    uint lightIndices[];
+};
+
+uniform sampler2DArray objectTexture;
+uniform vec3 viewPosition;
+// cluster tiles per pixel and the depth slice mapping, slice = log(depth) * scale + bias
+uniform vec2 clusterScreenScale;
+uniform float clusterDepthScale;
+uniform float clusterDepthBias;
+
+int FindCluster();
+vec3 CalcLightSource(LightSource light, Material material, vec3 lightNormal, vec3 vertexPosition, vec3 viewDirection);
+
+void main()
+{
+#ifdef LIT
+    Material material = materials[fragmentMaterialIndex];
+    vec3 lightNormal = normalize(fragmentVertexNormal);
+    vec3 viewDirection = normalize(viewPosition - fragmentPosition);
+    vec3 phongResult = vec3(0.0f);
+
+    uvec2 cluster = clusters[FindCluster()];
+    for (uint i = 0u; i < cluster.y; i++)
+    {
+        phongResult += CalcLightSource(lights[lightIndices[cluster.x + i]], material, lightNormal, fragmentPosition, viewDirection);
+    }
+
+#ifdef TEXTURED
+    vec4 textureColor = texture(objectTexture, vec3(fragmentTextureCoordinate, fragmentTextureLayer));
+    outFragmentColor = vec4(phongResult * textureColor.xyz, material.opacity);
+#else
+    outFragmentColor = vec4(phongResult * fragmentColor.xyz, fragmentColor.w * material.opacity);
+#endif
+#else
+#ifdef TEXTURED
+    outFragmentColor = texture(objectTexture, vec3(fragmentTextureCoordinate, fragmentTextureLayer));
+#else
+    outFragmentColor = fragmentColor;
+#endif
+#endif
+}
+
+int FindCluster()
+{
+    ivec2 tile = ivec2(gl_FragCoord.xy * clusterScreenScale);
+    int slice = int(floor(log(max(fragmentViewDepth, 1e-4)) * clusterDepthScale + clusterDepthBias));
+
+    tile = clamp(tile, ivec2(0), ivec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+    slice = clamp(slice, 0, CLUSTER_GRID_Z - 1);
+    return (slice * CLUSTER_GRID_Y + tile.y) * CLUSTER_GRID_X + tile.x;
+}
+
+vec3 CalcLightSource(LightSource light, Material material, vec3 lightNormal, vec3 vertexPosition, vec3 viewDirection)
+{
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    // ambient lighting
+    ambient = light.ambientColor * material.ambientColor * material.ambientStrength;
+
+    // diffuse lighting
+    vec3 lightDirection = normalize(light.position - vertexPosition);
+    float impact = max(dot(lightNormal, lightDirection), 0.0);
+    diffuse = impact * light.diffuseColor * material.diffuseColor;
+
+    // specular lighting
+    vec3 reflectDir = reflect(-lightDirection, lightNormal);
+    float specularComponent = pow(max(dot(viewDirection, reflectDir), 0.0), light.focalStrength);
+    specular = light.specularIntensity * specularComponent * material.specularColor * light.specularColor;
+
+    // ranged lights fade smoothly to nothing at their range
+    float attenuation = 1.0;
+    if (light.range > 0.0)
+    {
+        float distanceRatio = length(light.position - vertexPosition) / light.range;
+        attenuation = clamp(1.0 - distanceRatio * distanceRatio, 0.0, 1.0);
+        attenuation *= attenuation;
+    }
+
+    return (ambient + diffuse + specular) * attenuation;
+}
@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+// vertexShader.glsl
+// =================
+// Transforms scene geometry and passes lighting inputs to the fragment stage
+///////////////////////////////////////////////////////////////////////////////
+#version 440 core
+#extension GL_ARB_shader_draw_parameters : enable
+
+// packed vertices store the position in [0, 1] of the mesh's bounds and
+// an octahedral normal in xy, see InstancedMeshes::PACKED_VERTEX
+layout (location = 0) in vec3 inVertexPosition;
+layout (location = 1) in vec3 inVertexNormal;
+layout (location = 2) in vec2 inTextureCoordinate;
+
+// per-instance attributes, read only when bUseInstancing is set
+layout (location = 3) in mat4 inInstanceModel;
+layout (location = 7) in vec2 inInstanceUVScale;
+layout (location = 8) in ivec2 inInstanceIndices;   // material, texture layer
+
+// the depth prepass and the opaque pass must compute equal depths
+invariant gl_Position;
+
+out vec3 fragmentPosition;
+out float fragmentViewDepth;
+out vec3 fragmentVertexNormal;
+out vec2 fragmentTextureCoordinate;
+flat out int fragmentMaterialIndex;
+flat out int fragmentTextureLayer;
+flat out vec4 fragmentColor;
+
+// std430 layout, mirrored by InstancedMeshes::DRAW_DATA
+struct DrawData
+{
+    vec4 color;
+    vec4 positionScale;
+    vec4 positionOffset;
+};
+
+// per-draw state of a multi-draw indirect call, indexed by gl_DrawID
+layout (std430, binding = 4) readonly buffer DrawBlock
+{
+    DrawData draws[];
+};
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec2 UVscale = vec2(1.0f, 1.0f);
+uniform int materialIndex = 0;
+uniform int textureLayer = 0;
+uniform bool bUseInstancing = false;
+uniform bool bUseIndirect = false;
+uniform vec4 objectColor = vec4(1.0f);
+uniform bool bPackedVertices = false;
+uniform vec3 positionScale = vec3(1.0f);
+uniform vec3 positionOffset = vec3(0.0f);
+
+/***********************************************************
+ *  DecodeOctahedral()
+ *
+ *  Unfolds a normal stored on the octahedron, whose lower
+ *  half was folded out over the corners of the square.
+ ***********************************************************/
+vec3 DecodeOctahedral(vec2 encoded)
+{
+    vec3 normal = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0f);
+    normal.x += (normal.x >= 0.0f) ? -fold : fold;
+    normal.y += (normal.y >= 0.0f) ? -fold : fold;
+    return normalize(normal);
+}
+
+void main()
+{
+    mat4 objectModel = model;
+    vec2 objectUVScale = UVscale;
+    int objectMaterialIndex = materialIndex;
+    int objectTextureLayer = textureLayer;
+    vec4 objectDrawColor = objectColor;
+    vec3 meshPositionScale = positionScale;
+    vec3 meshPositionOffset = positionOffset;
+
+    if (bUseInstancing)
+    {
+        objectModel = inInstanceModel;
+        objectUVScale = inInstanceUVScale;
+        objectMaterialIndex = inInstanceIndices.x;
+        objectTextureLayer = inInstanceIndices.y;
+    }
+
+#ifdef GL_ARB_shader_draw_parameters
+    if (bUseIndirect)
+    {
+        DrawData drawData = draws[gl_DrawIDARB];
+        objectDrawColor = drawData.color;
+        meshPositionScale = drawData.positionScale.xyz;
+        meshPositionOffset = drawData.positionOffset.xyz;
+    }
+#endif
+
+    vec3 vertexPosition = inVertexPosition;
+    vec3 vertexNormal = inVertexNormal;
+    if (bPackedVertices)
+    {
+        vertexPosition = meshPositionOffset + inVertexPosition * meshPositionScale;
+        vertexNormal = DecodeOctahedral(inVertexNormal.xy);
+    }
+
+    fragmentPosition = vec3(objectModel * vec4(vertexPosition, 1.0f));
+    fragmentViewDepth = -(view * vec4(fragmentPosition, 1.0f)).z;
+    fragmentVertexNormal = mat3(transpose(inverse(objectModel))) * vertexNormal;
+    fragmentTextureCoordinate = inTextureCoordinate * objectUVScale;
+    fragmentMaterialIndex = objectMaterialIndex;
+    fragmentTextureLayer = objectTextureLayer;
+    fragmentColor = objectDrawColor;
+
+    gl_Position = projection * view * objectModel * vec4(vertexPosition, 1.0f);
+}
@@ -0,0 +1,273 @@
+///////////////////////////////////////////////////////////////////////////////
+// FrameBenchmark.cpp
+// ==================
+// Per-frame CPU and GPU timing capture for the headless benchmark mode
+//
+//  Records the CPU time spent submitting each frame, the GPU time measured
+//  with timer queries, and any named per-frame counters reported by the
+//  renderer, then writes them out as CSV and JSON with percentile summaries.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FrameBenchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+    // nearest-rank percentile of an already sorted series
+    double Percentile(const std::vector<double>& sorted, double fraction)
+    {
+        if (sorted.empty())
+            return 0.0;
+
+        int rank = (int)std::ceil(fraction * sorted.size()) - 1;
+        rank = std::max(0, std::min(rank, (int)sorted.size() - 1));
+        return sorted[rank];
+    }
+
+    void WriteSummaryJSON(std::ofstream& file, const char* name, double mean, double minimum,
+        double maximum, double p50, double p95, double p99)
+    {
+        file << "  \"" << name << "\": { \"mean\": " << mean
+            << ", \"min\": " << minimum << ", \"max\": " << maximum
+            << ", \"p50\": " << p50 << ", \"p95\": " << p95 << ", \"p99\": " << p99 << " },\n";
+    }
+}
+
+/***********************************************************
+ *  FrameBenchmark()
+ ***********************************************************/
+FrameBenchmark::FrameBenchmark()
+{
+    for (int i = 0; i < QUERY_RING_SIZE; ++i)
+    {
+        m_timerQueries[i] = 0;
+        m_queryFrames[i] = -1;
+    }
+}
+
+/***********************************************************
+ *  ~FrameBenchmark()
+ ***********************************************************/
+FrameBenchmark::~FrameBenchmark()
+{
+    if (m_timerQueries[0])
+        glDeleteQueries(QUERY_RING_SIZE, m_timerQueries);
+}
+
+/***********************************************************
+ *  Initialize()
+ ***********************************************************/
+void FrameBenchmark::Initialize()
+{
+    glGenQueries(QUERY_RING_SIZE, m_timerQueries);
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method starts the CPU clock and the GPU timer query
+ *  for a new frame. The query slot being reused belongs to a
+ *  frame several frames old, so its result is normally ready.
+ ***********************************************************/
+void FrameBenchmark::BeginFrame()
+{
+    int frame = (int)m_samples.size();
+    int slot = frame % QUERY_RING_SIZE;
+
+    if (m_queryFrames[slot] >= 0)
+        ResolveQuery(slot);
+
+    FRAME_SAMPLE sample;
+    sample.cpuMilliseconds = 0.0;
+    sample.gpuMilliseconds = 0.0;
+    m_samples.push_back(sample);
+
+    if (m_timerQueries[slot])
+    {
+        glBeginQuery(GL_TIME_ELAPSED, m_timerQueries[slot]);
+        m_queryFrames[slot] = frame;
+    }
+
+    m_frameStart = std::chrono::steady_clock::now();
+}
+
+/***********************************************************
+ *  EndFrame()
+ ***********************************************************/
+void FrameBenchmark::EndFrame()
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_frameStart;
+    m_samples.back().cpuMilliseconds = elapsed.count();
+
+    if (m_timerQueries[0])
+        glEndQuery(GL_TIME_ELAPSED);
+}
+
+/***********************************************************
+ *  SetCounter()
+ *
+ *  This method records a named value for the frame that is
+ *  currently being captured. Counters first seen part way
+ *  through a run read as zero for the earlier frames.
+ ***********************************************************/
+void FrameBenchmark::SetCounter(const char* name, double value)
+{
+    if (m_samples.empty())
+        return;
+
+    size_t index = 0;
+    while (index < m_counterNames.size() && m_counterNames[index] != name)
+        ++index;
+    if (index == m_counterNames.size())
+        m_counterNames.push_back(name);
+
+    std::vector<double>& counters = m_samples.back().counters;
+    if (counters.size() < m_counterNames.size())
+        counters.resize(m_counterNames.size(), 0.0);
+    counters[index] = value;
+}
+
+/***********************************************************
+ *  Finish()
+ ***********************************************************/
+void FrameBenchmark::Finish()
+{
+    for (int slot = 0; slot < QUERY_RING_SIZE; ++slot)
+    {
+        if (m_queryFrames[slot] >= 0)
+            ResolveQuery(slot);
+    }
+}
+
+/***********************************************************
+ *  ResolveQuery()
+ ***********************************************************/
+void FrameBenchmark::ResolveQuery(int slot)
+{
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(m_timerQueries[slot], GL_QUERY_RESULT, &nanoseconds);
+    m_samples[m_queryFrames[slot]].gpuMilliseconds = nanoseconds / 1.0e6;
+    m_queryFrames[slot] = -1;
+}
+
+/***********************************************************
+ *  Summarize()
+ ***********************************************************/
+FrameBenchmark::TIMING_SUMMARY FrameBenchmark::Summarize(bool gpu) const
+{
+    std::vector<double> values;
+    values.reserve(m_samples.size());
+    for (const FRAME_SAMPLE& sample : m_samples)
+        values.push_back(gpu ? sample.gpuMilliseconds : sample.cpuMilliseconds);
+    std::sort(values.begin(), values.end());
+
+    TIMING_SUMMARY summary = {};
+    if (values.empty())
+        return summary;
+
+    double total = 0.0;
+    for (double value : values)
+        total += value;
+
+    summary.mean = total / values.size();
+    summary.minimum = values.front();
+    summary.maximum = values.back();
+    summary.p50 = Percentile(values, 0.50);
+    summary.p95 = Percentile(values, 0.95);
+    summary.p99 = Percentile(values, 0.99);
+    return summary;
+}
+
+/***********************************************************
+ *  WriteCSV()
+ *
+ *  This method writes one row per frame with the CPU time,
+ *  the GPU time and every recorded counter.
+ ***********************************************************/
+bool FrameBenchmark::WriteCSV(const char* filename) const
+{
+    std::ofstream file(filename);
+    if (!file)
+    {
+        std::cout << "Failed to open " << filename << " for writing" << std::endl;
+        return false;
+    }
+
+    file << "frame,cpu_ms,gpu_ms";
+    for (const std::string& name : m_counterNames)
+        file << "," << name;
+    file << "\n";
+
+    file << std::fixed << std::setprecision(4);
+    for (size_t frame = 0; frame < m_samples.size(); ++frame)
+    {
+        const FRAME_SAMPLE& sample = m_samples[frame];
+        file << frame << "," << sample.cpuMilliseconds << "," << sample.gpuMilliseconds;
+        for (size_t i = 0; i < m_counterNames.size(); ++i)
+            file << "," << (i < sample.counters.size() ? sample.counters[i] : 0.0);
+        file << "\n";
+    }
+
+    return true;
+}
+
+/***********************************************************
+ *  WriteJSON()
+ *
+ *  This method writes the percentile summaries followed by
+ *  the per-frame samples.
+ ***********************************************************/
+bool FrameBenchmark::WriteJSON(const char* filename) const
+{
+    std::ofstream file(filename);
+    if (!file)
+    {
+        std::cout << "Failed to open " << filename << " for writing" << std::endl;
+        return false;
+    }
+
+    TIMING_SUMMARY cpu = Summarize(false);
+    TIMING_SUMMARY gpu = Summarize(true);
+
+    file << std::fixed << std::setprecision(4);
+    file << "{\n";
+    file << "  \"frames\": " << m_samples.size() << ",\n";
+    WriteSummaryJSON(file, "cpu_ms", cpu.mean, cpu.minimum, cpu.maximum, cpu.p50, cpu.p95, cpu.p99);
+    WriteSummaryJSON(file, "gpu_ms", gpu.mean, gpu.minimum, gpu.maximum, gpu.p50, gpu.p95, gpu.p99);
+
+    file << "  \"samples\": [\n";
+    for (size_t frame = 0; frame < m_samples.size(); ++frame)
+    {
+        const FRAME_SAMPLE& sample = m_samples[frame];
+        file << "    { \"frame\": " << frame
+            << ", \"cpu_ms\": " << sample.cpuMilliseconds
+            << ", \"gpu_ms\": " << sample.gpuMilliseconds;
+        for (size_t i = 0; i < m_counterNames.size(); ++i)
+            file << ", \"" << m_counterNames[i] << "\": " << (i < sample.counters.size() ? sample.counters[i] : 0.0);
+        file << " }" << (frame + 1 < m_samples.size() ? "," : "") << "\n";
+    }
+    file << "  ]\n";
+    file << "}\n";
+
+    return true;
+}
+
+/***********************************************************
+ *  PrintSummary()
+ ***********************************************************/
+void FrameBenchmark::PrintSummary() const
+{
+    TIMING_SUMMARY cpu = Summarize(false);
+    TIMING_SUMMARY gpu = Summarize(true);
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "INFO: " << m_samples.size() << " frames rendered" << std::endl;
+    std::cout << "INFO: CPU ms  p50 " << cpu.p50 << "  p95 " << cpu.p95 << "  p99 " << cpu.p99 << std::endl;
+    std::cout << "INFO: GPU ms  p50 " << gpu.p50 << "  p95 " << gpu.p95 << "  p99 " << gpu.p99 << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+}
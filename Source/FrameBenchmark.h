@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////
+// FrameBenchmark.h
+// ================
+// Per-frame CPU and GPU timing capture for the headless benchmark mode
+//
+//  Records the CPU time spent submitting each frame, the GPU time measured
+//  with timer queries, and any named per-frame counters reported by the
+//  renderer, then writes them out as CSV and JSON with percentile summaries.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  FrameBenchmark
+ *
+ *  This class collects frame timings and counters for a
+ *  fixed number of frames. GPU timer queries are kept in a
+ *  small ring so reading a result never stalls the frame
+ *  that is currently being submitted.
+ ***********************************************************/
+class FrameBenchmark
+{
+public:
+    // constructor
+    FrameBenchmark();
+    // destructor
+    ~FrameBenchmark();
+
+    // create the GPU timer queries
+    void Initialize();
+    // mark the start and end of a frame
+    void BeginFrame();
+    void EndFrame();
+    // record a named counter value for the current frame
+    void SetCounter(const char* name, double value);
+    // wait for outstanding GPU results after the last frame
+    void Finish();
+
+    // output of the collected samples
+    bool WriteCSV(const char* filename) const;
+    bool WriteJSON(const char* filename) const;
+    void PrintSummary() const;
+
+private:
+    // timings and counters captured for a single frame
+    struct FRAME_SAMPLE
+    {
+        double cpuMilliseconds;
+        double gpuMilliseconds;
+        std::vector<double> counters;
+    };
+
+    // percentile summary of one timing series
+    struct TIMING_SUMMARY
+    {
+        double mean;
+        double minimum;
+        double maximum;
+        double p50;
+        double p95;
+        double p99;
+    };
+
+    // number of frames a GPU query may stay in flight
+    static const int QUERY_RING_SIZE = 4;
+
+    GLuint m_timerQueries[QUERY_RING_SIZE];
+    int m_queryFrames[QUERY_RING_SIZE];
+
+    std::vector<FRAME_SAMPLE> m_samples;
+    std::vector<std::string> m_counterNames;
+    std::chrono::steady_clock::time_point m_frameStart;
+
+    // read back the GPU time of a ring slot into its frame sample
+    void ResolveQuery(int slot);
+    // summarize the CPU or GPU series
+    TIMING_SUMMARY Summarize(bool gpu) const;
+};
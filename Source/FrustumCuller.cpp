@@ -0,0 +1,430 @@
+///////////////////////////////////////////////////////////////////////////////
+// FrustumCuller.cpp
+// =================
+// Skips scene objects that lie outside the view frustum
+//
+//  Every queued object carries a world-space bounding box and sphere. A
+//  bounding volume hierarchy is built over the boxes each frame and walked
+//  against the six frustum planes, so whole groups of objects are accepted
+//  or rejected with a single test. Below the top of the tree the walk splits
+//  into subtrees that can be tested on several threads at once. Boxes are
+//  tested against four planes at a time with SSE where the compiler targets
+//  it.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_CULLER_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+    const int FRUSTUM_PLANE_COUNT = 6;
+    // plane slots including the padding that every box passes
+    const int PADDED_PLANE_COUNT = 8;
+
+    // objects per leaf, small scenes gain nothing from deeper trees
+    const int MAX_LEAF_OBJECTS = 2;
+    // largest subtree BeginCull leaves to a single task
+    const int MAX_TASK_OBJECTS = 64;
+}
+
+/***********************************************************
+ *  FrustumCuller()
+ ***********************************************************/
+FrustumCuller::FrustumCuller()
+{
+    // start with every plane passing, so nothing is culled before SetFrustum
+    for (int i = 0; i < PADDED_PLANE_COUNT; ++i)
+    {
+        m_planeX[i] = 0.0f;
+        m_planeY[i] = 0.0f;
+        m_planeZ[i] = 0.0f;
+        m_planeW[i] = 1.0f;
+    }
+    m_stats = CULL_STATS();
+}
+
+/***********************************************************
+ *  MakeBounds()
+ ***********************************************************/
+FrustumCuller::BOUNDS FrustumCuller::MakeBounds(const glm::vec3& minimum, const glm::vec3& maximum)
+{
+    BOUNDS bounds;
+    bounds.center = (minimum + maximum) * 0.5f;
+    bounds.extents = (maximum - minimum) * 0.5f;
+    bounds.radius = glm::length(bounds.extents);
+    return bounds;
+}
+
+/***********************************************************
+ *  TransformBounds()
+ *
+ *  This method returns the box enclosing the transformed
+ *  local box. Each world extent is the sum of the local
+ *  extents projected onto that axis by the absolute values
+ *  of the rotation and scale terms.
+ ***********************************************************/
+FrustumCuller::BOUNDS FrustumCuller::TransformBounds(const BOUNDS& bounds, const glm::mat4& model)
+{
+    BOUNDS world;
+    world.center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+    for (int row = 0; row < 3; ++row)
+    {
+        world.extents[row] =
+            std::fabs(model[0][row]) * bounds.extents.x +
+            std::fabs(model[1][row]) * bounds.extents.y +
+            std::fabs(model[2][row]) * bounds.extents.z;
+    }
+    world.radius = glm::length(world.extents);
+    return world;
+}
+
+/***********************************************************
+ *  Clear()
+ ***********************************************************/
+void FrustumCuller::Clear()
+{
+    m_objects.clear();
+}
+
+/***********************************************************
+ *  AddObject()
+ ***********************************************************/
+int FrustumCuller::AddObject(const BOUNDS& bounds)
+{
+    m_objects.push_back(bounds);
+    return (int)m_objects.size() - 1;
+}
+
+/***********************************************************
+ *  SetObjectCount()
+ ***********************************************************/
+void FrustumCuller::SetObjectCount(int count)
+{
+    m_objects.resize(count);
+}
+
+/***********************************************************
+ *  SetObject()
+ ***********************************************************/
+void FrustumCuller::SetObject(int index, const BOUNDS& bounds)
+{
+    m_objects[index] = bounds;
+}
+
+/***********************************************************
+ *  GetObject()
+ ***********************************************************/
+const FrustumCuller::BOUNDS& FrustumCuller::GetObject(int index) const
+{
+    return m_objects[index];
+}
+
+/***********************************************************
+ *  SetFrustum()
+ *
+ *  This method extracts the six clip planes from the rows of
+ *  the view-projection matrix, with normals pointing into
+ *  the frustum, and normalizes them.
+ ***********************************************************/
+void FrustumCuller::SetFrustum(const glm::mat4& viewProjection)
+{
+    glm::vec4 rows[4];
+    for (int row = 0; row < 4; ++row)
+        rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+
+    const glm::vec4 planes[FRUSTUM_PLANE_COUNT] = {
+        rows[3] + rows[0],  // left
+        rows[3] - rows[0],  // right
+        rows[3] + rows[1],  // bottom
+        rows[3] - rows[1],  // top
+        rows[3] + rows[2],  // near
+        rows[3] - rows[2]   // far
+    };
+
+    for (int i = 0; i < FRUSTUM_PLANE_COUNT; ++i)
+    {
+        float length = glm::length(glm::vec3(planes[i]));
+        glm::vec4 plane = (length > 0.0f) ? planes[i] / length : planes[i];
+        m_planeX[i] = plane.x;
+        m_planeY[i] = plane.y;
+        m_planeZ[i] = plane.z;
+        m_planeW[i] = plane.w;
+    }
+}
+
+/***********************************************************
+ *  Cull()
+ *
+ *  This method runs every part of the walk in turn on the
+ *  calling thread.
+ ***********************************************************/
+void FrustumCuller::Cull(std::vector<int>& visible)
+{
+    visible.clear();
+    int nodesTested = 0;
+    int taskCount = BeginCull();
+    for (int task = 0; task < taskCount; ++task)
+        CullTask(task, visible, nodesTested);
+
+    // keep the queue order independent of the tree layout
+    std::sort(visible.begin(), visible.end());
+    EndCull((int)visible.size(), nodesTested);
+}
+
+/***********************************************************
+ *  BeginCull()
+ *
+ *  This method builds the hierarchy over the objects added
+ *  since the last Clear and walks its top against the
+ *  frustum. A node fully inside accepts its whole subtree,
+ *  a node outside rejects it, and only nodes crossing a
+ *  plane are opened further. Nodes small enough, or inside,
+ *  are left as tasks, which do not share any state and so
+ *  can be walked by different threads.
+ ***********************************************************/
+int FrustumCuller::BeginCull()
+{
+    m_stats = CULL_STATS();
+    m_stats.objects = (int)m_objects.size();
+    m_tasks.clear();
+    if (m_objects.empty())
+        return 0;
+
+    m_order.resize(m_objects.size());
+    for (size_t i = 0; i < m_order.size(); ++i)
+        m_order[i] = (int)i;
+    m_nodes.clear();
+    BuildNode(0, (int)m_objects.size());
+
+    m_stack.clear();
+    m_stack.push_back(0);
+    while (!m_stack.empty())
+    {
+        int nodeIndex = m_stack.back();
+        m_stack.pop_back();
+        const BVH_NODE& node = m_nodes[nodeIndex];
+
+        if (node.objectCount <= MAX_TASK_OBJECTS)
+        {
+            m_tasks.push_back({ nodeIndex, false });
+            continue;
+        }
+
+        ++m_stats.nodesTested;
+        CULL_RESULT result = TestBox(node.center, node.extents);
+        if (result == CULL_OUTSIDE)
+            continue;
+        if (result == CULL_INSIDE)
+        {
+            m_tasks.push_back({ nodeIndex, true });
+            continue;
+        }
+
+        m_stack.push_back(node.rightChild);
+        m_stack.push_back(nodeIndex + 1);
+    }
+    return (int)m_tasks.size();
+}
+
+/***********************************************************
+ *  CullTask()
+ *
+ *  This method appends the visible objects of one task and
+ *  adds the nodes it tested. It only reads the culler, so
+ *  several tasks may run at once.
+ ***********************************************************/
+void FrustumCuller::CullTask(int task, std::vector<int>& visible, int& nodesTested) const
+{
+    const CULL_TASK& cullTask = m_tasks[task];
+    if (cullTask.inside)
+    {
+        AcceptNode(m_nodes[cullTask.node], visible);
+        return;
+    }
+
+    std::vector<int> stack;
+    nodesTested += WalkNode(cullTask.node, visible, stack);
+}
+
+/***********************************************************
+ *  EndCull()
+ ***********************************************************/
+void FrustumCuller::EndCull(int visibleCount, int nodesTested)
+{
+    m_stats.nodesTested += nodesTested;
+    m_stats.visible = visibleCount;
+    m_stats.culled = m_stats.objects - visibleCount;
+}
+
+/***********************************************************
+ *  GetStats()
+ ***********************************************************/
+FrustumCuller::CULL_STATS FrustumCuller::GetStats() const
+{
+    return m_stats;
+}
+
+/***********************************************************
+ *  BuildNode()
+ *
+ *  This method bounds a range of objects and, unless it is
+ *  small enough for a leaf, splits it at the median object
+ *  center along the axis where the centers spread most.
+ ***********************************************************/
+void FrustumCuller::BuildNode(int first, int count)
+{
+    glm::vec3 boxMinimum(INFINITY), boxMaximum(-INFINITY);
+    glm::vec3 centerMinimum(INFINITY), centerMaximum(-INFINITY);
+    for (int i = first; i < first + count; ++i)
+    {
+        const BOUNDS& bounds = m_objects[m_order[i]];
+        boxMinimum = glm::min(boxMinimum, bounds.center - bounds.extents);
+        boxMaximum = glm::max(boxMaximum, bounds.center + bounds.extents);
+        centerMinimum = glm::min(centerMinimum, bounds.center);
+        centerMaximum = glm::max(centerMaximum, bounds.center);
+    }
+
+    int nodeIndex = (int)m_nodes.size();
+    BVH_NODE node;
+    node.center = (boxMinimum + boxMaximum) * 0.5f;
+    node.extents = (boxMaximum - boxMinimum) * 0.5f;
+    node.firstObject = first;
+    node.objectCount = count;
+    node.rightChild = -1;
+    m_nodes.push_back(node);
+
+    if (count <= MAX_LEAF_OBJECTS)
+        return;
+
+    glm::vec3 spread = centerMaximum - centerMinimum;
+    int axis = 0;
+    if (spread.y > spread[axis])
+        axis = 1;
+    if (spread.z > spread[axis])
+        axis = 2;
+
+    int half = count / 2;
+    const std::vector<BOUNDS>& objects = m_objects;
+    std::nth_element(m_order.begin() + first, m_order.begin() + first + half, m_order.begin() + first + count,
+        [&objects, axis](int a, int b) { return objects[a].center[axis] < objects[b].center[axis]; });
+
+    BuildNode(first, half);
+    int rightChild = (int)m_nodes.size();
+    BuildNode(first + half, count - half);
+    m_nodes[nodeIndex].rightChild = rightChild;
+}
+
+/***********************************************************
+ *  TestBox()
+ *
+ *  This method compares the distance of the box center to
+ *  each plane with the box's projected radius on the plane
+ *  normal. The box is outside if it is behind any plane and
+ *  inside if it is in front of all of them.
+ ***********************************************************/
+FrustumCuller::CULL_RESULT FrustumCuller::TestBox(const glm::vec3& center, const glm::vec3& extents) const
+{
+    bool intersecting = false;
+
+#ifdef FRUSTUM_CULLER_SSE
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 centerX = _mm_set1_ps(center.x);
+    const __m128 centerY = _mm_set1_ps(center.y);
+    const __m128 centerZ = _mm_set1_ps(center.z);
+    const __m128 extentX = _mm_set1_ps(extents.x);
+    const __m128 extentY = _mm_set1_ps(extents.y);
+    const __m128 extentZ = _mm_set1_ps(extents.z);
+
+    for (int group = 0; group < PADDED_PLANE_COUNT; group += 4)
+    {
+        __m128 planeX = _mm_loadu_ps(m_planeX + group);
+        __m128 planeY = _mm_loadu_ps(m_planeY + group);
+        __m128 planeZ = _mm_loadu_ps(m_planeZ + group);
+        __m128 planeW = _mm_loadu_ps(m_planeW + group);
+
+        __m128 distance = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(planeX, centerX), _mm_mul_ps(planeY, centerY)),
+            _mm_add_ps(_mm_mul_ps(planeZ, centerZ), planeW));
+        __m128 radius = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, planeX), extentX),
+                _mm_mul_ps(_mm_andnot_ps(signMask, planeY), extentY)),
+            _mm_mul_ps(_mm_andnot_ps(signMask, planeZ), extentZ));
+
+        if (_mm_movemask_ps(_mm_cmplt_ps(distance, _mm_xor_ps(radius, signMask))))
+            return CULL_OUTSIDE;
+        if (_mm_movemask_ps(_mm_cmplt_ps(distance, radius)))
+            intersecting = true;
+    }
+#else
+    for (int i = 0; i < FRUSTUM_PLANE_COUNT; ++i)
+    {
+        float distance = m_planeX[i] * center.x + m_planeY[i] * center.y + m_planeZ[i] * center.z + m_planeW[i];
+        float radius = std::fabs(m_planeX[i]) * extents.x + std::fabs(m_planeY[i]) * extents.y + std::fabs(m_planeZ[i]) * extents.z;
+
+        if (distance < -radius)
+            return CULL_OUTSIDE;
+        if (distance < radius)
+            intersecting = true;
+    }
+#endif
+
+    return intersecting ? CULL_INTERSECTING : CULL_INSIDE;
+}
+
+/***********************************************************
+ *  WalkNode()
+ ***********************************************************/
+int FrustumCuller::WalkNode(int nodeIndex, std::vector<int>& visible, std::vector<int>& stack) const
+{
+    int nodesTested = 0;
+    stack.clear();
+    stack.push_back(nodeIndex);
+    while (!stack.empty())
+    {
+        int index = stack.back();
+        stack.pop_back();
+        const BVH_NODE& node = m_nodes[index];
+
+        ++nodesTested;
+        CULL_RESULT result = TestBox(node.center, node.extents);
+        if (result == CULL_OUTSIDE)
+            continue;
+        if (result == CULL_INSIDE)
+        {
+            AcceptNode(node, visible);
+            continue;
+        }
+
+        if (node.rightChild < 0)
+        {
+            // a leaf crossing a plane tests its objects individually
+            for (int i = 0; i < node.objectCount; ++i)
+            {
+                int object = m_order[node.firstObject + i];
+                if (TestBox(m_objects[object].center, m_objects[object].extents) != CULL_OUTSIDE)
+                    visible.push_back(object);
+            }
+            continue;
+        }
+
+        stack.push_back(node.rightChild);
+        stack.push_back(index + 1);
+    }
+    return nodesTested;
+}
+
+/***********************************************************
+ *  AcceptNode()
+ ***********************************************************/
+void FrustumCuller::AcceptNode(const BVH_NODE& node, std::vector<int>& visible) const
+{
+    for (int i = 0; i < node.objectCount; ++i)
+        visible.push_back(m_order[node.firstObject + i]);
+}
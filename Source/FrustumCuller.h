@@ -0,0 +1,131 @@
+///////////////////////////////////////////////////////////////////////////////
+// FrustumCuller.h
+// ===============
+// Skips scene objects that lie outside the view frustum
+//
+//  Every queued object carries a world-space bounding box and sphere. A
+//  bounding volume hierarchy is built over the boxes each frame and walked
+//  against the six frustum planes, so whole groups of objects are accepted
+//  or rejected with a single test. Below the top of the tree the walk splits
+//  into subtrees that can be tested on several threads at once. Boxes are
+//  tested against four planes at a time with SSE where the compiler targets
+//  it.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/***********************************************************
+ *  FrustumCuller
+ *
+ *  This class collects the bounds of one frame's objects and
+ *  returns the indices of the objects inside the frustum.
+ ***********************************************************/
+class FrustumCuller
+{
+public:
+    // axis-aligned box and the sphere enclosing it
+    struct BOUNDS
+    {
+        glm::vec3 center;
+        glm::vec3 extents;
+        float radius;
+    };
+
+    // culling results for one frame
+    struct CULL_STATS
+    {
+        int objects;
+        int visible;
+        int culled;
+        int nodesTested;
+    };
+
+    // constructor
+    FrustumCuller();
+
+    // bounds of the box between two corners
+    static BOUNDS MakeBounds(const glm::vec3& minimum, const glm::vec3& maximum);
+    // world bounds of local bounds placed by a model matrix
+    static BOUNDS TransformBounds(const BOUNDS& bounds, const glm::mat4& model);
+
+    // remove every object
+    void Clear();
+    // add an object, returning its index
+    int AddObject(const BOUNDS& bounds);
+    // size the object list, for filling it from several threads
+    void SetObjectCount(int count);
+    // replace one object, safe to call from several threads for different objects
+    void SetObject(int index, const BOUNDS& bounds);
+    // bounds of an object
+    const BOUNDS& GetObject(int index) const;
+    // extract the frustum planes from a view-projection matrix
+    void SetFrustum(const glm::mat4& viewProjection);
+    // build the hierarchy and collect the visible objects in index order
+    void Cull(std::vector<int>& visible);
+
+    // Cull in parts: build the hierarchy and split the walk into tasks,
+    // run every task, from several threads if wanted, then pass the totals
+    int BeginCull();
+    void CullTask(int task, std::vector<int>& visible, int& nodesTested) const;
+    void EndCull(int visibleCount, int nodesTested);
+
+    // results of the last Cull
+    CULL_STATS GetStats() const;
+
+private:
+    // where a box lies relative to the frustum
+    enum CULL_RESULT
+    {
+        CULL_OUTSIDE = 0,
+        CULL_INTERSECTING,
+        CULL_INSIDE
+    };
+
+    // hierarchy node covering a contiguous range of m_order
+    struct BVH_NODE
+    {
+        glm::vec3 center;
+        glm::vec3 extents;
+        int firstObject;
+        int objectCount;
+        // index of the second child, the first follows the node
+        int rightChild;
+    };
+
+    // subtree left to walk after BeginCull, already known to be inside
+    // the frustum when its root was accepted on the way down
+    struct CULL_TASK
+    {
+        int node;
+        bool inside;
+    };
+
+    std::vector<BOUNDS> m_objects;
+    std::vector<int> m_order;
+    std::vector<BVH_NODE> m_nodes;
+    std::vector<int> m_stack;
+    std::vector<CULL_TASK> m_tasks;
+
+    // planes as structure of arrays, padded to two groups of four, read
+    // unaligned as the culler lives inside heap objects that new only
+    // aligns to 8 bytes on 32-bit builds
+    float m_planeX[8];
+    float m_planeY[8];
+    float m_planeZ[8];
+    float m_planeW[8];
+
+    CULL_STATS m_stats;
+
+    // build the node covering m_order[first, first + count)
+    void BuildNode(int first, int count);
+    // test a box against the frustum planes
+    CULL_RESULT TestBox(const glm::vec3& center, const glm::vec3& extents) const;
+    // accept every object below a node without testing them
+    void AcceptNode(const BVH_NODE& node, std::vector<int>& visible) const;
+    // walk the subtree below a node, returning the nodes tested
+    int WalkNode(int nodeIndex, std::vector<int>& visible, std::vector<int>& stack) const;
+};
@@ -0,0 +1,366 @@
+///////////////////////////////////////////////////////////////////////////////
+// GLStateCache.cpp
+// ================
+// Shadow copy of the GL state the renderer sets, dropping redundant calls
+//
+//  Uniform locations are looked up once per program and name, and the last
+//  value written to each is kept, so setting a uniform to the value it
+//  already has issues no GL call. Values are set by name for every program
+//  at once: a program made current receives the values set while another
+//  was current, so variants of one shader can be switched freely. The bound
+//  program, the textures of each unit and the blend, depth and color mask
+//  state are shadowed the same way. Code that changes tracked state behind
+//  the cache's back must call Invalidate afterwards.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "GLStateCache.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstring>
+
+namespace
+{
+    // capabilities shadowed by SetCapability, by slot
+    const GLenum TRACKED_CAPABILITIES[] = { GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE };
+
+    // bytes of a value of each uniform type
+    const size_t UNIFORM_SIZES[] = { sizeof(int), sizeof(float), 2 * sizeof(float),
+        3 * sizeof(float), 4 * sizeof(float), 16 * sizeof(float) };
+}
+
+/***********************************************************
+ *  GLStateCache()
+ ***********************************************************/
+GLStateCache::GLStateCache()
+{
+    m_program = 0;
+    m_programKnown = false;
+    m_uniforms = nullptr;
+    m_stats = STATE_STATS();
+    Invalidate();
+}
+
+/***********************************************************
+ *  UseProgram()
+ *
+ *  This method makes the passed program current and issues
+ *  the uniform values set since it was last current, so it
+ *  draws with the same values as the program before it.
+ ***********************************************************/
+void GLStateCache::UseProgram(GLuint program)
+{
+    if (!Issue(!m_programKnown || program != m_program))
+        return;
+
+    glUseProgram(program);
+    m_program = program;
+    m_programKnown = true;
+    m_uniforms = &m_programUniforms[program];
+
+    for (int index = 0; index < (int)m_uniformValues.size(); ++index)
+    {
+        if (m_uniformValues[index].set && ApplyUniform(index))
+            Issue(true);
+    }
+}
+
+/***********************************************************
+ *  SetBoolValue()
+ ***********************************************************/
+void GLStateCache::SetBoolValue(const std::string& name, bool value)
+{
+    SetIntValue(name, value ? 1 : 0);
+}
+
+/***********************************************************
+ *  SetIntValue()
+ ***********************************************************/
+void GLStateCache::SetIntValue(const std::string& name, int value)
+{
+    SetUniform(name, UNIFORM_INT, &value);
+}
+
+/***********************************************************
+ *  SetFloatValue()
+ ***********************************************************/
+void GLStateCache::SetFloatValue(const std::string& name, float value)
+{
+    SetUniform(name, UNIFORM_FLOAT, &value);
+}
+
+/***********************************************************
+ *  SetVec2Value()
+ ***********************************************************/
+void GLStateCache::SetVec2Value(const std::string& name, const glm::vec2& value)
+{
+    SetUniform(name, UNIFORM_VEC2, glm::value_ptr(value));
+}
+
+/***********************************************************
+ *  SetVec3Value()
+ ***********************************************************/
+void GLStateCache::SetVec3Value(const std::string& name, const glm::vec3& value)
+{
+    SetUniform(name, UNIFORM_VEC3, glm::value_ptr(value));
+}
+
+/***********************************************************
+ *  SetVec4Value()
+ ***********************************************************/
+void GLStateCache::SetVec4Value(const std::string& name, const glm::vec4& value)
+{
+    SetUniform(name, UNIFORM_VEC4, glm::value_ptr(value));
+}
+
+/***********************************************************
+ *  SetMat4Value()
+ ***********************************************************/
+void GLStateCache::SetMat4Value(const std::string& name, const glm::mat4& value)
+{
+    SetUniform(name, UNIFORM_MAT4, glm::value_ptr(value));
+}
+
+/***********************************************************
+ *  BindTexture()
+ ***********************************************************/
+void GLStateCache::BindTexture(int unit, GLenum target, GLuint texture)
+{
+    if (unit < 0 || unit >= MAX_TEXTURE_UNITS)
+        return;
+
+    if (!Issue(m_boundTargets[unit] != target || m_boundTextures[unit] != texture))
+        return;
+
+    if (Issue(unit != m_activeUnit))
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        m_activeUnit = unit;
+    }
+    glBindTexture(target, texture);
+    m_boundTargets[unit] = target;
+    m_boundTextures[unit] = texture;
+}
+
+/***********************************************************
+ *  SetCapability()
+ ***********************************************************/
+void GLStateCache::SetCapability(GLenum capability, bool enable)
+{
+    int tracked = -1;
+    for (int i = 0; i < CAPABILITY_COUNT; ++i)
+    {
+        if (TRACKED_CAPABILITIES[i] == capability)
+            tracked = i;
+    }
+
+    if (tracked >= 0 && !Issue(m_capabilities[tracked] != (int)enable))
+        return;
+    if (tracked < 0)
+        Issue(true);
+
+    if (enable)
+        glEnable(capability);
+    else
+        glDisable(capability);
+    if (tracked >= 0)
+        m_capabilities[tracked] = enable ? 1 : 0;
+}
+
+/***********************************************************
+ *  SetBlendFunc()
+ ***********************************************************/
+void GLStateCache::SetBlendFunc(GLenum source, GLenum destination)
+{
+    if (!Issue(source != m_blendSource || destination != m_blendDestination))
+        return;
+
+    glBlendFunc(source, destination);
+    m_blendSource = source;
+    m_blendDestination = destination;
+}
+
+/***********************************************************
+ *  SetDepthFunc()
+ ***********************************************************/
+void GLStateCache::SetDepthFunc(GLenum function)
+{
+    if (!Issue(function != m_depthFunc))
+        return;
+
+    glDepthFunc(function);
+    m_depthFunc = function;
+}
+
+/***********************************************************
+ *  SetDepthMask()
+ ***********************************************************/
+void GLStateCache::SetDepthMask(bool write)
+{
+    if (!Issue(m_depthMask != (int)write))
+        return;
+
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+    m_depthMask = write ? 1 : 0;
+}
+
+/***********************************************************
+ *  SetColorMask()
+ ***********************************************************/
+void GLStateCache::SetColorMask(bool write)
+{
+    if (!Issue(m_colorMask != (int)write))
+        return;
+
+    GLboolean mask = write ? GL_TRUE : GL_FALSE;
+    glColorMask(mask, mask, mask, mask);
+    m_colorMask = write ? 1 : 0;
+}
+
+/***********************************************************
+ *  Invalidate()
+ *
+ *  This method forgets every shadowed value but keeps the
+ *  uniform locations, which only change with the program.
+ ***********************************************************/
+void GLStateCache::Invalidate()
+{
+    m_programKnown = false;
+    for (auto& program : m_programUniforms)
+    {
+        for (UNIFORM_SLOT& slot : program.second)
+            slot.known = false;
+    }
+
+    m_activeUnit = -1;
+    for (int unit = 0; unit < MAX_TEXTURE_UNITS; ++unit)
+    {
+        m_boundTextures[unit] = 0;
+        m_boundTargets[unit] = GL_NONE;
+    }
+
+    for (int i = 0; i < CAPABILITY_COUNT; ++i)
+        m_capabilities[i] = -1;
+    m_blendSource = GL_NONE;
+    m_blendDestination = GL_NONE;
+    m_depthFunc = GL_NONE;
+    m_depthMask = -1;
+    m_colorMask = -1;
+}
+
+/***********************************************************
+ *  ResetStats()
+ ***********************************************************/
+void GLStateCache::ResetStats()
+{
+    m_stats = STATE_STATS();
+}
+
+/***********************************************************
+ *  GetStats()
+ ***********************************************************/
+GLStateCache::STATE_STATS GLStateCache::GetStats() const
+{
+    return m_stats;
+}
+
+/***********************************************************
+ *  SetUniform()
+ ***********************************************************/
+void GLStateCache::SetUniform(const std::string& name, UNIFORM_TYPE type, const void* value)
+{
+    int index = FindUniform(name);
+    UNIFORM_VALUE& uniform = m_uniformValues[index];
+    uniform.type = type;
+    uniform.set = true;
+    std::memcpy(uniform.value, value, UNIFORM_SIZES[type]);
+
+    Issue(m_uniforms && ApplyUniform(index));
+}
+
+/***********************************************************
+ *  FindUniform()
+ ***********************************************************/
+int GLStateCache::FindUniform(const std::string& name)
+{
+    auto found = m_uniformIndices.find(name);
+    if (found != m_uniformIndices.end())
+        return found->second;
+
+    UNIFORM_VALUE uniform = UNIFORM_VALUE();
+    uniform.name = name;
+    uniform.set = false;
+    m_uniformIndices[name] = (int)m_uniformValues.size();
+    m_uniformValues.push_back(uniform);
+    return (int)m_uniformValues.size() - 1;
+}
+
+/***********************************************************
+ *  ApplyUniform()
+ *
+ *  This method also reports a uniform the program does not
+ *  use as unchanged, since setting it would have no effect.
+ *  Its location is looked up the first time the program
+ *  needs it.
+ ***********************************************************/
+bool GLStateCache::ApplyUniform(int index)
+{
+    if ((int)m_uniforms->size() <= index)
+        m_uniforms->resize(index + 1, UNIFORM_SLOT());
+
+    const UNIFORM_VALUE& uniform = m_uniformValues[index];
+    UNIFORM_SLOT& slot = (*m_uniforms)[index];
+    if (!slot.located)
+    {
+        slot.location = glGetUniformLocation(m_program, uniform.name.c_str());
+        slot.located = true;
+    }
+
+    size_t bytes = UNIFORM_SIZES[uniform.type];
+    if (slot.location < 0)
+        return false;
+    if (slot.known && std::memcmp(slot.value, uniform.value, bytes) == 0)
+        return false;
+
+    std::memcpy(slot.value, uniform.value, bytes);
+    slot.known = true;
+
+    switch (uniform.type)
+    {
+    case UNIFORM_INT:
+    {
+        int value;
+        std::memcpy(&value, uniform.value, sizeof(value));
+        glUniform1i(slot.location, value);
+        break;
+    }
+    case UNIFORM_FLOAT:
+        glUniform1f(slot.location, uniform.value[0]);
+        break;
+    case UNIFORM_VEC2:
+        glUniform2fv(slot.location, 1, uniform.value);
+        break;
+    case UNIFORM_VEC3:
+        glUniform3fv(slot.location, 1, uniform.value);
+        break;
+    case UNIFORM_VEC4:
+        glUniform4fv(slot.location, 1, uniform.value);
+        break;
+    case UNIFORM_MAT4:
+        glUniformMatrix4fv(slot.location, 1, GL_FALSE, uniform.value);
+        break;
+    }
+    return true;
+}
+
+/***********************************************************
+ *  Issue()
+ ***********************************************************/
+bool GLStateCache::Issue(bool changed)
+{
+    if (changed)
+        ++m_stats.issued;
+    else
+        ++m_stats.suppressed;
+    return changed;
+}
@@ -0,0 +1,142 @@
+///////////////////////////////////////////////////////////////////////////////
+// GLStateCache.h
+// ==============
+// Shadow copy of the GL state the renderer sets, dropping redundant calls
+//
+//  Uniform locations are looked up once per program and name, and the last
+//  value written to each is kept, so setting a uniform to the value it
+//  already has issues no GL call. Values are set by name for every program
+//  at once: a program made current receives the values set while another
+//  was current, so variants of one shader can be switched freely. The bound
+//  program, the textures of each unit and the blend, depth and color mask
+//  state are shadowed the same way. Code that changes tracked state behind
+//  the cache's back must call Invalidate afterwards.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/***********************************************************
+ *  GLStateCache
+ *
+ *  This class sets uniforms and fixed-function state through
+ *  a shadow copy of their current values, and counts the GL
+ *  calls it issued and suppressed.
+ ***********************************************************/
+class GLStateCache
+{
+public:
+    // GL calls since the last ResetStats
+    struct STATE_STATS
+    {
+        int issued;
+        int suppressed;
+    };
+
+    // constructor
+    GLStateCache();
+
+    // make the passed program current, bringing its uniforms up to date
+    void UseProgram(GLuint program);
+
+    // uniforms of every program, by name
+    void SetBoolValue(const std::string& name, bool value);
+    void SetIntValue(const std::string& name, int value);
+    void SetFloatValue(const std::string& name, float value);
+    void SetVec2Value(const std::string& name, const glm::vec2& value);
+    void SetVec3Value(const std::string& name, const glm::vec3& value);
+    void SetVec4Value(const std::string& name, const glm::vec4& value);
+    void SetMat4Value(const std::string& name, const glm::mat4& value);
+
+    // bind a texture to a texture unit, selecting the unit only when needed
+    void BindTexture(int unit, GLenum target, GLuint texture);
+
+    // GL_BLEND, GL_DEPTH_TEST and GL_CULL_FACE are tracked, others pass through
+    void SetCapability(GLenum capability, bool enable);
+    void SetBlendFunc(GLenum source, GLenum destination);
+    void SetDepthFunc(GLenum function);
+    void SetDepthMask(bool write);
+    void SetColorMask(bool write);
+
+    // forget every shadowed value, so the next call of each is issued
+    void Invalidate();
+
+    // counting of issued and suppressed calls
+    void ResetStats();
+    STATE_STATS GetStats() const;
+
+private:
+    // texture units whose bindings are shadowed
+    static const int MAX_TEXTURE_UNITS = 8;
+    // capabilities whose enable state is shadowed
+    static const int CAPABILITY_COUNT = 3;
+
+    // kinds of uniform value, selecting the glUniform call
+    enum UNIFORM_TYPE
+    {
+        UNIFORM_INT = 0,
+        UNIFORM_FLOAT,
+        UNIFORM_VEC2,
+        UNIFORM_VEC3,
+        UNIFORM_VEC4,
+        UNIFORM_MAT4
+    };
+
+    // value last set for one uniform name
+    struct UNIFORM_VALUE
+    {
+        std::string name;
+        UNIFORM_TYPE type;
+        bool set;
+        float value[16];
+    };
+
+    // location of one uniform in a program and the value it last received
+    struct UNIFORM_SLOT
+    {
+        GLint location;
+        bool located;
+        bool known;
+        float value[16];
+    };
+
+    GLuint m_program;
+    bool m_programKnown;
+    std::unordered_map<std::string, int> m_uniformIndices;
+    std::vector<UNIFORM_VALUE> m_uniformValues;
+    // slots of every program used, by uniform index
+    std::unordered_map<GLuint, std::vector<UNIFORM_SLOT>> m_programUniforms;
+    // slots of the current program, null before the first UseProgram
+    std::vector<UNIFORM_SLOT>* m_uniforms;
+
+    int m_activeUnit;
+    GLuint m_boundTextures[MAX_TEXTURE_UNITS];
+    GLenum m_boundTargets[MAX_TEXTURE_UNITS];
+
+    // -1 unknown, otherwise 0 or 1
+    int m_capabilities[CAPABILITY_COUNT];
+    GLenum m_blendSource;
+    GLenum m_blendDestination;
+    GLenum m_depthFunc;
+    int m_depthMask;
+    int m_colorMask;
+
+    STATE_STATS m_stats;
+
+    // record the value of a uniform and pass it to the current program
+    void SetUniform(const std::string& name, UNIFORM_TYPE type, const void* value);
+    // index of a uniform name, created on first use
+    int FindUniform(const std::string& name);
+    // true, after issuing the glUniform call, when the current program
+    // uses the uniform and has not received its value yet
+    bool ApplyUniform(int index);
+    // count one call as issued or suppressed and return whether to issue it
+    bool Issue(bool changed);
+};
@@ -0,0 +1,288 @@
+///////////////////////////////////////////////////////////////////////////////
+// HeadlessContext.cpp
+// ===================
+// Offscreen OpenGL context and framebuffer for windowless rendering
+//
+//  Used by the headless benchmark mode so the scene can be rendered on
+//  machines without a display, e.g. CI boxes running llvmpipe. Elsewhere
+//  a hidden GLFW window provides the context, so the benchmark also runs
+//  from the Windows project, though it then needs a desktop session.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "HeadlessContext.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <vector>
+
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include "GLFW/glfw3.h"
+#endif
+
+namespace
+{
+#if defined(__linux__)
+    // context versions to try, newest first (llvmpipe tops out at 4.5)
+    const EGLint g_ContextVersions[][2] = { { 4, 6 }, { 4, 5 }, { 4, 4 } };
+
+    bool HasExtension(const char* extensions, const char* name)
+    {
+        if (!extensions)
+            return false;
+
+        size_t length = strlen(name);
+        const char* start = extensions;
+        while ((start = strstr(start, name)) != nullptr)
+        {
+            const char end = start[length];
+            if ((start == extensions || start[-1] == ' ') && (end == ' ' || end == '\0'))
+                return true;
+            start += length;
+        }
+        return false;
+    }
+#endif
+}
+
+/***********************************************************
+ *  HeadlessContext()
+ ***********************************************************/
+HeadlessContext::HeadlessContext()
+{
+    m_display = nullptr;
+    m_context = nullptr;
+    m_window = nullptr;
+    m_framebuffer = 0;
+    m_colorBuffer = 0;
+    m_depthBuffer = 0;
+    m_width = 0;
+    m_height = 0;
+}
+
+/***********************************************************
+ *  ~HeadlessContext()
+ ***********************************************************/
+HeadlessContext::~HeadlessContext()
+{
+    Destroy();
+}
+
+/***********************************************************
+ *  CreateContext()
+ *
+ *  This method creates an OpenGL core profile context with
+ *  no default surface. The Mesa surfaceless platform is used
+ *  when present so that no X or Wayland server is needed.
+ *  Without EGL, the context belongs to a window that is
+ *  never shown; its own framebuffer is not used.
+ ***********************************************************/
+bool HeadlessContext::CreateContext()
+{
+#if defined(__linux__)
+    EGLDisplay display = EGL_NO_DISPLAY;
+
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major = 0, minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+    {
+        std::cout << "Failed to initialize EGL display" << std::endl;
+        return false;
+    }
+    m_display = display;
+
+    if (!HasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context"))
+    {
+        std::cout << "EGL display does not support surfaceless contexts" << std::endl;
+        Destroy();
+        return false;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        std::cout << "Failed to bind the desktop OpenGL API" << std::endl;
+        Destroy();
+        return false;
+    }
+
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config = nullptr;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0)
+        config = nullptr;
+
+    EGLContext context = EGL_NO_CONTEXT;
+    for (const EGLint* version : g_ContextVersions)
+    {
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, version[0],
+            EGL_CONTEXT_MINOR_VERSION, version[1],
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context != EGL_NO_CONTEXT)
+            break;
+    }
+    if (context == EGL_NO_CONTEXT)
+    {
+        std::cout << "Failed to create a headless OpenGL context" << std::endl;
+        Destroy();
+        return false;
+    }
+    m_context = context;
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        std::cout << "Failed to make the headless context current" << std::endl;
+        Destroy();
+        return false;
+    }
+
+    std::cout << "INFO: EGL " << major << "." << minor << " surfaceless context created" << std::endl;
+    return true;
+#else
+    if (!glfwInit())
+    {
+        std::cout << "Failed to initialize GLFW" << std::endl;
+        return false;
+    }
+
+    glfwDefaultWindowHints();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    m_window = glfwCreateWindow(1, 1, "Headless", nullptr, nullptr);
+    if (!m_window)
+    {
+        std::cout << "Failed to create a headless OpenGL context" << std::endl;
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(m_window);
+
+    std::cout << "INFO: hidden GLFW window context created" << std::endl;
+    return true;
+#endif
+}
+
+/***********************************************************
+ *  CreateRenderTarget()
+ *
+ *  This method creates the framebuffer object the scene is
+ *  rendered into, since a surfaceless context has no default
+ *  framebuffer. The target stays bound for the whole run.
+ ***********************************************************/
+bool HeadlessContext::CreateRenderTarget(int width, int height)
+{
+    m_width = width;
+    m_height = height;
+
+    glGenRenderbuffers(1, &m_colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &m_depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &m_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Offscreen framebuffer is incomplete" << std::endl;
+        return false;
+    }
+
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+/***********************************************************
+ *  SaveRenderTarget()
+ *
+ *  This method reads back the render target and writes it
+ *  as a binary PPM, flipped so the image is upright.
+ ***********************************************************/
+bool HeadlessContext::SaveRenderTarget(const char* filename) const
+{
+    if (!m_framebuffer)
+        return false;
+
+    std::vector<unsigned char> pixels(m_width * m_height * 3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, m_width, m_height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "Failed to open " << filename << " for writing" << std::endl;
+        return false;
+    }
+
+    file << "P6\n" << m_width << " " << m_height << "\n255\n";
+    for (int row = m_height - 1; row >= 0; --row)
+        file.write((const char*)&pixels[row * m_width * 3], m_width * 3);
+
+    return true;
+}
+
+/***********************************************************
+ *  Destroy()
+ ***********************************************************/
+void HeadlessContext::Destroy()
+{
+    if (m_framebuffer)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &m_framebuffer);
+        glDeleteRenderbuffers(1, &m_colorBuffer);
+        glDeleteRenderbuffers(1, &m_depthBuffer);
+        m_framebuffer = 0;
+        m_colorBuffer = 0;
+        m_depthBuffer = 0;
+    }
+
+#if defined(__linux__)
+    if (m_display)
+    {
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (m_context)
+            eglDestroyContext(m_display, m_context);
+        eglTerminate(m_display);
+    }
+#else
+    if (m_window)
+    {
+        glfwMakeContextCurrent(nullptr);
+        glfwDestroyWindow(m_window);
+        m_window = nullptr;
+        glfwTerminate();
+    }
+#endif
+    m_context = nullptr;
+    m_display = nullptr;
+}
@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////////////
+// HeadlessContext.h
+// =================
+// Offscreen OpenGL context and framebuffer for windowless rendering
+//
+//  Used by the headless benchmark mode so the scene can be rendered on
+//  machines without a display, e.g. CI boxes running llvmpipe. Elsewhere
+//  a hidden GLFW window provides the context, so the benchmark also runs
+//  from the Windows project, though it then needs a desktop session.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+struct GLFWwindow;
+
+/***********************************************************
+ *  HeadlessContext
+ *
+ *  This class creates a surfaceless EGL context on Linux,
+ *  or the context of a hidden GLFW window elsewhere, and an
+ *  offscreen framebuffer object that takes the place of the
+ *  GLFW display window's default framebuffer.
+ ***********************************************************/
+class HeadlessContext
+{
+public:
+    // constructor
+    HeadlessContext();
+    // destructor
+    ~HeadlessContext();
+
+    // create an OpenGL context without a visible surface and make it current
+    bool CreateContext();
+    // create and bind the offscreen render target (needs GLEW)
+    bool CreateRenderTarget(int width, int height);
+    // write the current contents of the render target to a PPM image
+    bool SaveRenderTarget(const char* filename) const;
+    // release the render target and the context
+    void Destroy();
+
+private:
+    // EGL handles, kept opaque so EGL headers stay out of this header
+    void* m_display;
+    void* m_context;
+    // hidden window holding the context where EGL is not used
+    GLFWwindow* m_window;
+
+    // offscreen render target
+    GLuint m_framebuffer;
+    GLuint m_colorBuffer;
+    GLuint m_depthBuffer;
+    int m_width;
+    int m_height;
+};
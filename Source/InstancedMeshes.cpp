@@ -0,0 +1,543 @@
+///////////////////////////////////////////////////////////////////////////////
+// InstancedMeshes.cpp
+// ===================
+// Instanced and indirect drawing of the basic shapes from shared buffers
+//
+//  Every shape is suballocated from one vertex buffer and one index buffer
+//  bound to a single vertex array, so switching shapes only changes the
+//  index range of a draw. Curved shapes are built at several tessellation
+//  levels of detail, and every level is reordered for the vertex cache as
+//  it is loaded. Vertices are stored as floats or packed into 16 bytes,
+//  with positions quantized to each mesh's bounds and octahedral normals.
+//  Copies of a shape read their model matrix, UV
+//  scale, material index and texture layer from a per-instance vertex
+//  buffer, and a whole frame can be issued as one multi-draw indirect call
+//  whose draws read their color and texture flag by gl_DrawID.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "InstancedMeshes.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+    // tessellation of the curved shapes at each level of detail, finest first
+    const int SPHERE_SLICES[InstancedMeshes::MAX_LODS] = { 40, 20, 12 };
+    const int SPHERE_STACKS[InstancedMeshes::MAX_LODS] = { 20, 10, 6 };
+    const int ROUND_SLICES[InstancedMeshes::MAX_LODS] = { 36, 18, 10 };
+    const int TORUS_RING_SLICES[InstancedMeshes::MAX_LODS] = { 40, 20, 12 };
+    const int TORUS_TUBE_SLICES[InstancedMeshes::MAX_LODS] = { 16, 8, 6 };
+    // the tube thickness ShapeMeshes' torus is loaded with
+    const float TORUS_TUBE_RADIUS = 0.2f;
+
+    // shader attribute locations
+    const GLuint POSITION_LOCATION = 0;
+    const GLuint NORMAL_LOCATION = 1;
+    const GLuint UV_LOCATION = 2;
+    const GLuint INSTANCE_MODEL_LOCATION = 3;
+    const GLuint INSTANCE_UV_SCALE_LOCATION = 7;
+    // material index and texture layer share one ivec2
+    const GLuint INSTANCE_INDICES_LOCATION = 8;
+
+    // initial instance buffer size, grown on demand
+    const int INITIAL_INSTANCE_CAPACITY = 256;
+
+    // shader storage binding of the per-draw data, must match vertexShader.glsl
+    const GLuint DRAW_BLOCK_BINDING = 4;
+
+    /***********************************************************
+     *  ChordError()
+     *
+     *  Largest gap between a circle and the polygon of the
+     *  passed number of segments inscribed in it.
+     ***********************************************************/
+    float ChordError(float radius, int segments)
+    {
+        return radius * (1.0f - std::cos(3.14159265f / segments));
+    }
+}
+
+/***********************************************************
+ *  InstancedMeshes()
+ ***********************************************************/
+InstancedMeshes::InstancedMeshes()
+{
+    for (MESH_LODS& mesh : m_meshes)
+    {
+        for (int lod = 0; lod < MAX_LODS; ++lod)
+        {
+            mesh.ranges[lod].firstIndex = 0;
+            mesh.ranges[lod].indexCount = 0;
+            mesh.ranges[lod].baseVertex = 0;
+            mesh.ranges[lod].vertexCount = 0;
+            mesh.errors[lod] = 0.0f;
+        }
+        mesh.lodCount = 0;
+        mesh.localBounds = FrustumCuller::MakeBounds(glm::vec3(0.0f), glm::vec3(0.0f));
+        mesh.positionScale = glm::vec3(1.0f);
+        mesh.positionOffset = glm::vec3(0.0f);
+    }
+    m_vertexFormat = VERTEX_FLOAT;
+    m_vao = 0;
+    m_vertexBuffer = 0;
+    m_indexBuffer = 0;
+    m_instanceBuffer = 0;
+    m_instanceCapacity = 0;
+    m_commandBuffer = 0;
+    m_drawDataBuffer = 0;
+    m_supportsIndirect = false;
+}
+
+/***********************************************************
+ *  ~InstancedMeshes()
+ ***********************************************************/
+InstancedMeshes::~InstancedMeshes()
+{
+    if (m_vao)
+    {
+        glDeleteVertexArrays(1, &m_vao);
+        glDeleteBuffers(1, &m_vertexBuffer);
+        glDeleteBuffers(1, &m_indexBuffer);
+        glDeleteBuffers(1, &m_instanceBuffer);
+    }
+    if (m_commandBuffer)
+    {
+        glDeleteBuffers(1, &m_commandBuffer);
+        glDeleteBuffers(1, &m_drawDataBuffer);
+    }
+}
+
+/***********************************************************
+ *  SetVertexFormat()
+ ***********************************************************/
+void InstancedMeshes::SetVertexFormat(VERTEX_FORMAT format)
+{
+    m_vertexFormat = format;
+}
+
+/***********************************************************
+ *  GetVertexFormat()
+ ***********************************************************/
+InstancedMeshes::VERTEX_FORMAT InstancedMeshes::GetVertexFormat() const
+{
+    return m_vertexFormat;
+}
+
+/***********************************************************
+ *  LoadMeshes()
+ *
+ *  This method builds every mesh and level of detail into
+ *  one vertex and one index array, uploads them, and sets up
+ *  the single vertex array with the per-vertex attributes
+ *  and the per-instance attributes at a divisor of one. The
+ *  flat shapes have a single level with no error. Packed
+ *  vertices are read as normalized integers that the shader
+ *  decodes.
+ ***********************************************************/
+void InstancedMeshes::LoadMeshes()
+{
+    std::vector<ShapeGeometry::SHAPE_VERTEX> vertices;
+    std::vector<uint32_t> indices;
+    ShapeGeometry::SHAPE_MESH mesh;
+
+    ShapeGeometry::BuildPlane(mesh);
+    AddMesh(RenderQueue::MESH_PLANE, 0.0f, mesh, vertices, indices);
+    ShapeGeometry::BuildBox(mesh);
+    AddMesh(RenderQueue::MESH_BOX, 0.0f, mesh, vertices, indices);
+
+    for (int lod = 0; lod < MAX_LODS; ++lod)
+    {
+        float roundError = ChordError(1.0f, ROUND_SLICES[lod]);
+        ShapeGeometry::BuildCylinder(mesh, ROUND_SLICES[lod], true, true, true);
+        AddMesh(RenderQueue::MESH_CYLINDER, roundError, mesh, vertices, indices);
+        ShapeGeometry::BuildCylinder(mesh, ROUND_SLICES[lod], false, true, true);
+        AddMesh(RenderQueue::MESH_CYLINDER_OPEN_TOP, roundError, mesh, vertices, indices);
+        ShapeGeometry::BuildCone(mesh, ROUND_SLICES[lod], true);
+        AddMesh(RenderQueue::MESH_CONE, roundError, mesh, vertices, indices);
+        ShapeGeometry::BuildTaperedCylinder(mesh, ROUND_SLICES[lod], true, true, true);
+        AddMesh(RenderQueue::MESH_TAPERED_CYLINDER, roundError, mesh, vertices, indices);
+
+        // stacks span half a circle
+        float sphereError = std::max(ChordError(1.0f, SPHERE_SLICES[lod]), ChordError(1.0f, 2 * SPHERE_STACKS[lod]));
+        ShapeGeometry::BuildSphere(mesh, SPHERE_SLICES[lod], SPHERE_STACKS[lod]);
+        AddMesh(RenderQueue::MESH_SPHERE, sphereError, mesh, vertices, indices);
+
+        float torusError = std::max(ChordError(1.0f + TORUS_TUBE_RADIUS, TORUS_RING_SLICES[lod]),
+            ChordError(TORUS_TUBE_RADIUS, TORUS_TUBE_SLICES[lod]));
+        ShapeGeometry::BuildTorus(mesh, TORUS_RING_SLICES[lod], TORUS_TUBE_SLICES[lod], TORUS_TUBE_RADIUS);
+        AddMesh(RenderQueue::MESH_TORUS, torusError, mesh, vertices, indices);
+    }
+
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+
+    glGenBuffers(1, &m_vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    glGenBuffers(1, &m_indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(POSITION_LOCATION);
+    glEnableVertexAttribArray(NORMAL_LOCATION);
+    glEnableVertexAttribArray(UV_LOCATION);
+    size_t vertexBytes = 0;
+    if (m_vertexFormat == VERTEX_PACKED)
+    {
+        std::vector<PACKED_VERTEX> packed;
+        PackVertices(vertices, packed);
+        vertexBytes = packed.size() * sizeof(PACKED_VERTEX);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, packed.data(), GL_STATIC_DRAW);
+
+        // the shader scales positions by the mesh and decodes the normal's xy
+        GLsizei stride = sizeof(PACKED_VERTEX);
+        glVertexAttribPointer(POSITION_LOCATION, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PACKED_VERTEX, position));
+        glVertexAttribPointer(NORMAL_LOCATION, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PACKED_VERTEX, normal));
+        glVertexAttribPointer(UV_LOCATION, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PACKED_VERTEX, uv));
+    }
+    else
+    {
+        vertexBytes = vertices.size() * sizeof(ShapeGeometry::SHAPE_VERTEX);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices.data(), GL_STATIC_DRAW);
+
+        GLsizei stride = sizeof(ShapeGeometry::SHAPE_VERTEX);
+        glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(ShapeGeometry::SHAPE_VERTEX, position));
+        glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(ShapeGeometry::SHAPE_VERTEX, normal));
+        glVertexAttribPointer(UV_LOCATION, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(ShapeGeometry::SHAPE_VERTEX, uv));
+    }
+    std::cout << "INFO: " << vertices.size() << " vertices  " << vertexBytes / 1024 << " KB "
+        << (m_vertexFormat == VERTEX_PACKED ? "packed" : "float") << std::endl;
+
+    glGenBuffers(1, &m_instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    m_instanceCapacity = INITIAL_INSTANCE_CAPACITY * sizeof(INSTANCE_DATA);
+    glBufferData(GL_ARRAY_BUFFER, m_instanceCapacity, nullptr, GL_STREAM_DRAW);
+    GLsizei instanceStride = sizeof(INSTANCE_DATA);
+
+    // a mat4 attribute takes four consecutive vec4 locations
+    for (GLuint column = 0; column < 4; ++column)
+    {
+        GLuint location = INSTANCE_MODEL_LOCATION + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, instanceStride,
+            (void*)(offsetof(INSTANCE_DATA, model) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+
+    glEnableVertexAttribArray(INSTANCE_UV_SCALE_LOCATION);
+    glVertexAttribPointer(INSTANCE_UV_SCALE_LOCATION, 2, GL_FLOAT, GL_FALSE, instanceStride, (void*)offsetof(INSTANCE_DATA, uvScale));
+    glVertexAttribDivisor(INSTANCE_UV_SCALE_LOCATION, 1);
+
+    glEnableVertexAttribArray(INSTANCE_INDICES_LOCATION);
+    glVertexAttribIPointer(INSTANCE_INDICES_LOCATION, 2, GL_INT, instanceStride, (void*)offsetof(INSTANCE_DATA, materialIndex));
+    glVertexAttribDivisor(INSTANCE_INDICES_LOCATION, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // multi-draw indirect is core in 4.3, gl_DrawID needs the extension below 4.6
+    m_supportsIndirect = GLEW_VERSION_4_3 && GLEW_ARB_shader_draw_parameters;
+    if (m_supportsIndirect)
+    {
+        glGenBuffers(1, &m_commandBuffer);
+        glGenBuffers(1, &m_drawDataBuffer);
+    }
+    else
+    {
+        std::cout << "GL_ARB_shader_draw_parameters is not supported, drawing without multi-draw indirect" << std::endl;
+    }
+}
+
+/***********************************************************
+ *  AddMesh()
+ *
+ *  This method reorders the next level of a mesh for the
+ *  vertex cache, reports the simulated cache cost before and
+ *  after, then appends its vertices and indices to the shared
+ *  arrays and records where they start. Indices stay
+ *  relative to the level and are offset by baseVertex. The
+ *  finest level sets the bounds.
+ ***********************************************************/
+void InstancedMeshes::AddMesh(RenderQueue::MESH_ID id, float error, ShapeGeometry::SHAPE_MESH& mesh,
+    std::vector<ShapeGeometry::SHAPE_VERTEX>& vertices, std::vector<uint32_t>& indices)
+{
+    MESH_LODS& lods = m_meshes[id];
+    if (lods.lodCount >= MAX_LODS)
+        return;
+
+    MeshOptimizer::CACHE_STATS before = MeshOptimizer::AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+    MeshOptimizer::Optimize(mesh);
+    MeshOptimizer::CACHE_STATS after = MeshOptimizer::AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "INFO: " << RenderQueue::GetMeshName(id) << " lod " << lods.lodCount
+        << "  ACMR " << before.acmr << " -> " << after.acmr
+        << "  ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+
+    MESH_RANGE& range = lods.ranges[lods.lodCount];
+    range.firstIndex = (GLuint)indices.size();
+    range.indexCount = (GLuint)mesh.indices.size();
+    range.baseVertex = (GLint)vertices.size();
+    range.vertexCount = (GLuint)mesh.vertices.size();
+    lods.errors[lods.lodCount] = error;
+
+    if (lods.lodCount == 0)
+    {
+        glm::vec3 minimum(INFINITY), maximum(-INFINITY);
+        for (const ShapeGeometry::SHAPE_VERTEX& vertex : mesh.vertices)
+        {
+            minimum = glm::min(minimum, vertex.position);
+            maximum = glm::max(maximum, vertex.position);
+        }
+        lods.localBounds = FrustumCuller::MakeBounds(minimum, maximum);
+    }
+    ++lods.lodCount;
+
+    vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+}
+
+/***********************************************************
+ *  PackVertices()
+ *
+ *  This method finds the bounds of each mesh over all its
+ *  levels, so one decode serves every level, and stores the
+ *  vertices as normalized 16-bit integers. Positions are
+ *  scaled to the bounds, and unit normals are folded onto
+ *  an octahedron and its lower half unfolded into the
+ *  square, which keeps the error even over the sphere.
+ ***********************************************************/
+void InstancedMeshes::PackVertices(const std::vector<ShapeGeometry::SHAPE_VERTEX>& vertices,
+    std::vector<PACKED_VERTEX>& packed)
+{
+    packed.resize(vertices.size());
+    for (MESH_LODS& lods : m_meshes)
+    {
+        glm::vec3 minimum(INFINITY), maximum(-INFINITY);
+        for (int lod = 0; lod < lods.lodCount; ++lod)
+        {
+            const MESH_RANGE& range = lods.ranges[lod];
+            for (GLuint v = 0; v < range.vertexCount; ++v)
+            {
+                minimum = glm::min(minimum, vertices[range.baseVertex + v].position);
+                maximum = glm::max(maximum, vertices[range.baseVertex + v].position);
+            }
+        }
+        if (lods.lodCount == 0)
+            continue;
+
+        lods.positionOffset = minimum;
+        lods.positionScale = maximum - minimum;
+
+        // a flat axis stores zero
+        glm::vec3 inverseScale(0.0f);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (lods.positionScale[axis] > 0.0f)
+                inverseScale[axis] = 1.0f / lods.positionScale[axis];
+        }
+
+        for (int lod = 0; lod < lods.lodCount; ++lod)
+        {
+            const MESH_RANGE& range = lods.ranges[lod];
+            for (GLuint v = 0; v < range.vertexCount; ++v)
+            {
+                const ShapeGeometry::SHAPE_VERTEX& vertex = vertices[range.baseVertex + v];
+                PACKED_VERTEX& out = packed[range.baseVertex + v];
+
+                glm::vec3 position = (vertex.position - minimum) * inverseScale;
+                for (int axis = 0; axis < 3; ++axis)
+                    out.position[axis] = (uint16_t)std::lround(std::min(std::max(position[axis], 0.0f), 1.0f) * 65535.0f);
+                out.position[3] = 0;
+
+                glm::vec3 normal = vertex.normal / (std::fabs(vertex.normal.x) + std::fabs(vertex.normal.y) + std::fabs(vertex.normal.z));
+                glm::vec2 octahedral(normal.x, normal.y);
+                if (normal.z < 0.0f)
+                {
+                    octahedral.x = (1.0f - std::fabs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f);
+                    octahedral.y = (1.0f - std::fabs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f);
+                }
+                out.normal[0] = (int16_t)std::lround(octahedral.x * 32767.0f);
+                out.normal[1] = (int16_t)std::lround(octahedral.y * 32767.0f);
+
+                out.uv[0] = (uint16_t)std::lround(std::min(std::max(vertex.uv.x, 0.0f), 1.0f) * 65535.0f);
+                out.uv[1] = (uint16_t)std::lround(std::min(std::max(vertex.uv.y, 0.0f), 1.0f) * 65535.0f);
+            }
+        }
+    }
+}
+
+/***********************************************************
+ *  BindMeshes()
+ *
+ *  This method binds the vertex array every mesh shares.
+ *  The draw methods expect it to be bound, so it is bound
+ *  once for all the draws of a frame rather than per draw.
+ ***********************************************************/
+void InstancedMeshes::BindMeshes() const
+{
+    glBindVertexArray(m_vao);
+}
+
+/***********************************************************
+ *  UnbindMeshes()
+ ***********************************************************/
+void InstancedMeshes::UnbindMeshes() const
+{
+    glBindVertexArray(0);
+}
+
+/***********************************************************
+ *  DrawMesh()
+ ***********************************************************/
+void InstancedMeshes::DrawMesh(RenderQueue::MESH_ID mesh, int lod)
+{
+    const MESH_RANGE& range = m_meshes[mesh].ranges[lod];
+    if (!m_vao)
+        return;
+
+    glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+        (void*)(range.firstIndex * sizeof(uint32_t)), range.baseVertex);
+}
+
+/***********************************************************
+ *  UploadInstances()
+ *
+ *  This method refills the instance buffer. The buffer
+ *  storage is orphaned first so the driver never waits on
+ *  the previous draw that read from it.
+ ***********************************************************/
+void InstancedMeshes::UploadInstances(const INSTANCE_DATA* instances, int instanceCount)
+{
+    GLsizeiptr size = instanceCount * sizeof(INSTANCE_DATA);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    while (m_instanceCapacity < size)
+        m_instanceCapacity *= 2;
+    glBufferData(GL_ARRAY_BUFFER, m_instanceCapacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/***********************************************************
+ *  DrawInstances()
+ *
+ *  This method refills the instance buffer and draws every
+ *  instance of the mesh with one call.
+ ***********************************************************/
+void InstancedMeshes::DrawInstances(RenderQueue::MESH_ID mesh, int lod, const INSTANCE_DATA* instances, int instanceCount)
+{
+    const MESH_RANGE& range = m_meshes[mesh].ranges[lod];
+    if (!m_vao || instanceCount <= 0)
+        return;
+
+    UploadInstances(instances, instanceCount);
+
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+        (void*)(range.firstIndex * sizeof(uint32_t)), instanceCount, range.baseVertex);
+}
+
+/***********************************************************
+ *  SupportsIndirect()
+ ***********************************************************/
+bool InstancedMeshes::SupportsIndirect() const
+{
+    return m_supportsIndirect;
+}
+
+/***********************************************************
+ *  MakeCommand()
+ ***********************************************************/
+InstancedMeshes::DRAW_COMMAND InstancedMeshes::MakeCommand(RenderQueue::MESH_ID mesh, int lod, int instanceCount, int baseInstance) const
+{
+    const MESH_RANGE& range = m_meshes[mesh].ranges[lod];
+
+    DRAW_COMMAND command;
+    command.count = range.indexCount;
+    command.instanceCount = (GLuint)instanceCount;
+    command.firstIndex = range.firstIndex;
+    command.baseVertex = range.baseVertex;
+    command.baseInstance = (GLuint)baseInstance;
+    return command;
+}
+
+/***********************************************************
+ *  DrawIndirect()
+ *
+ *  This method uploads the instances, the commands and the
+ *  per-draw data of a frame and issues them all with one
+ *  glMultiDrawElementsIndirect. Each command's baseInstance
+ *  offsets the instanced attributes into the shared instance
+ *  buffer, and the shader reads drawData by gl_DrawID.
+ ***********************************************************/
+void InstancedMeshes::DrawIndirect(const DRAW_COMMAND* commands, const DRAW_DATA* drawData, int commandCount,
+    const INSTANCE_DATA* instances, int instanceCount)
+{
+    if (!m_vao || !m_supportsIndirect || commandCount <= 0)
+        return;
+
+    UploadInstances(instances, instanceCount);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawDataBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, commandCount * sizeof(DRAW_DATA), drawData, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_BLOCK_BINDING, m_drawDataBuffer);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commandCount * sizeof(DRAW_COMMAND), commands, GL_STREAM_DRAW);
+
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, commandCount, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+/***********************************************************
+ *  GetLocalBounds()
+ ***********************************************************/
+const FrustumCuller::BOUNDS& InstancedMeshes::GetLocalBounds(RenderQueue::MESH_ID mesh) const
+{
+    return m_meshes[mesh].localBounds;
+}
+
+/***********************************************************
+ *  GetLodCount()
+ ***********************************************************/
+int InstancedMeshes::GetLodCount(RenderQueue::MESH_ID mesh) const
+{
+    return m_meshes[mesh].lodCount;
+}
+
+/***********************************************************
+ *  GetLodErrors()
+ ***********************************************************/
+const float* InstancedMeshes::GetLodErrors(RenderQueue::MESH_ID mesh) const
+{
+    return m_meshes[mesh].errors;
+}
+
+/***********************************************************
+ *  GetIndexCount()
+ ***********************************************************/
+int InstancedMeshes::GetIndexCount(RenderQueue::MESH_ID mesh, int lod) const
+{
+    return (int)m_meshes[mesh].ranges[lod].indexCount;
+}
+
+/***********************************************************
+ *  GetPositionScale()
+ ***********************************************************/
+glm::vec3 InstancedMeshes::GetPositionScale(RenderQueue::MESH_ID mesh) const
+{
+    return m_meshes[mesh].positionScale;
+}
+
+/***********************************************************
+ *  GetPositionOffset()
+ ***********************************************************/
+glm::vec3 InstancedMeshes::GetPositionOffset(RenderQueue::MESH_ID mesh) const
+{
+    return m_meshes[mesh].positionOffset;
+}
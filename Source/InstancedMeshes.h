@@ -0,0 +1,173 @@
+///////////////////////////////////////////////////////////////////////////////
+// InstancedMeshes.h
+// =================
+// Instanced and indirect drawing of the basic shapes from shared buffers
+//
+//  Every shape is suballocated from one vertex buffer and one index buffer
+//  bound to a single vertex array, so switching shapes only changes the
+//  index range of a draw. Curved shapes are built at several tessellation
+//  levels of detail, and every level is reordered for the vertex cache as
+//  it is loaded. Vertices are stored as floats or packed into 16 bytes,
+//  with positions quantized to each mesh's bounds and octahedral normals.
+//  Copies of a shape read their model matrix, UV
+//  scale, material index and texture layer from a per-instance vertex
+//  buffer, and a whole frame can be issued as one multi-draw indirect call
+//  whose draws read their color and texture flag by gl_DrawID.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FrustumCuller.h"
+#include "RenderQueue.h"
+#include "ShapeGeometry.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/***********************************************************
+ *  InstancedMeshes
+ *
+ *  This class owns the shared geometry buffers and vertex
+ *  array of every RenderQueue mesh, the instance buffer, and
+ *  the command and per-draw buffers of indirect draws.
+ ***********************************************************/
+class InstancedMeshes
+{
+public:
+    // per-instance attributes, shader locations 3 to 8
+    struct INSTANCE_DATA
+    {
+        glm::mat4 model;
+        glm::vec2 uvScale;
+        int materialIndex;
+        int textureLayer;
+    };
+
+    // std430 layout of one entry of the shader's DrawBlock
+    struct DRAW_DATA
+    {
+        glm::vec4 color;
+        // decode of the mesh's positions, xyz used
+        glm::vec4 positionScale;
+        glm::vec4 positionOffset;
+    };
+
+    // layouts of the shared vertex buffer
+    enum VERTEX_FORMAT
+    {
+        // 32 bytes, float position, normal and UV
+        VERTEX_FLOAT = 0,
+        // 16 bytes, 16-bit position, octahedral normal and UV
+        VERTEX_PACKED
+    };
+
+    // layout of one glMultiDrawElementsIndirect command
+    struct DRAW_COMMAND
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // tessellation levels of the curved shapes, 0 the finest
+    static const int MAX_LODS = 3;
+
+    // constructor
+    InstancedMeshes();
+    // destructor
+    ~InstancedMeshes();
+
+    // layout of the vertex buffer built by the next LoadMeshes
+    void SetVertexFormat(VERTEX_FORMAT format);
+    VERTEX_FORMAT GetVertexFormat() const;
+    // build the shared buffers for every mesh and level of detail
+    void LoadMeshes();
+    // bind or unbind the shared vertex array around a frame's draws
+    void BindMeshes() const;
+    void UnbindMeshes() const;
+    // draw one copy of a mesh with the shader's uniform transform
+    void DrawMesh(RenderQueue::MESH_ID mesh, int lod);
+    // draw one copy of a mesh per instance
+    void DrawInstances(RenderQueue::MESH_ID mesh, int lod, const INSTANCE_DATA* instances, int instanceCount);
+
+    // whether the context can draw with DrawIndirect
+    bool SupportsIndirect() const;
+    // command drawing instances of a mesh starting at an instance buffer entry
+    DRAW_COMMAND MakeCommand(RenderQueue::MESH_ID mesh, int lod, int instanceCount, int baseInstance) const;
+    // draw every command with one call, draw i reading drawData[i]
+    void DrawIndirect(const DRAW_COMMAND* commands, const DRAW_DATA* drawData, int commandCount,
+        const INSTANCE_DATA* instances, int instanceCount);
+
+    // bounds of a mesh's vertices in model space
+    const FrustumCuller::BOUNDS& GetLocalBounds(RenderQueue::MESH_ID mesh) const;
+    // levels of detail built for a mesh
+    int GetLodCount(RenderQueue::MESH_ID mesh) const;
+    // largest distance in model units between a level and the true surface
+    const float* GetLodErrors(RenderQueue::MESH_ID mesh) const;
+    // indices drawn for one copy of a mesh at a level
+    int GetIndexCount(RenderQueue::MESH_ID mesh, int lod) const;
+    // model position of a vertex is offset + stored position * scale
+    glm::vec3 GetPositionScale(RenderQueue::MESH_ID mesh) const;
+    glm::vec3 GetPositionOffset(RenderQueue::MESH_ID mesh) const;
+
+private:
+    // range of one level of a mesh in the shared buffers
+    struct MESH_RANGE
+    {
+        GLuint firstIndex;
+        GLuint indexCount;
+        GLint baseVertex;
+        GLuint vertexCount;
+    };
+
+    // levels of one mesh, from finest to coarsest
+    struct MESH_LODS
+    {
+        MESH_RANGE ranges[MAX_LODS];
+        float errors[MAX_LODS];
+        int lodCount;
+        FrustumCuller::BOUNDS localBounds;
+        // identity unless the vertices are packed
+        glm::vec3 positionScale;
+        glm::vec3 positionOffset;
+    };
+
+    // VERTEX_PACKED layout, normalized integers read as floats by the shader
+    struct PACKED_VERTEX
+    {
+        // position within the mesh's bounds, w unused
+        uint16_t position[4];
+        // octahedral unit normal
+        int16_t normal[2];
+        uint16_t uv[2];
+    };
+
+    MESH_LODS m_meshes[RenderQueue::MESH_COUNT];
+    VERTEX_FORMAT m_vertexFormat;
+
+    // shared geometry of every mesh
+    GLuint m_vao;
+    GLuint m_vertexBuffer;
+    GLuint m_indexBuffer;
+
+    // shared per-instance attribute buffer
+    GLuint m_instanceBuffer;
+    GLsizeiptr m_instanceCapacity;
+
+    // indirect commands and the per-draw data they index
+    GLuint m_commandBuffer;
+    GLuint m_drawDataBuffer;
+    bool m_supportsIndirect;
+
+    // optimize a level of a mesh and append it to the geometry being gathered for upload
+    void AddMesh(RenderQueue::MESH_ID id, float error, ShapeGeometry::SHAPE_MESH& mesh,
+        std::vector<ShapeGeometry::SHAPE_VERTEX>& vertices, std::vector<uint32_t>& indices);
+    // quantize the gathered vertices of every mesh to its bounds over all levels
+    void PackVertices(const std::vector<ShapeGeometry::SHAPE_VERTEX>& vertices, std::vector<PACKED_VERTEX>& packed);
+    // refill the instance buffer, growing it when needed
+    void UploadInstances(const INSTANCE_DATA* instances, int instanceCount);
+};
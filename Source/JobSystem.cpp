@@ -0,0 +1,225 @@
+///////////////////////////////////////////////////////////////////////////////
+// JobSystem.cpp
+// =============
+// Worker threads that split a range of work into chunks and steal chunks
+//
+//  A parallel loop over [0, count) is cut into fixed size chunks, and each
+//  thread, the caller included, is dealt a contiguous block of them. A
+//  thread takes chunks from the front of its own block and, once that is
+//  empty, steals from the blocks of the others, so a thread that finishes
+//  early keeps working instead of idling. Taking a chunk is a single atomic
+//  increment; the mutex is only held to start and finish a loop.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "JobSystem.h"
+
+#include <algorithm>
+
+/***********************************************************
+ *  JobSystem()
+ ***********************************************************/
+JobSystem::JobSystem()
+{
+    m_threadCount = 1;
+    m_job = nullptr;
+    m_count = 0;
+    m_chunkSize = 1;
+    m_generation = 0;
+    m_loopOpen = false;
+    m_activeWorkers = 0;
+    m_stopping = false;
+    m_stats = JOB_STATS();
+    m_stolen = 0;
+    m_queues.reset(new CHUNK_QUEUE[1]);
+}
+
+/***********************************************************
+ *  ~JobSystem()
+ ***********************************************************/
+JobSystem::~JobSystem()
+{
+    Stop();
+}
+
+/***********************************************************
+ *  Start()
+ ***********************************************************/
+void JobSystem::Start(int workerCount)
+{
+    Stop();
+
+    workerCount = std::max(workerCount, 0);
+    m_threadCount = workerCount + 1;
+    m_queues.reset(new CHUNK_QUEUE[m_threadCount]);
+    m_stopping = false;
+    for (int thread = 1; thread <= workerCount; ++thread)
+        m_workers.emplace_back(&JobSystem::WorkerLoop, this, thread);
+}
+
+/***********************************************************
+ *  GetDefaultWorkerCount()
+ ***********************************************************/
+int JobSystem::GetDefaultWorkerCount()
+{
+    int hardwareThreads = (int)std::thread::hardware_concurrency();
+    return std::max(hardwareThreads - 1, 0);
+}
+
+/***********************************************************
+ *  GetWorkerCount()
+ ***********************************************************/
+int JobSystem::GetWorkerCount() const
+{
+    return (int)m_workers.size();
+}
+
+/***********************************************************
+ *  GetChunkCount()
+ ***********************************************************/
+int JobSystem::GetChunkCount(int count, int chunkSize)
+{
+    return (count + chunkSize - 1) / chunkSize;
+}
+
+/***********************************************************
+ *  ParallelFor()
+ *
+ *  This method deals the chunks out to the threads in
+ *  contiguous blocks and works on them alongside the
+ *  workers. Once every chunk has been taken the loop is
+ *  closed to workers that have not joined yet, and it waits
+ *  for those that did to finish their last chunk. A loop of
+ *  one chunk, or without workers, runs on the caller alone.
+ ***********************************************************/
+void JobSystem::ParallelFor(int count, int chunkSize, const CHUNK_JOB& job)
+{
+    if (count <= 0)
+        return;
+
+    chunkSize = std::max(chunkSize, 1);
+    int chunkCount = GetChunkCount(count, chunkSize);
+    ++m_stats.loops;
+    m_stats.chunks += chunkCount;
+
+    if (m_workers.empty() || chunkCount == 1)
+    {
+        for (int chunk = 0; chunk < chunkCount; ++chunk)
+            job(chunk, chunk * chunkSize, std::min((chunk + 1) * chunkSize, count));
+        return;
+    }
+
+    for (int thread = 0; thread < m_threadCount; ++thread)
+    {
+        m_queues[thread].next = (int)((int64_t)chunkCount * thread / m_threadCount);
+        m_queues[thread].end = (int)((int64_t)chunkCount * (thread + 1) / m_threadCount);
+    }
+    m_job = &job;
+    m_count = count;
+    m_chunkSize = chunkSize;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_loopOpen = true;
+        ++m_generation;
+    }
+    m_loopReady.notify_all();
+
+    RunChunks(0);
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_loopOpen = false;
+        m_loopDone.wait(lock, [this] { return m_activeWorkers == 0; });
+    }
+    m_job = nullptr;
+}
+
+/***********************************************************
+ *  ResetStats()
+ ***********************************************************/
+void JobSystem::ResetStats()
+{
+    m_stats = JOB_STATS();
+    m_stolen = 0;
+}
+
+/***********************************************************
+ *  GetStats()
+ ***********************************************************/
+JobSystem::JOB_STATS JobSystem::GetStats() const
+{
+    JOB_STATS stats = m_stats;
+    stats.stolen = m_stolen;
+    return stats;
+}
+
+/***********************************************************
+ *  Stop()
+ ***********************************************************/
+void JobSystem::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_loopReady.notify_all();
+    for (std::thread& worker : m_workers)
+        worker.join();
+    m_workers.clear();
+    m_threadCount = 1;
+}
+
+/***********************************************************
+ *  WorkerLoop()
+ *
+ *  This method waits for a loop the worker has not joined
+ *  yet. A worker that wakes after the loop was closed goes
+ *  back to waiting, so the caller only ever waits for the
+ *  workers that may still be running one of its chunks.
+ ***********************************************************/
+void JobSystem::WorkerLoop(int thread)
+{
+    uint64_t joinedGeneration = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_loopReady.wait(lock, [this, joinedGeneration] {
+                return m_stopping || (m_loopOpen && m_generation != joinedGeneration); });
+            if (m_stopping)
+                return;
+            joinedGeneration = m_generation;
+            ++m_activeWorkers;
+        }
+
+        RunChunks(thread);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_activeWorkers;
+        }
+        m_loopDone.notify_one();
+    }
+}
+
+/***********************************************************
+ *  RunChunks()
+ ***********************************************************/
+void JobSystem::RunChunks(int thread)
+{
+    for (int offset = 0; offset < m_threadCount; ++offset)
+    {
+        CHUNK_QUEUE& queue = m_queues[(thread + offset) % m_threadCount];
+        for (;;)
+        {
+            int chunk = queue.next.fetch_add(1);
+            if (chunk >= queue.end)
+                break;
+            if (offset > 0)
+                ++m_stolen;
+
+            int first = chunk * m_chunkSize;
+            (*m_job)(chunk, first, std::min(first + m_chunkSize, m_count));
+        }
+    }
+}
@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////
+// JobSystem.h
+// ===========
+// Worker threads that split a range of work into chunks and steal chunks
+//
+//  A parallel loop over [0, count) is cut into fixed size chunks, and each
+//  thread, the caller included, is dealt a contiguous block of them. A
+//  thread takes chunks from the front of its own block and, once that is
+//  empty, steals from the blocks of the others, so a thread that finishes
+//  early keeps working instead of idling. Taking a chunk is a single atomic
+//  increment; the mutex is only held to start and finish a loop.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/***********************************************************
+ *  JobSystem
+ *
+ *  This class owns the worker threads and runs one parallel
+ *  loop at a time, called from the render thread.
+ ***********************************************************/
+class JobSystem
+{
+public:
+    // work of one chunk, the elements [first, end) of the loop
+    typedef std::function<void(int chunk, int first, int end)> CHUNK_JOB;
+
+    // chunks run since the last ResetStats
+    struct JOB_STATS
+    {
+        int loops;
+        int chunks;
+        int stolen;
+    };
+
+    // constructor
+    JobSystem();
+    // destructor
+    ~JobSystem();
+
+    // start the worker threads, replacing any running ones
+    void Start(int workerCount);
+    // one worker per hardware thread besides the caller's
+    static int GetDefaultWorkerCount();
+    // threads besides the caller that take chunks
+    int GetWorkerCount() const;
+
+    // number of chunks a loop over count elements is cut into
+    static int GetChunkCount(int count, int chunkSize);
+    // run job on every chunk and return once all have finished
+    void ParallelFor(int count, int chunkSize, const CHUNK_JOB& job);
+
+    // counting of loops, chunks and steals
+    void ResetStats();
+    JOB_STATS GetStats() const;
+
+private:
+    // chunks dealt to one thread, padded to a cache line so that
+    // taking a chunk does not slow down the neighboring queues
+    struct CHUNK_QUEUE
+    {
+        std::atomic<int> next;
+        int end;
+        char padding[56];
+    };
+
+    std::vector<std::thread> m_workers;
+    // workers plus the caller, one queue each
+    int m_threadCount;
+    std::unique_ptr<CHUNK_QUEUE[]> m_queues;
+
+    // loop being run, read by the workers that joined it
+    const CHUNK_JOB* m_job;
+    int m_count;
+    int m_chunkSize;
+
+    std::mutex m_mutex;
+    std::condition_variable m_loopReady;
+    std::condition_variable m_loopDone;
+    uint64_t m_generation;
+    bool m_loopOpen;
+    int m_activeWorkers;
+    bool m_stopping;
+
+    JOB_STATS m_stats;
+    std::atomic<int> m_stolen;
+
+    void Stop();
+    void WorkerLoop(int thread);
+    // take chunks from the thread's own queue, then from the others
+    void RunChunks(int thread);
+};
@@ -0,0 +1,406 @@
+///////////////////////////////////////////////////////////////////////////////
+// LightClusters.cpp
+// =================
+// Bins scene lights into clusters of the view frustum for the fragment shader
+//
+//  The frustum is divided into a grid of screen tiles and exponentially
+//  spaced depth slices. Every frame each light's bounding sphere is tested
+//  against the clusters it can reach, and the light lists of all clusters
+//  are uploaded in shader storage buffers, so a fragment only shades the
+//  lights of its own cluster. Lights without a range reach every cluster.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    // shader storage bindings, must match fragmentShader.glsl
+    const GLuint LIGHT_BLOCK_BINDING = 1;
+    const GLuint CLUSTER_BLOCK_BINDING = 2;
+    const GLuint LIGHT_INDEX_BLOCK_BINDING = 3;
+
+    // cluster boxes are grown by this fraction so that rounding in the
+    // shader's slice and tile lookup never misses a light
+    const float CLUSTER_MARGIN = 0.01f;
+
+    /***********************************************************
+     *  Unproject()
+     *
+     *  View-space point of a normalized device coordinate.
+     ***********************************************************/
+    glm::vec3 Unproject(const glm::mat4& inverseProjection, float x, float y, float z)
+    {
+        glm::vec4 point = inverseProjection * glm::vec4(x, y, z, 1.0f);
+        return glm::vec3(point.x, point.y, point.z) / point.w;
+    }
+}
+
+/***********************************************************
+ *  LightClusters()
+ ***********************************************************/
+LightClusters::LightClusters()
+{
+    m_lightsDirty = true;
+    m_viewportWidth = 1;
+    m_viewportHeight = 1;
+    m_clusterProjection = glm::mat4(1.0f);
+    m_hasClusterBounds = false;
+    m_nearDepth = 0.0f;
+    m_farDepth = 0.0f;
+    m_depthScale = 0.0f;
+    m_depthBias = 0.0f;
+    m_lightBuffer = 0;
+    m_clusterBuffer = 0;
+    m_indexBuffer = 0;
+    m_stats = CLUSTER_STATS();
+}
+
+/***********************************************************
+ *  ~LightClusters()
+ ***********************************************************/
+LightClusters::~LightClusters()
+{
+    if (m_lightBuffer)
+        glDeleteBuffers(1, &m_lightBuffer);
+    if (m_clusterBuffer)
+        glDeleteBuffers(1, &m_clusterBuffer);
+    if (m_indexBuffer)
+        glDeleteBuffers(1, &m_indexBuffer);
+}
+
+/***********************************************************
+ *  ClearLights()
+ ***********************************************************/
+void LightClusters::ClearLights()
+{
+    m_lights.clear();
+    m_lightsDirty = true;
+}
+
+/***********************************************************
+ *  AddLight()
+ ***********************************************************/
+int LightClusters::AddLight(const GPU_LIGHT& light)
+{
+    m_lights.push_back(light);
+    m_lightsDirty = true;
+    return (int)m_lights.size() - 1;
+}
+
+/***********************************************************
+ *  GetLightCount()
+ ***********************************************************/
+int LightClusters::GetLightCount() const
+{
+    return (int)m_lights.size();
+}
+
+/***********************************************************
+ *  SetViewportSize()
+ ***********************************************************/
+void LightClusters::SetViewportSize(int width, int height)
+{
+    m_viewportWidth = std::max(width, 1);
+    m_viewportHeight = std::max(height, 1);
+}
+
+/***********************************************************
+ *  BuildClusterBounds()
+ *
+ *  This method computes the view-space box of every cluster
+ *  of a projection. The corner rays of the screen tiles are
+ *  unprojected once and cut at the depth of each slice, which
+ *  works for perspective and orthographic projections alike.
+ ***********************************************************/
+void LightClusters::BuildClusterBounds(const glm::mat4& projection)
+{
+    glm::mat4 inverseProjection = glm::inverse(projection);
+
+    m_nearDepth = -Unproject(inverseProjection, 0.0f, 0.0f, -1.0f).z;
+    m_farDepth = -Unproject(inverseProjection, 0.0f, 0.0f, 1.0f).z;
+
+    // slice = log(depth) * scale + bias places GRID_Z slices between near and far
+    float logRatio = std::log(m_farDepth / m_nearDepth);
+    m_depthScale = GRID_Z / logRatio;
+    m_depthBias = -GRID_Z * std::log(m_nearDepth) / logRatio;
+
+    // near and far points of the ray through every tile corner
+    const int cornersX = GRID_X + 1;
+    const int cornersY = GRID_Y + 1;
+    std::vector<glm::vec3> nearCorners(cornersX * cornersY);
+    std::vector<glm::vec3> farCorners(cornersX * cornersY);
+    for (int y = 0; y < cornersY; ++y)
+    {
+        for (int x = 0; x < cornersX; ++x)
+        {
+            float ndcX = -1.0f + 2.0f * x / GRID_X;
+            float ndcY = -1.0f + 2.0f * y / GRID_Y;
+            nearCorners[y * cornersX + x] = Unproject(inverseProjection, ndcX, ndcY, -1.0f);
+            farCorners[y * cornersX + x] = Unproject(inverseProjection, ndcX, ndcY, 1.0f);
+        }
+    }
+
+    m_clusterBounds.resize(CLUSTER_COUNT);
+    for (int z = 0; z < GRID_Z; ++z)
+    {
+        float sliceDepths[2] =
+        {
+            m_nearDepth * std::pow(m_farDepth / m_nearDepth, (float)z / GRID_Z),
+            m_nearDepth * std::pow(m_farDepth / m_nearDepth, (float)(z + 1) / GRID_Z)
+        };
+
+        for (int y = 0; y < GRID_Y; ++y)
+        {
+            for (int x = 0; x < GRID_X; ++x)
+            {
+                glm::vec3 minimum(std::numeric_limits<float>::max());
+                glm::vec3 maximum(-std::numeric_limits<float>::max());
+                for (int corner = 0; corner < 4; ++corner)
+                {
+                    int cornerIndex = (y + corner / 2) * cornersX + (x + corner % 2);
+                    const glm::vec3& nearPoint = nearCorners[cornerIndex];
+                    const glm::vec3& farPoint = farCorners[cornerIndex];
+                    for (int slice = 0; slice < 2; ++slice)
+                    {
+                        float t = (sliceDepths[slice] + nearPoint.z) / (nearPoint.z - farPoint.z);
+                        glm::vec3 point = nearPoint + (farPoint - nearPoint) * t;
+                        for (int axis = 0; axis < 3; ++axis)
+                        {
+                            minimum[axis] = std::min(minimum[axis], point[axis]);
+                            maximum[axis] = std::max(maximum[axis], point[axis]);
+                        }
+                    }
+                }
+
+                glm::vec3 margin = (maximum - minimum) * CLUSTER_MARGIN;
+                CLUSTER_BOUNDS& bounds = m_clusterBounds[(z * GRID_Y + y) * GRID_X + x];
+                bounds.minimum = minimum - margin;
+                bounds.maximum = maximum + margin;
+            }
+        }
+    }
+
+    m_clusterProjection = projection;
+    m_hasClusterBounds = true;
+}
+
+/***********************************************************
+ *  GetDepthSlice()
+ ***********************************************************/
+int LightClusters::GetDepthSlice(float depth) const
+{
+    int slice = (int)std::floor(std::log(depth) * m_depthScale + m_depthBias);
+    return std::min(std::max(slice, 0), GRID_Z - 1);
+}
+
+/***********************************************************
+ *  BinLight()
+ *
+ *  This method finds the clusters overlapped by a light's
+ *  sphere. The sphere's box is projected to bound the tiles
+ *  and its depth range bounds the slices, then each cluster
+ *  in that block is tested against the sphere.
+ ***********************************************************/
+bool LightClusters::BinLight(uint32_t light, const glm::vec3& viewCenter, float range, const glm::mat4& projection)
+{
+    float closestDepth = std::max(-viewCenter.z - range, m_nearDepth);
+    float farthestDepth = std::min(-viewCenter.z + range, m_farDepth);
+    if (closestDepth > farthestDepth)
+        return false;
+
+    // screen rectangle of the part of the sphere's box in front of the near plane
+    float minimumX = std::numeric_limits<float>::max();
+    float minimumY = std::numeric_limits<float>::max();
+    float maximumX = -std::numeric_limits<float>::max();
+    float maximumY = -std::numeric_limits<float>::max();
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        glm::vec4 point(
+            viewCenter.x + ((corner & 1) ? range : -range),
+            viewCenter.y + ((corner & 2) ? range : -range),
+            (corner & 4) ? -farthestDepth : -closestDepth,
+            1.0f);
+        glm::vec4 clip = projection * point;
+        minimumX = std::min(minimumX, clip.x / clip.w);
+        maximumX = std::max(maximumX, clip.x / clip.w);
+        minimumY = std::min(minimumY, clip.y / clip.w);
+        maximumY = std::max(maximumY, clip.y / clip.w);
+    }
+    if (maximumX < -1.0f || minimumX > 1.0f || maximumY < -1.0f || minimumY > 1.0f)
+        return false;
+
+    int firstX = std::max((int)std::floor((minimumX + 1.0f) * 0.5f * GRID_X), 0);
+    int lastX = std::min((int)std::floor((maximumX + 1.0f) * 0.5f * GRID_X), GRID_X - 1);
+    int firstY = std::max((int)std::floor((minimumY + 1.0f) * 0.5f * GRID_Y), 0);
+    int lastY = std::min((int)std::floor((maximumY + 1.0f) * 0.5f * GRID_Y), GRID_Y - 1);
+    int firstZ = GetDepthSlice(closestDepth);
+    int lastZ = GetDepthSlice(farthestDepth);
+
+    float rangeSquared = range * range;
+    bool binned = false;
+    for (int z = firstZ; z <= lastZ; ++z)
+    {
+        for (int y = firstY; y <= lastY; ++y)
+        {
+            for (int x = firstX; x <= lastX; ++x)
+            {
+                uint32_t cluster = (uint32_t)((z * GRID_Y + y) * GRID_X + x);
+                const CLUSTER_BOUNDS& bounds = m_clusterBounds[cluster];
+
+                float distanceSquared = 0.0f;
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    float closest = std::min(std::max(viewCenter[axis], bounds.minimum[axis]), bounds.maximum[axis]);
+                    float delta = viewCenter[axis] - closest;
+                    distanceSquared += delta * delta;
+                }
+                if (distanceSquared > rangeSquared)
+                    continue;
+
+                m_pairClusters.push_back(cluster);
+                m_pairLights.push_back(light);
+                binned = true;
+            }
+        }
+    }
+    return binned;
+}
+
+/***********************************************************
+ *  Update()
+ *
+ *  This method bins every light for the camera and builds
+ *  the cluster lists, each cluster holding the lights
+ *  without a range followed by the ranged lights reaching
+ *  it, in light order.
+ ***********************************************************/
+void LightClusters::Update(const glm::mat4& view, const glm::mat4& projection)
+{
+    if (!m_hasClusterBounds || projection != m_clusterProjection)
+        BuildClusterBounds(projection);
+
+    m_pairClusters.clear();
+    m_pairLights.clear();
+    m_globalLights.clear();
+
+    int visibleLights = 0;
+    for (size_t i = 0; i < m_lights.size(); ++i)
+    {
+        const GPU_LIGHT& light = m_lights[i];
+        if (light.range <= 0.0f)
+        {
+            m_globalLights.push_back((uint32_t)i);
+            ++visibleLights;
+            continue;
+        }
+
+        glm::vec4 viewCenter = view * glm::vec4(light.position, 1.0f);
+        if (BinLight((uint32_t)i, glm::vec3(viewCenter.x, viewCenter.y, viewCenter.z), light.range, projection))
+            ++visibleLights;
+    }
+
+    // count the lights of each cluster and lay the lists out back to back
+    m_clusterCursor.assign(CLUSTER_COUNT, 0);
+    for (size_t i = 0; i < m_pairClusters.size(); ++i)
+        ++m_clusterCursor[m_pairClusters[i]];
+
+    uint32_t globalCount = (uint32_t)m_globalLights.size();
+    m_clusterRanges.resize(CLUSTER_COUNT * 2);
+    m_lightIndices.resize(globalCount * CLUSTER_COUNT + m_pairClusters.size());
+
+    m_stats = CLUSTER_STATS();
+    uint32_t offset = 0;
+    for (int cluster = 0; cluster < CLUSTER_COUNT; ++cluster)
+    {
+        uint32_t count = globalCount + m_clusterCursor[cluster];
+        m_clusterRanges[cluster * 2] = offset;
+        m_clusterRanges[cluster * 2 + 1] = count;
+
+        std::copy(m_globalLights.begin(), m_globalLights.end(), m_lightIndices.begin() + offset);
+        m_clusterCursor[cluster] = offset + globalCount;
+        offset += count;
+
+        if (count > 0)
+            ++m_stats.occupiedClusters;
+        m_stats.maxClusterLights = std::max(m_stats.maxClusterLights, (int)count);
+    }
+
+    for (size_t i = 0; i < m_pairClusters.size(); ++i)
+        m_lightIndices[m_clusterCursor[m_pairClusters[i]]++] = m_pairLights[i];
+
+    m_stats.lights = (int)m_lights.size();
+    m_stats.visibleLights = visibleLights;
+    m_stats.lightIndices = (int)m_lightIndices.size();
+
+    UploadBuffers();
+}
+
+/***********************************************************
+ *  UploadBuffers()
+ *
+ *  This method uploads the light table when it has changed
+ *  and the cluster lists every frame. Empty tables upload a
+ *  single zeroed entry, as a buffer binding cannot be empty.
+ ***********************************************************/
+void LightClusters::UploadBuffers()
+{
+    if (!m_lightBuffer)
+    {
+        glGenBuffers(1, &m_lightBuffer);
+        glGenBuffers(1, &m_clusterBuffer);
+        glGenBuffers(1, &m_indexBuffer);
+    }
+
+    if (m_lightsDirty)
+    {
+        GPU_LIGHT emptyLight = GPU_LIGHT();
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_lightBuffer);
+        if (m_lights.empty())
+            glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GPU_LIGHT), &emptyLight, GL_DYNAMIC_DRAW);
+        else
+            glBufferData(GL_SHADER_STORAGE_BUFFER, m_lights.size() * sizeof(GPU_LIGHT), m_lights.data(), GL_DYNAMIC_DRAW);
+        m_lightsDirty = false;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_clusterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, m_clusterRanges.size() * sizeof(uint32_t), m_clusterRanges.data(), GL_STREAM_DRAW);
+
+    uint32_t emptyIndex = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_indexBuffer);
+    if (m_lightIndices.empty())
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t), &emptyIndex, GL_STREAM_DRAW);
+    else
+        glBufferData(GL_SHADER_STORAGE_BUFFER, m_lightIndices.size() * sizeof(uint32_t), m_lightIndices.data(), GL_STREAM_DRAW);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+/***********************************************************
+ *  Bind()
+ *
+ *  This method binds the light and cluster buffers and sets
+ *  the uniforms the fragment shader uses to find the cluster
+ *  of a fragment from its window position and view depth.
+ ***********************************************************/
+void LightClusters::Bind(GLStateCache* pStateCache) const
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BLOCK_BINDING, m_lightBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BLOCK_BINDING, m_clusterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_INDEX_BLOCK_BINDING, m_indexBuffer);
+
+    pStateCache->SetVec2Value("clusterScreenScale", glm::vec2((float)GRID_X / m_viewportWidth, (float)GRID_Y / m_viewportHeight));
+    pStateCache->SetFloatValue("clusterDepthScale", m_depthScale);
+    pStateCache->SetFloatValue("clusterDepthBias", m_depthBias);
+}
+
+/***********************************************************
+ *  GetStats()
+ ***********************************************************/
+LightClusters::CLUSTER_STATS LightClusters::GetStats() const
+{
+    return m_stats;
+}
@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////////
+// LightClusters.h
+// ===============
+// Bins scene lights into clusters of the view frustum for the fragment shader
+//
+//  The frustum is divided into a grid of screen tiles and exponentially
+//  spaced depth slices. Every frame each light's bounding sphere is tested
+//  against the clusters it can reach, and the light lists of all clusters
+//  are uploaded in shader storage buffers, so a fragment only shades the
+//  lights of its own cluster. Lights without a range reach every cluster.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GLStateCache.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  LightClusters
+ *
+ *  This class holds the scene lights, assigns them to the
+ *  clusters of the current view and keeps the shader's light
+ *  and cluster buffers up to date.
+ ***********************************************************/
+class LightClusters
+{
+public:
+    // cluster grid, must match the CLUSTER_GRID_* defines in fragmentShader.glsl
+    static const int GRID_X = 16;
+    static const int GRID_Y = 9;
+    static const int GRID_Z = 24;
+    static const int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+
+    // std430 layout of one entry of the shader's LightBlock
+    struct GPU_LIGHT
+    {
+        glm::vec3 position;
+        float range;            // 0 lights the whole scene without falloff
+        glm::vec3 ambientColor;
+        float focalStrength;
+        glm::vec3 diffuseColor;
+        float specularIntensity;
+        glm::vec3 specularColor;
+        float padding;
+    };
+
+    // binning results for one frame
+    struct CLUSTER_STATS
+    {
+        int lights;
+        int visibleLights;
+        int occupiedClusters;
+        int lightIndices;
+        int maxClusterLights;
+    };
+
+    // constructor
+    LightClusters();
+    // destructor
+    ~LightClusters();
+
+    // remove every light
+    void ClearLights();
+    // add a light, returning its index
+    int AddLight(const GPU_LIGHT& light);
+    int GetLightCount() const;
+
+    // size in pixels of the render target the clusters tile
+    void SetViewportSize(int width, int height);
+    // bin the lights for a camera and upload the cluster buffers
+    void Update(const glm::mat4& view, const glm::mat4& projection);
+    // bind the buffers and set the uniforms that locate a fragment's cluster
+    void Bind(GLStateCache* pStateCache) const;
+
+    // results of the last Update
+    CLUSTER_STATS GetStats() const;
+
+private:
+    // view-space box of one cluster
+    struct CLUSTER_BOUNDS
+    {
+        glm::vec3 minimum;
+        glm::vec3 maximum;
+    };
+
+    std::vector<GPU_LIGHT> m_lights;
+    bool m_lightsDirty;
+
+    int m_viewportWidth;
+    int m_viewportHeight;
+
+    // cluster boxes of the projection they were built for
+    glm::mat4 m_clusterProjection;
+    bool m_hasClusterBounds;
+    std::vector<CLUSTER_BOUNDS> m_clusterBounds;
+    float m_nearDepth;
+    float m_farDepth;
+    float m_depthScale;
+    float m_depthBias;
+
+    // first index and light count per cluster, then the light indices
+    std::vector<uint32_t> m_clusterRanges;
+    std::vector<uint32_t> m_lightIndices;
+    // cluster and light of every overlap found while binning
+    std::vector<uint32_t> m_pairClusters;
+    std::vector<uint32_t> m_pairLights;
+    // lights without a range, listed first in every cluster
+    std::vector<uint32_t> m_globalLights;
+    std::vector<uint32_t> m_clusterCursor;
+
+    GLuint m_lightBuffer;
+    GLuint m_clusterBuffer;
+    GLuint m_indexBuffer;
+
+    CLUSTER_STATS m_stats;
+
+    // build the view-space cluster boxes of a projection
+    void BuildClusterBounds(const glm::mat4& projection);
+    // add the clusters a ranged light reaches to the pair lists, false if none
+    bool BinLight(uint32_t light, const glm::vec3& viewCenter, float range, const glm::mat4& projection);
+    // depth slice holding a view-space depth
+    int GetDepthSlice(float depth) const;
+    // upload the light table and cluster lists
+    void UploadBuffers();
+};
@@ -0,0 +1,162 @@
+///////////////////////////////////////////////////////////////////////////////
+// LodSelector.cpp
+// ===============
+// Picks a tessellation level per object from its projected screen error
+//
+//  Each level of a mesh has a geometric error, the largest distance in
+//  model units between its polygons and the true curved surface. Scaled by
+//  the object and projected at its distance from the camera this gives an
+//  error in pixels, and the coarsest level under the allowed error is
+//  drawn. A coarser level is only taken once its error is well under the
+//  limit, so objects near a threshold do not switch back and forth.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "LodSelector.h"
+
+#include <algorithm>
+
+namespace
+{
+    // default largest projected error in pixels
+    const float DEFAULT_MAX_SCREEN_ERROR = 0.75f;
+
+    // fraction of the allowed error a coarser level must fall under
+    const float COARSEN_HYSTERESIS = 0.75f;
+}
+
+/***********************************************************
+ *  LodSelector()
+ ***********************************************************/
+LodSelector::LodSelector()
+{
+    m_maxScreenError = DEFAULT_MAX_SCREEN_ERROR;
+    m_view = glm::mat4(1.0f);
+    m_pixelScale = 1.0f;
+    m_perspective = true;
+    m_nearDepth = 0.1f;
+    m_stats = LOD_STATS();
+}
+
+/***********************************************************
+ *  SetMaxScreenError()
+ ***********************************************************/
+void LodSelector::SetMaxScreenError(float pixels)
+{
+    m_maxScreenError = std::max(pixels, 0.0f);
+}
+
+/***********************************************************
+ *  SetView()
+ *
+ *  This method reads the vertical scale of the projection.
+ *  A perspective projection divides by view depth, held in
+ *  the w row, while an orthographic one does not.
+ ***********************************************************/
+void LodSelector::SetView(const glm::mat4& view, const glm::mat4& projection, int viewportHeight)
+{
+    m_view = view;
+    m_pixelScale = projection[1][1] * viewportHeight * 0.5f;
+    m_perspective = projection[2][3] != 0.0f;
+
+    // view depth of the near plane, where a perspective divide is largest
+    if (m_perspective)
+        m_nearDepth = projection[3][2] / (projection[2][2] - 1.0f);
+}
+
+/***********************************************************
+ *  BeginFrame()
+ ***********************************************************/
+void LodSelector::BeginFrame()
+{
+    m_stats = LOD_STATS();
+}
+
+/***********************************************************
+ *  SelectLevel()
+ *
+ *  This method selects on the render thread, counting into
+ *  the stats of the frame.
+ ***********************************************************/
+int LodSelector::SelectLevel(int object, const glm::mat4& model, const FrustumCuller::BOUNDS& worldBounds,
+    const float* levelErrors, int levelCount)
+{
+    ReserveObjects(object + 1);
+    return SelectLevel(object, model, worldBounds, levelErrors, levelCount, m_stats);
+}
+
+/***********************************************************
+ *  ReserveObjects()
+ ***********************************************************/
+void LodSelector::ReserveObjects(int objectCount)
+{
+    if (objectCount > (int)m_levels.size())
+        m_levels.resize(objectCount, -1);
+}
+
+/***********************************************************
+ *  SelectLevel()
+ *
+ *  This method projects the errors of the levels for the
+ *  object's largest scale at the nearest depth of its bounds,
+ *  moves to finer levels while the current one is over the
+ *  limit, then to coarser ones while they are under the limit
+ *  by the hysteresis margin. It only writes the object's own
+ *  level and the passed stats.
+ ***********************************************************/
+int LodSelector::SelectLevel(int object, const glm::mat4& model, const FrustumCuller::BOUNDS& worldBounds,
+    const float* levelErrors, int levelCount, LOD_STATS& stats)
+{
+    ++stats.objects;
+
+    if (levelCount <= 1)
+    {
+        m_levels[object] = 0;
+        return 0;
+    }
+
+    // the largest axis scale keeps the estimate conservative for stretched shapes
+    float objectScale = std::max(glm::length(glm::vec3(model[0])),
+        std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+    float pixelsPerUnit = m_pixelScale;
+    if (m_perspective)
+    {
+        glm::vec4 viewCenter = m_view * glm::vec4(worldBounds.center, 1.0f);
+        float nearestDepth = std::max(-viewCenter.z - worldBounds.radius, m_nearDepth);
+        pixelsPerUnit /= nearestDepth;
+    }
+    float errorScale = objectScale * pixelsPerUnit;
+
+    // a new object starts from the coarsest level and refines
+    int previous = m_levels[object];
+    int level = (previous < 0) ? levelCount - 1 : std::min(previous, levelCount - 1);
+    while (level > 0 && levelErrors[level] * errorScale > m_maxScreenError)
+        --level;
+    while (level + 1 < levelCount && levelErrors[level + 1] * errorScale < m_maxScreenError * COARSEN_HYSTERESIS)
+        ++level;
+
+    if (level > 0)
+        ++stats.reduced;
+    if (previous >= 0 && level != previous)
+        ++stats.switches;
+    m_levels[object] = level;
+    return level;
+}
+
+/***********************************************************
+ *  AddStats()
+ ***********************************************************/
+void LodSelector::AddStats(const LOD_STATS& stats)
+{
+    m_stats.objects += stats.objects;
+    m_stats.reduced += stats.reduced;
+    m_stats.switches += stats.switches;
+}
+
+/***********************************************************
+ *  GetStats()
+ ***********************************************************/
+LodSelector::LOD_STATS LodSelector::GetStats() const
+{
+    return m_stats;
+}
@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////
+// LodSelector.h
+// =============
+// Picks a tessellation level per object from its projected screen error
+//
+//  Each level of a mesh has a geometric error, the largest distance in
+//  model units between its polygons and the true curved surface. Scaled by
+//  the object and projected at its distance from the camera this gives an
+//  error in pixels, and the coarsest level under the allowed error is
+//  drawn. A coarser level is only taken once its error is well under the
+//  limit, so objects near a threshold do not switch back and forth.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FrustumCuller.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/***********************************************************
+ *  LodSelector
+ *
+ *  This class remembers the level last drawn for each object
+ *  and chooses the next one for the current camera.
+ ***********************************************************/
+class LodSelector
+{
+public:
+    // level choices for one frame
+    struct LOD_STATS
+    {
+        int objects;
+        int reduced;
+        int switches;
+    };
+
+    // constructor
+    LodSelector();
+
+    // largest allowed projected error in pixels, 0 always draws the finest level
+    void SetMaxScreenError(float pixels);
+    // camera and render target height of the next selections
+    void SetView(const glm::mat4& view, const glm::mat4& projection, int viewportHeight);
+    // start a frame's selections
+    void BeginFrame();
+    // level to draw an object at, given the errors of its mesh's levels
+    int SelectLevel(int object, const glm::mat4& model, const FrustumCuller::BOUNDS& worldBounds,
+        const float* levelErrors, int levelCount);
+
+    // make room for a frame's objects, so that distinct objects can then be
+    // selected on several threads, each counting into its own stats
+    void ReserveObjects(int objectCount);
+    int SelectLevel(int object, const glm::mat4& model, const FrustumCuller::BOUNDS& worldBounds,
+        const float* levelErrors, int levelCount, LOD_STATS& stats);
+    // add the counts of selections made with separate stats
+    void AddStats(const LOD_STATS& stats);
+
+    // results since the last BeginFrame
+    LOD_STATS GetStats() const;
+
+private:
+    float m_maxScreenError;
+    glm::mat4 m_view;
+    // pixels covered by one world unit at unit distance, or at any distance when orthographic
+    float m_pixelScale;
+    bool m_perspective;
+    float m_nearDepth;
+
+    // level drawn last for each object, -1 before the first
+    std::vector<int> m_levels;
+
+    LOD_STATS m_stats;
+};
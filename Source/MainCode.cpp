@@ -1,5 +1,10 @@
 #include <iostream>         // error handling and output
 #include <cstdlib>          // EXIT_FAILURE
+#include <cstring>          // command line parsing
+#include <algorithm>        // std::min
+#include <chrono>           // transform benchmark timing
+#include <string>
+#include <vector>
 
 #include <GL/glew.h>        // GLEW library
 #include "GLFW/glfw3.h"     // GLFW library
@@ -11,8 +16,12 @@
 
 #include "SceneManager.h"
 #include "ViewManager.h"
-#include "ShapeMeshes.h"
-#include "ShaderManager.h"
+#include "ShaderVariants.h"
+#include "GLStateCache.h"
+#include "HeadlessContext.h"
+#include "Profiler.h"
+#include "FrameBenchmark.h"
+#include "TransformBatch.h"
 
 // Namespace for declaring global variables
 namespace
@@ -22,24 +31,78 @@ namespace
     GLFWwindow* g_Window = nullptr;
 
     SceneManager* g_SceneManager = nullptr;
-    ShaderManager* g_ShaderManager = nullptr;
+    ShaderVariants* g_ShaderVariants = nullptr;
+    GLStateCache* g_StateCache = nullptr;
     ViewManager* g_ViewManager = nullptr;
+
+    // command line options, mostly for the headless benchmark mode
+    struct BENCHMARK_OPTIONS
+    {
+        bool headless = false;
+        bool benchmarkTransforms = false;
+        int frameCount = 600;
+        int warmupFrames = 10;
+        const char* csvFilename = "frame_times.csv";
+        const char* jsonFilename = "frame_times.json";
+        const char* captureFilename = nullptr;
+        TextureCooker::TEXTURE_FORMAT textureFormat = TextureCooker::FORMAT_RGBA8;
+        InstancedMeshes::VERTEX_FORMAT vertexFormat = InstancedMeshes::VERTEX_FLOAT;
+        const char* sceneFilename = nullptr;
+        const char* compileSceneFilename = nullptr;
+        int extraLights = 0;
+        bool indirectDrawing = true;
+        float maxScreenError = -1.0f;
+        bool depthPrepass = false;
+        bool occlusionCulling = true;
+        bool onDemand = false;
+        int workerThreads = -1;
+        const char* traceFilename = nullptr;
+        bool traceDraws = false;
+    };
+
+    // object counts and repetitions of the transform benchmark
+    const int TRANSFORM_BENCHMARK_COUNTS[] = { 1000, 10000, 100000 };
+    const int TRANSFORM_BENCHMARK_RUNS = 7;
+
+    // longest wait for input between checks of the window in on-demand mode
+    const double ON_DEMAND_WAIT_SECONDS = 0.5;
 }
 
 // Function declarations
 bool InitializeGLFW();
-bool InitializeGLEW();
+bool InitializeGLEW(bool headless = false);
+bool ParseCommandLine(int argc, char* argv[], BENCHMARK_OPTIONS& options);
+bool PrepareRenderer(const BENCHMARK_OPTIONS& options);
+void RenderFrame();
+int RunHeadlessBenchmark(const BENCHMARK_OPTIONS& options);
+int RunTransformBenchmark();
 
 /***********************************************************
  *  main(int, char*)
  ***********************************************************/
 int main(int argc, char* argv[])
 {
+    BENCHMARK_OPTIONS options;
+    if (!ParseCommandLine(argc, argv, options))
+        return EXIT_FAILURE;
+
+    if (options.compileSceneFilename)
+    {
+        std::string source = options.compileSceneFilename;
+        return SceneFile::Compile(source, SceneFile::GetBinaryFilename(source)) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (options.benchmarkTransforms)
+        return RunTransformBenchmark();
+    if (options.headless)
+        return RunHeadlessBenchmark(options);
+
     if (!InitializeGLFW())
         return EXIT_FAILURE;
 
-    g_ShaderManager = new ShaderManager();
-    g_ViewManager = new ViewManager(g_ShaderManager);
+    g_ShaderVariants = new ShaderVariants();
+    g_StateCache = new GLStateCache();
+    g_ViewManager = new ViewManager(g_StateCache);
+    ViewManager::SetOnDemand(options.onDemand);
 
     g_Window = g_ViewManager->CreateDisplayWindow(WINDOW_TITLE);
     if (!g_Window)
@@ -48,37 +111,404 @@ int main(int argc, char* argv[])
     if (!InitializeGLEW())
         return EXIT_FAILURE;
 
-    g_ShaderManager->LoadShaders(
-        "../../Utilities/shaders/vertexShader.glsl",
-        "../../Utilities/shaders/fragmentShader.glsl");
-    g_ShaderManager->use();
-
-    g_SceneManager = new SceneManager(g_ShaderManager);
-    g_SceneManager->PrepareScene();
+    if (!PrepareRenderer(options))
+        return EXIT_FAILURE;
 
-    // Main render loop
+    // Main render loop, on demand it sleeps until input or animation
+    // makes the displayed frame out of date
     while (!glfwWindowShouldClose(g_Window))
     {
-        glEnable(GL_DEPTH_TEST);
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (options.onDemand && !ViewManager::TakeRedrawRequest())
+        {
+            glfwWaitEventsTimeout(ON_DEMAND_WAIT_SECONDS);
+            continue;
+        }
 
-        g_ViewManager->PrepareSceneView();
-        g_SceneManager->Update();
-        g_SceneManager->RenderScene();
+        RenderFrame();
 
         glfwSwapBuffers(g_Window);
         glfwPollEvents();
     }
 
+    if (options.traceFilename)
+        Profiler::WriteTrace(options.traceFilename);
+
     // Cleanup
     delete g_SceneManager;
     delete g_ViewManager;
-    delete g_ShaderManager;
+    delete g_StateCache;
+    delete g_ShaderVariants;
 
     exit(EXIT_SUCCESS);
 }
 
+/***********************************************************
+ *  ParseCommandLine()
+ *
+ *  Recognized options:
+ *    --headless          render offscreen and benchmark
+ *    --frames N          number of frames to benchmark
+ *    --warmup N          frames rendered before timing starts
+ *    --csv FILE          per-frame timings as CSV
+ *    --json FILE         summary and per-frame timings as JSON
+ *    --capture FILE      save the last frame as a PPM image
+ *    --texture-format F  rgba8, bc1 or bc3 texture storage
+ *    --vertex-format F   float or packed vertex storage
+ *    --bench-transforms  time matrix composition, no window
+ *    --scene FILE        scene source to load
+ *    --compile-scene FILE  compile a scene source, no window
+ *    --extra-lights N    scatter N ranged lights over the table
+ *    --no-indirect       draw each run separately, not as one
+ *                        multi-draw indirect call
+ *    --lod-error PIXELS  largest tessellation error on screen,
+ *                        0 draws every shape at full detail
+ *    --depth-prepass     write opaque depth before shading
+ *    --no-occlusion      draw objects hidden behind others
+ *    --on-demand         redraw the window only after input
+ *                        or while the scene animates, space
+ *                        pauses the animation so it can idle
+ *    --job-threads N     threads besides the render thread that
+ *                        build the draw list, 0 for none
+ *    --trace FILE        write CPU and GPU scope timings as a
+ *                        Chrome trace on exit
+ *    --trace-draws       also time every draw in the trace
+ ***********************************************************/
+bool ParseCommandLine(int argc, char* argv[], BENCHMARK_OPTIONS& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* option = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if (strcmp(option, "--headless") == 0)
+            options.headless = true;
+        else if (strcmp(option, "--frames") == 0 && hasValue)
+            options.frameCount = atoi(argv[++i]);
+        else if (strcmp(option, "--warmup") == 0 && hasValue)
+            options.warmupFrames = atoi(argv[++i]);
+        else if (strcmp(option, "--csv") == 0 && hasValue)
+            options.csvFilename = argv[++i];
+        else if (strcmp(option, "--json") == 0 && hasValue)
+            options.jsonFilename = argv[++i];
+        else if (strcmp(option, "--capture") == 0 && hasValue)
+            options.captureFilename = argv[++i];
+        else if (strcmp(option, "--bench-transforms") == 0)
+            options.benchmarkTransforms = true;
+        else if (strcmp(option, "--scene") == 0 && hasValue)
+            options.sceneFilename = argv[++i];
+        else if (strcmp(option, "--compile-scene") == 0 && hasValue)
+            options.compileSceneFilename = argv[++i];
+        else if (strcmp(option, "--extra-lights") == 0 && hasValue)
+            options.extraLights = atoi(argv[++i]);
+        else if (strcmp(option, "--no-indirect") == 0)
+            options.indirectDrawing = false;
+        else if (strcmp(option, "--lod-error") == 0 && hasValue)
+            options.maxScreenError = (float)atof(argv[++i]);
+        else if (strcmp(option, "--depth-prepass") == 0)
+            options.depthPrepass = true;
+        else if (strcmp(option, "--no-occlusion") == 0)
+            options.occlusionCulling = false;
+        else if (strcmp(option, "--on-demand") == 0)
+            options.onDemand = true;
+        else if (strcmp(option, "--job-threads") == 0 && hasValue)
+            options.workerThreads = atoi(argv[++i]);
+        else if (strcmp(option, "--trace") == 0 && hasValue)
+            options.traceFilename = argv[++i];
+        else if (strcmp(option, "--trace-draws") == 0)
+            options.traceDraws = true;
+        else if (strcmp(option, "--texture-format") == 0 && hasValue)
+        {
+            const char* format = argv[++i];
+            if (strcmp(format, "rgba8") == 0)
+                options.textureFormat = TextureCooker::FORMAT_RGBA8;
+            else if (strcmp(format, "bc1") == 0)
+                options.textureFormat = TextureCooker::FORMAT_BC1;
+            else if (strcmp(format, "bc3") == 0)
+                options.textureFormat = TextureCooker::FORMAT_BC3;
+            else
+            {
+                std::cerr << "Unknown texture format: " << format << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(option, "--vertex-format") == 0 && hasValue)
+        {
+            const char* format = argv[++i];
+            if (strcmp(format, "float") == 0)
+                options.vertexFormat = InstancedMeshes::VERTEX_FLOAT;
+            else if (strcmp(format, "packed") == 0)
+                options.vertexFormat = InstancedMeshes::VERTEX_PACKED;
+            else
+            {
+                std::cerr << "Unknown vertex format: " << format << std::endl;
+                return false;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown or incomplete option: " << option << std::endl;
+            return false;
+        }
+    }
+
+    if (options.frameCount <= 0 || options.warmupFrames < 0)
+    {
+        std::cerr << "--frames must be positive and --warmup not negative" << std::endl;
+        return false;
+    }
+    if (options.extraLights < 0)
+    {
+        std::cerr << "--extra-lights must not be negative" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/***********************************************************
+ *  PrepareRenderer()
+ *
+ *  Loads the shaders and prepares the scene once a context
+ *  is current, for both the windowed and headless paths.
+ *  Returns false when a shader variant fails to build.
+ ***********************************************************/
+bool PrepareRenderer(const BENCHMARK_OPTIONS& options)
+{
+    if (options.traceFilename && !Profiler::Start(options.traceDraws))
+        std::cout << "Tracing is unavailable, the profiler was compiled out" << std::endl;
+
+    {
+        PROFILE_SCOPE("LoadShaders");
+        if (!g_ShaderVariants->LoadShaders(
+            "Shaders/vertexShader.glsl",
+            "Shaders/fragmentShader.glsl"))
+        {
+            std::cout << "Failed to build the scene shaders" << std::endl;
+            return false;
+        }
+    }
+    g_StateCache->UseProgram(g_ShaderVariants->GetProgram(true, true));
+
+    g_SceneManager = new SceneManager(g_StateCache, g_ShaderVariants);
+    g_SceneManager->SetTextureFormat(options.textureFormat);
+    g_SceneManager->SetVertexFormat(options.vertexFormat);
+    if (options.sceneFilename)
+        g_SceneManager->SetSceneFilename(options.sceneFilename);
+    g_SceneManager->SetExtraLightCount(options.extraLights);
+    g_SceneManager->SetIndirectDrawing(options.indirectDrawing);
+    if (options.maxScreenError >= 0.0f)
+        g_SceneManager->SetMaxScreenError(options.maxScreenError);
+    g_SceneManager->SetDepthPrepass(options.depthPrepass);
+    g_SceneManager->SetOcclusionCulling(options.occlusionCulling);
+    // headless runs step the animation once per frame to stay repeatable
+    g_SceneManager->SetThreadedSimulation(!options.headless);
+    g_SceneManager->SetWorkerThreadCount(
+        options.workerThreads >= 0 ? options.workerThreads : JobSystem::GetDefaultWorkerCount());
+    g_SceneManager->SetViewportSize(ViewManager::GetDisplayWidth(), ViewManager::GetDisplayHeight());
+
+    PROFILE_SCOPE("PrepareScene");
+    g_SceneManager->PrepareScene();
+    return true;
+}
+
+/***********************************************************
+ *  RenderFrame()
+ ***********************************************************/
+void RenderFrame()
+{
+    Profiler::BeginFrame();
+    PROFILE_GPU_SCOPE("Frame");
+
+    g_StateCache->ResetStats();
+    g_StateCache->SetCapability(GL_DEPTH_TEST, true);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    g_ViewManager->PrepareSceneView();
+    g_SceneManager->SetAnimationPaused(ViewManager::IsAnimationPaused());
+    g_SceneManager->SetViewProjection(g_ViewManager->GetViewMatrix(), g_ViewManager->GetProjectionMatrix());
+    if (g_SceneManager->Update())
+        ViewManager::RequestRedraw();
+    g_SceneManager->RenderScene();
+}
+
+/***********************************************************
+ *  RunHeadlessBenchmark()
+ *
+ *  Renders a fixed number of frames into an offscreen target
+ *  while the camera follows the scripted path, then writes
+ *  the per-frame CPU and GPU timings.
+ ***********************************************************/
+int RunHeadlessBenchmark(const BENCHMARK_OPTIONS& options)
+{
+    HeadlessContext context;
+    if (!context.CreateContext())
+        return EXIT_FAILURE;
+
+    if (!InitializeGLEW(true))
+        return EXIT_FAILURE;
+
+    if (!context.CreateRenderTarget(ViewManager::GetDisplayWidth(), ViewManager::GetDisplayHeight()))
+        return EXIT_FAILURE;
+
+    g_ShaderVariants = new ShaderVariants();
+    g_StateCache = new GLStateCache();
+    g_ViewManager = new ViewManager(g_StateCache);
+    g_ViewManager->InitializeOffscreenView();
+
+    if (!PrepareRenderer(options))
+        return EXIT_FAILURE;
+
+    // settle shader compilation and first-use driver work
+    for (int frame = 0; frame < options.warmupFrames; ++frame)
+    {
+        g_ViewManager->SetScriptedCameraTime(0.0f);
+        RenderFrame();
+    }
+    glFinish();
+
+    FrameBenchmark benchmark;
+    benchmark.Initialize();
+
+    for (int frame = 0; frame < options.frameCount; ++frame)
+    {
+        g_ViewManager->SetScriptedCameraTime((float)frame / options.frameCount);
+
+        benchmark.BeginFrame();
+        RenderFrame();
+        benchmark.EndFrame();
+
+        RenderQueue::QUEUE_STATS stats = g_SceneManager->GetRenderStats();
+        benchmark.SetCounter("draws", stats.draws);
+        benchmark.SetCounter("draw_calls", stats.drawCalls);
+        benchmark.SetCounter("indirect_commands", stats.indirectCommands);
+        benchmark.SetCounter("triangles", stats.triangles);
+        benchmark.SetCounter("state_changes", stats.stateChanges);
+        benchmark.SetCounter("state_changes_saved", stats.naiveStateChanges - stats.stateChanges);
+
+        GLStateCache::STATE_STATS glStats = g_StateCache->GetStats();
+        benchmark.SetCounter("gl_calls_issued", glStats.issued);
+        benchmark.SetCounter("gl_calls_suppressed", glStats.suppressed);
+
+        FrustumCuller::CULL_STATS cullStats = g_SceneManager->GetCullStats();
+        benchmark.SetCounter("visible_objects", cullStats.visible);
+        benchmark.SetCounter("culled_objects", cullStats.culled);
+        OcclusionCuller::OCCLUSION_STATS occlusionStats = g_SceneManager->GetOcclusionStats();
+        benchmark.SetCounter("occluders", occlusionStats.occluders);
+        benchmark.SetCounter("occluded_objects", occlusionStats.occluded);
+        benchmark.SetCounter("matrices_updated", g_SceneManager->GetTransformUpdateCount());
+
+        JobSystem::JOB_STATS jobStats = g_SceneManager->GetJobStats();
+        benchmark.SetCounter("job_chunks", jobStats.chunks);
+        benchmark.SetCounter("job_chunks_stolen", jobStats.stolen);
+
+        LodSelector::LOD_STATS lodStats = g_SceneManager->GetLodStats();
+        benchmark.SetCounter("reduced_lod_objects", lodStats.reduced);
+        benchmark.SetCounter("lod_switches", lodStats.switches);
+
+        LightClusters::CLUSTER_STATS lightStats = g_SceneManager->GetLightStats();
+        benchmark.SetCounter("visible_lights", lightStats.visibleLights);
+        benchmark.SetCounter("cluster_light_indices", lightStats.lightIndices);
+        benchmark.SetCounter("max_cluster_lights", lightStats.maxClusterLights);
+
+        // texture memory, and the memory and decoding that sharing avoided
+        TextureCache::CACHE_STATS textureStats = g_SceneManager->GetTextureCacheStats();
+        benchmark.SetCounter("texture_kb", (double)(textureStats.textureBytes / 1024));
+        benchmark.SetCounter("texture_kb_saved", (double)(textureStats.bytesSaved / 1024));
+        benchmark.SetCounter("texture_decode_ms_saved", textureStats.decodeMillisecondsSaved);
+
+        // read back a few frames late
+        PassCounters::PASS_STATS passStats = g_SceneManager->GetPassStats();
+        benchmark.SetCounter("prepass_fragments", (double)passStats.fragments[PassCounters::PASS_DEPTH]);
+        benchmark.SetCounter("opaque_fragments", (double)passStats.fragments[PassCounters::PASS_OPAQUE]);
+        benchmark.SetCounter("transparent_fragments", (double)passStats.fragments[PassCounters::PASS_TRANSPARENT]);
+        benchmark.SetCounter("prepass_overdraw", passStats.overdraw[PassCounters::PASS_DEPTH]);
+        benchmark.SetCounter("opaque_overdraw", passStats.overdraw[PassCounters::PASS_OPAQUE]);
+        benchmark.SetCounter("transparent_overdraw", passStats.overdraw[PassCounters::PASS_TRANSPARENT]);
+    }
+    benchmark.Finish();
+
+    benchmark.PrintSummary();
+    benchmark.WriteCSV(options.csvFilename);
+    benchmark.WriteJSON(options.jsonFilename);
+    if (options.captureFilename)
+        context.SaveRenderTarget(options.captureFilename);
+    if (options.traceFilename)
+        Profiler::WriteTrace(options.traceFilename);
+
+    // Cleanup
+    delete g_SceneManager;
+    delete g_ViewManager;
+    delete g_StateCache;
+    delete g_ShaderVariants;
+
+    return EXIT_SUCCESS;
+}
+
+/***********************************************************
+ *  RunTransformBenchmark()
+ *
+ *  Composes batches of random transforms with the glm calls
+ *  SetTransformations used to make, then with each batch
+ *  kernel the processor supports, and prints the fastest of
+ *  several runs of each.
+ ***********************************************************/
+int RunTransformBenchmark()
+{
+    TransformBatch::KERNEL bestKernel = TransformBatch::GetBestKernel();
+    std::cout << "INFO: best transform kernel " << TransformBatch::GetKernelName(bestKernel) << std::endl;
+
+    srand(330);
+    for (int count : TRANSFORM_BENCHMARK_COUNTS)
+    {
+        std::vector<glm::vec3> scales(count), rotations(count), positions(count);
+        TransformBatch batch;
+        batch.Resize(count);
+        for (int i = 0; i < count; ++i)
+        {
+            scales[i] = glm::vec3(0.5f + rand() % 100 / 50.0f);
+            rotations[i] = glm::vec3((float)(rand() % 360), (float)(rand() % 360), (float)(rand() % 360));
+            positions[i] = glm::vec3(rand() % 200 - 100.0f, rand() % 20 * 1.0f, rand() % 200 - 100.0f);
+            batch.Set(i, scales[i], rotations[i], positions[i]);
+        }
+        std::vector<glm::mat4> matrices(count);
+
+        double glmMilliseconds = 1e30;
+        for (int run = 0; run < TRANSFORM_BENCHMARK_RUNS; ++run)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int i = 0; i < count; ++i)
+            {
+                glm::mat4 scale = glm::scale(scales[i]);
+                glm::mat4 rotationX = glm::rotate(glm::radians(rotations[i].x), glm::vec3(1, 0, 0));
+                glm::mat4 rotationY = glm::rotate(glm::radians(rotations[i].y), glm::vec3(0, 1, 0));
+                glm::mat4 rotationZ = glm::rotate(glm::radians(rotations[i].z), glm::vec3(0, 0, 1));
+                glm::mat4 translation = glm::translate(positions[i]);
+                matrices[i] = translation * rotationX * rotationY * rotationZ * scale;
+            }
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            glmMilliseconds = std::min(glmMilliseconds, elapsed.count());
+        }
+        std::cout << "INFO: " << count << " transforms  glm " << glmMilliseconds << " ms";
+
+        for (int kernel = TransformBatch::KERNEL_SCALAR; kernel <= bestKernel; ++kernel)
+        {
+            double milliseconds = 1e30;
+            for (int run = 0; run < TRANSFORM_BENCHMARK_RUNS; ++run)
+            {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                batch.Compose(matrices.data(), (TransformBatch::KERNEL)kernel);
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+                milliseconds = std::min(milliseconds, elapsed.count());
+            }
+            std::cout << "  " << TransformBatch::GetKernelName((TransformBatch::KERNEL)kernel) << " " << milliseconds
+                << " ms (" << glmMilliseconds / milliseconds << "x)";
+        }
+        std::cout << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
+
 /***********************************************************
  *  InitializeGLFW()
  ***********************************************************/
@@ -102,9 +532,15 @@ bool InitializeGLFW()
 /***********************************************************
  *  InitializeGLEW()
  ***********************************************************/
-bool InitializeGLEW()
+bool InitializeGLEW(bool headless)
 {
     GLenum GLEWInitResult = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // a GLX build of GLEW loads the GL entry points before failing
+    // to find an X display, which an EGL context does not need
+    if (headless && GLEWInitResult == GLEW_ERROR_NO_GLX_DISPLAY)
+        GLEWInitResult = GLEW_OK;
+#endif
     if (GLEW_OK != GLEWInitResult)
     {
         std::cerr << glewGetErrorString(GLEWInitResult) << std::endl;
@@ -0,0 +1,46 @@
+///////////////////////////////////////////////////////////////////////////////
+// MappedFile.h
+// ============
+// Read-only memory mapping of whole files
+//
+//  Cooked textures and compiled scenes are used straight from the mapping,
+//  so loading them costs page faults rather than reads and copies.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/***********************************************************
+ *  MappedFile
+ *
+ *  This class maps a whole file read-only into memory and
+ *  unmaps it when destroyed.
+ ***********************************************************/
+class MappedFile
+{
+public:
+    // constructor
+    MappedFile();
+    // destructor
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // map the file, false if it does not exist or is empty
+    bool Open(const std::string& filename);
+    void Close();
+
+    const unsigned char* GetData() const;
+    size_t GetSize() const;
+
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void* m_fileHandle;
+    void* m_mappingHandle;
+#endif
+};
@@ -0,0 +1,385 @@
+///////////////////////////////////////////////////////////////////////////////
+// MeshOptimizer.cpp
+// =================
+// Reorders generated triangle lists for the GPU's vertex cache and overdraw
+//
+//  The parametric loops of ShapeGeometry emit triangles strip by strip, so
+//  a vertex shared with the next strip has left the post-transform cache
+//  by the time it is used again. Triangles are reordered to keep reuse
+//  within the cache, grouped into clusters that are drawn outside first to
+//  reduce overdraw, and the vertices are then stored in the order they are
+//  first fetched.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // least recently used cache modelled by the triangle scores
+    const int SCORE_CACHE_SIZE = 32;
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRIANGLE_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+
+    // first in, first out cache used to measure and cluster, a common hardware size
+    const uint32_t ANALYSIS_CACHE_SIZE = 16;
+
+    // largest ACMR increase accepted for the overdraw order
+    const float OVERDRAW_THRESHOLD = 1.05f;
+
+    /***********************************************************
+     *  VertexScore()
+     *
+     *  Forsyth's score of a vertex. Vertices of the triangle
+     *  just drawn score a fixed amount so the next triangle
+     *  does not simply reuse its edge, older cache entries
+     *  decay with their position, and vertices with few
+     *  triangles left are boosted so they are finished off
+     *  instead of being left behind.
+     ***********************************************************/
+    float VertexScore(int cachePosition, uint32_t remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+                score = LAST_TRIANGLE_SCORE;
+            else
+                score = std::pow(1.0f - (cachePosition - 3) / float(SCORE_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        }
+        return score + VALENCE_BOOST_SCALE * std::pow(float(remainingTriangles), -VALENCE_BOOST_POWER);
+    }
+
+    /***********************************************************
+     *  TriangleMisses()
+     *
+     *  Number of vertices of a triangle missing from the first
+     *  in, first out cache, which are added to it. A vertex is
+     *  cached while fewer than the cache size of vertices have
+     *  been added after it, so advancing the time by more than
+     *  the cache size empties the cache.
+     ***********************************************************/
+    int TriangleMisses(const uint32_t* triangle, std::vector<uint32_t>& timestamps, uint32_t& time)
+    {
+        int misses = 0;
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            uint32_t vertex = triangle[corner];
+            if (time - timestamps[vertex] > ANALYSIS_CACHE_SIZE)
+            {
+                timestamps[vertex] = time++;
+                ++misses;
+            }
+        }
+        return misses;
+    }
+}
+
+/***********************************************************
+ *  Optimize()
+ ***********************************************************/
+void MeshOptimizer::Optimize(ShapeGeometry::SHAPE_MESH& mesh)
+{
+    OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+    OptimizeOverdraw(mesh.indices, mesh.vertices, OVERDRAW_THRESHOLD);
+    OptimizeVertexFetch(mesh);
+}
+
+/***********************************************************
+ *  OptimizeVertexCache()
+ *
+ *  This method reorders triangles with Forsyth's linear-speed
+ *  algorithm. Each step draws the highest scoring triangle,
+ *  moves its vertices to the front of a simulated cache, and
+ *  rescores only the triangles of the cached vertices, from
+ *  which the next one is picked. When none of those is left
+ *  the best of all remaining triangles starts a new run.
+ ***********************************************************/
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // triangles of each vertex, the first remaining[v] of its range not yet drawn
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (uint32_t index : indices)
+        ++remaining[index];
+    std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+    for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+        firstTriangle[vertex + 1] = firstTriangle[vertex] + remaining[vertex];
+    std::vector<uint32_t> vertexTriangles(indices.size());
+    std::vector<uint32_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+        vertexTriangles[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+        vertexScores[vertex] = VertexScore(-1, remaining[vertex]);
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> drawn(triangleCount, false);
+    for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        const uint32_t* corners = &indices[triangle * 3];
+        triangleScores[triangle] = vertexScores[corners[0]] + vertexScores[corners[1]] + vertexScores[corners[2]];
+    }
+
+    std::vector<uint32_t> ordered;
+    ordered.reserve(indices.size());
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+    cache.reserve(SCORE_CACHE_SIZE + 3);
+    nextCache.reserve(SCORE_CACHE_SIZE + 3);
+
+    long long bestTriangle = -1;
+    for (size_t drawnCount = 0; drawnCount < triangleCount; ++drawnCount)
+    {
+        // the generated meshes are small, so a full scan on the rare restart is cheap
+        if (bestTriangle < 0)
+        {
+            float bestScore = -2.0f;
+            for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+            {
+                if (!drawn[triangle] && triangleScores[triangle] > bestScore)
+                {
+                    bestScore = triangleScores[triangle];
+                    bestTriangle = (long long)triangle;
+                }
+            }
+        }
+
+        const uint32_t* corners = &indices[bestTriangle * 3];
+        ordered.insert(ordered.end(), corners, corners + 3);
+        drawn[bestTriangle] = true;
+
+        // remove the triangle from the remaining lists of its vertices
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            uint32_t vertex = corners[corner];
+            uint32_t* triangles = &vertexTriangles[firstTriangle[vertex]];
+            uint32_t count = remaining[vertex];
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                if (triangles[i] == (uint32_t)bestTriangle)
+                {
+                    std::swap(triangles[i], triangles[count - 1]);
+                    break;
+                }
+            }
+            --remaining[vertex];
+        }
+
+        // the drawn vertices move to the front, the rest keep their order
+        nextCache.assign(corners, corners + 3);
+        for (uint32_t vertex : cache)
+        {
+            if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+                nextCache.push_back(vertex);
+        }
+        for (size_t i = 0; i < nextCache.size(); ++i)
+        {
+            uint32_t vertex = nextCache[i];
+            cachePosition[vertex] = (i < (size_t)SCORE_CACHE_SIZE) ? (int)i : -1;
+            vertexScores[vertex] = VertexScore(cachePosition[vertex], remaining[vertex]);
+        }
+
+        // rescore the triangles whose vertices changed, including those just pushed out
+        bestTriangle = -1;
+        float bestScore = -2.0f;
+        for (uint32_t vertex : nextCache)
+        {
+            const uint32_t* triangles = &vertexTriangles[firstTriangle[vertex]];
+            for (uint32_t i = 0; i < remaining[vertex]; ++i)
+            {
+                uint32_t triangle = triangles[i];
+                const uint32_t* other = &indices[triangle * 3];
+                float score = vertexScores[other[0]] + vertexScores[other[1]] + vertexScores[other[2]];
+                triangleScores[triangle] = score;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = triangle;
+                }
+            }
+        }
+
+        if (nextCache.size() > (size_t)SCORE_CACHE_SIZE)
+            nextCache.resize(SCORE_CACHE_SIZE);
+        cache.swap(nextCache);
+    }
+
+    // the scores model a different cache from the one measured, so an input that
+    // already reuses it better is kept
+    if (AnalyzeVertexCache(ordered, vertexCount).acmr <= AnalyzeVertexCache(indices, vertexCount).acmr)
+        indices.swap(ordered);
+}
+
+/***********************************************************
+ *  OptimizeOverdraw()
+ *
+ *  This method splits the cache-ordered triangles into
+ *  clusters, first where the cache starts cold and then
+ *  wherever a cluster's misses so far are already within the
+ *  threshold of its average, so reordering them costs little
+ *  cache reuse. Clusters facing away from the mesh center
+ *  are drawn first, since they tend to hide the others. The
+ *  new order is kept only if its ACMR stays in the threshold.
+ ***********************************************************/
+void MeshOptimizer::OptimizeOverdraw(std::vector<uint32_t>& indices,
+    const std::vector<ShapeGeometry::SHAPE_VERTEX>& vertices, float threshold)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+        return;
+
+    std::vector<uint32_t> timestamps(vertices.size(), 0);
+    uint32_t time = ANALYSIS_CACHE_SIZE + 1;
+
+    std::vector<size_t> coldStarts;
+    for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        if (TriangleMisses(&indices[triangle * 3], timestamps, time) == 3)
+            coldStarts.push_back(triangle);
+    }
+
+    std::vector<size_t> clusterStarts;
+    for (size_t cold = 0; cold < coldStarts.size(); ++cold)
+    {
+        size_t start = coldStarts[cold];
+        size_t end = (cold + 1 < coldStarts.size()) ? coldStarts[cold + 1] : triangleCount;
+
+        time += ANALYSIS_CACHE_SIZE + 1;
+        int runMisses = 0;
+        for (size_t triangle = start; triangle < end; ++triangle)
+            runMisses += TriangleMisses(&indices[triangle * 3], timestamps, time);
+        float splitAcmr = threshold * runMisses / float(end - start);
+
+        time += ANALYSIS_CACHE_SIZE + 1;
+        clusterStarts.push_back(start);
+        size_t clusterStart = start;
+        int clusterMisses = 0;
+        for (size_t triangle = start; triangle + 1 < end; ++triangle)
+        {
+            clusterMisses += TriangleMisses(&indices[triangle * 3], timestamps, time);
+            if (clusterMisses / float(triangle + 1 - clusterStart) <= splitAcmr)
+            {
+                clusterStart = triangle + 1;
+                clusterStarts.push_back(clusterStart);
+                clusterMisses = 0;
+                time += ANALYSIS_CACHE_SIZE + 1;
+            }
+        }
+    }
+    if (clusterStarts.size() < 2)
+        return;
+
+    // area-weighted centroid and normal of each cluster and of the whole mesh
+    size_t clusterCount = clusterStarts.size();
+    std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t cluster = 0; cluster < clusterCount; ++cluster)
+    {
+        size_t end = (cluster + 1 < clusterCount) ? clusterStarts[cluster + 1] : triangleCount;
+        float clusterArea = 0.0f;
+        for (size_t triangle = clusterStarts[cluster]; triangle < end; ++triangle)
+        {
+            glm::vec3 a = vertices[indices[triangle * 3]].position;
+            glm::vec3 b = vertices[indices[triangle * 3 + 1]].position;
+            glm::vec3 c = vertices[indices[triangle * 3 + 2]].position;
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float area = glm::length(normal);
+            glm::vec3 center = (a + b + c) / 3.0f;
+
+            clusterCentroids[cluster] += center * area;
+            clusterNormals[cluster] += normal;
+            clusterArea += area;
+        }
+        meshCentroid += clusterCentroids[cluster];
+        meshArea += clusterArea;
+        if (clusterArea > 0.0f)
+            clusterCentroids[cluster] /= clusterArea;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    std::vector<float> clusterKeys(clusterCount);
+    for (size_t cluster = 0; cluster < clusterCount; ++cluster)
+    {
+        float normalLength = glm::length(clusterNormals[cluster]);
+        glm::vec3 normal = (normalLength > 0.0f) ? clusterNormals[cluster] / normalLength : glm::vec3(0.0f);
+        clusterKeys[cluster] = glm::dot(clusterCentroids[cluster] - meshCentroid, normal);
+    }
+
+    std::vector<size_t> clusterOrder(clusterCount);
+    for (size_t cluster = 0; cluster < clusterCount; ++cluster)
+        clusterOrder[cluster] = cluster;
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(),
+        [&clusterKeys](size_t a, size_t b) { return clusterKeys[a] > clusterKeys[b]; });
+
+    std::vector<uint32_t> ordered;
+    ordered.reserve(indices.size());
+    for (size_t cluster : clusterOrder)
+    {
+        size_t end = (cluster + 1 < clusterCount) ? clusterStarts[cluster + 1] : triangleCount;
+        ordered.insert(ordered.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + end * 3);
+    }
+
+    float cacheAcmr = AnalyzeVertexCache(indices, vertices.size()).acmr;
+    if (AnalyzeVertexCache(ordered, vertices.size()).acmr <= cacheAcmr * threshold)
+        indices.swap(ordered);
+}
+
+/***********************************************************
+ *  OptimizeVertexFetch()
+ *
+ *  This method renumbers the vertices in order of first use
+ *  so the vertex fetches of a draw walk forward through the
+ *  buffer. Vertices no triangle uses are dropped.
+ ***********************************************************/
+void MeshOptimizer::OptimizeVertexFetch(ShapeGeometry::SHAPE_MESH& mesh)
+{
+    const uint32_t UNUSED = 0xFFFFFFFFu;
+    std::vector<uint32_t> remap(mesh.vertices.size(), UNUSED);
+    std::vector<ShapeGeometry::SHAPE_VERTEX> ordered;
+    ordered.reserve(mesh.vertices.size());
+
+    for (uint32_t& index : mesh.indices)
+    {
+        if (remap[index] == UNUSED)
+        {
+            remap[index] = (uint32_t)ordered.size();
+            ordered.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh.vertices.swap(ordered);
+}
+
+/***********************************************************
+ *  AnalyzeVertexCache()
+ ***********************************************************/
+MeshOptimizer::CACHE_STATS MeshOptimizer::AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount)
+{
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = ANALYSIS_CACHE_SIZE + 1;
+    int misses = 0;
+    size_t triangleCount = indices.size() / 3;
+    for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+        misses += TriangleMisses(&indices[triangle * 3], timestamps, time);
+
+    CACHE_STATS stats;
+    stats.acmr = triangleCount ? misses / float(triangleCount) : 0.0f;
+    stats.atvr = vertexCount ? misses / float(vertexCount) : 0.0f;
+    return stats;
+}
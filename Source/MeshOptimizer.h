@@ -0,0 +1,53 @@
+///////////////////////////////////////////////////////////////////////////////
+// MeshOptimizer.h
+// ===============
+// Reorders generated triangle lists for the GPU's vertex cache and overdraw
+//
+//  The parametric loops of ShapeGeometry emit triangles strip by strip, so
+//  a vertex shared with the next strip has left the post-transform cache
+//  by the time it is used again. Triangles are reordered to keep reuse
+//  within the cache, grouped into clusters that are drawn outside first to
+//  reduce overdraw, and the vertices are then stored in the order they are
+//  first fetched.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ShapeGeometry.h"
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  MeshOptimizer
+ *
+ *  This class holds the load-time optimization passes for
+ *  indexed triangle lists and the cache simulation used to
+ *  measure them.
+ ***********************************************************/
+class MeshOptimizer
+{
+public:
+    // simulated post-transform cache results of a triangle list
+    struct CACHE_STATS
+    {
+        // vertices transformed per triangle, 0.5 at best and 3 at worst
+        float acmr;
+        // vertices transformed per vertex of the mesh, 1 at best
+        float atvr;
+    };
+
+    // run every pass on a mesh
+    static void Optimize(ShapeGeometry::SHAPE_MESH& mesh);
+
+    // order triangles for a small least recently used vertex cache
+    static void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+    // order clusters of cache-ordered triangles outside first, keeping ACMR within threshold
+    static void OptimizeOverdraw(std::vector<uint32_t>& indices,
+        const std::vector<ShapeGeometry::SHAPE_VERTEX>& vertices, float threshold);
+    // store vertices in the order the indices first reference them
+    static void OptimizeVertexFetch(ShapeGeometry::SHAPE_MESH& mesh);
+
+    // simulate a first in, first out post-transform cache
+    static CACHE_STATS AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount);
+};
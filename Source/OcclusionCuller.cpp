@@ -0,0 +1,415 @@
+///////////////////////////////////////////////////////////////////////////////
+// OcclusionCuller.cpp
+// ===================
+// Skips objects hidden behind large occluders, using a depth pyramid
+//
+//  Each frame the largest solid objects in view are rasterized in software
+//  into a small depth buffer, and a pyramid is built over it in which every
+//  texel holds the farthest depth of the four below it. An object is then
+//  tested by projecting its bounding box to a screen rectangle and reading
+//  the two by two texels of the level that cover it: if the box's nearest
+//  point lies behind all of them, the object cannot be seen.
+//
+//  Both steps are conservative. An occluder only covers a texel that lies
+//  wholly inside its outline, at a depth no nearer than the occluder's near
+//  side anywhere within the texel, so culling never removes a visible pixel.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    // smallest clip w of a projected corner, boxes reaching nearer are
+    // partly behind the camera and neither occlude nor get culled
+    const float MIN_CLIP_W = 1e-3f;
+    // occluders smaller than this, in bounding radius over distance, hide
+    // too little to be worth rasterizing
+    const float MIN_OCCLUDER_SIZE = 0.05f;
+    // texel corners must lie this far inside an occluder's outline, in
+    // normalized device coordinates, so rounding cannot let it spill over
+    const float OUTLINE_MARGIN = 1e-5f;
+    // projected faces with less area than this are seen edge on, and
+    // are too thin to hold a texel corner inside the outline's margin
+    const float MIN_FACE_AREA = 1e-10f;
+    // depth an object must lie beyond the pyramid to count as hidden
+    const float DEPTH_EPSILON = 1e-6f;
+
+    // corner of a box, the bits of the index selecting the maximum of x, y and z
+    glm::vec3 GetBoxCorner(const FrustumCuller::BOUNDS& box, int corner)
+    {
+        return box.center + glm::vec3(
+            (corner & 1) ? box.extents.x : -box.extents.x,
+            (corner & 2) ? box.extents.y : -box.extents.y,
+            (corner & 4) ? box.extents.z : -box.extents.z);
+    }
+
+    float Cross(const glm::vec2& a, const glm::vec2& b, const glm::vec2& c)
+    {
+        return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    }
+
+    // counter-clockwise convex hull by the monotone chain algorithm
+    void BuildHull(glm::vec2* points, int count, std::vector<glm::vec2>& hull)
+    {
+        std::sort(points, points + count, [](const glm::vec2& a, const glm::vec2& b)
+            {
+                return a.x < b.x || (a.x == b.x && a.y < b.y);
+            });
+
+        hull.clear();
+        for (int i = 0; i < count; ++i)
+        {
+            while (hull.size() >= 2 && Cross(hull[hull.size() - 2], hull.back(), points[i]) <= 0.0f)
+                hull.pop_back();
+            hull.push_back(points[i]);
+        }
+        size_t lower = hull.size() + 1;
+        for (int i = count - 2; i >= 0; --i)
+        {
+            while (hull.size() >= lower && Cross(hull[hull.size() - 2], hull.back(), points[i]) <= 0.0f)
+                hull.pop_back();
+            hull.push_back(points[i]);
+        }
+        hull.pop_back();
+    }
+}
+
+/***********************************************************
+ *  OcclusionCuller()
+ ***********************************************************/
+OcclusionCuller::OcclusionCuller()
+{
+    m_viewProjection = glm::mat4(1.0f);
+    m_cameraPosition = glm::vec3(0.0f);
+    m_hasDepth = false;
+    m_stats = OCCLUSION_STATS();
+
+    int width = BUFFER_WIDTH;
+    int height = BUFFER_HEIGHT;
+    while (true)
+    {
+        DEPTH_LEVEL level;
+        level.width = width;
+        level.height = height;
+        level.depth.assign(width * height, 1.0f);
+        m_levels.push_back(level);
+        if (width == 1 && height == 1)
+            break;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+}
+
+/***********************************************************
+ *  BeginFrame()
+ ***********************************************************/
+void OcclusionCuller::BeginFrame(const glm::mat4& view, const glm::mat4& projection)
+{
+    m_viewProjection = projection * view;
+    m_cameraPosition = glm::vec3(glm::inverse(view)[3]);
+    m_occluders.clear();
+    m_hasDepth = false;
+    m_stats = OCCLUSION_STATS();
+}
+
+/***********************************************************
+ *  AddOccluder()
+ *
+ *  This method keeps the box with its approximate size on
+ *  screen, by which BuildPyramid picks the occluders. The
+ *  box must lie within the object's surface, so that it
+ *  hides nothing the object itself would not.
+ ***********************************************************/
+void OcclusionCuller::AddOccluder(const glm::mat4& model, const FrustumCuller::BOUNDS& localBox)
+{
+    FrustumCuller::BOUNDS world = FrustumCuller::TransformBounds(localBox, model);
+    glm::vec4 center = m_viewProjection * glm::vec4(world.center, 1.0f);
+    if (center.w <= MIN_CLIP_W)
+        return;
+
+    OCCLUDER occluder;
+    occluder.model = model;
+    occluder.localBox = localBox;
+    occluder.screenSize = world.radius / center.w;
+    if (occluder.screenSize >= MIN_OCCLUDER_SIZE)
+        m_occluders.push_back(occluder);
+}
+
+/***********************************************************
+ *  BuildPyramid()
+ *
+ *  This method clears the base level to the far plane,
+ *  rasterizes the largest occluders into it and fills each
+ *  level above with the farthest of the texels below.
+ ***********************************************************/
+void OcclusionCuller::BuildPyramid()
+{
+    std::fill(m_levels[0].depth.begin(), m_levels[0].depth.end(), 1.0f);
+
+    std::stable_sort(m_occluders.begin(), m_occluders.end(), [](const OCCLUDER& a, const OCCLUDER& b)
+        {
+            return a.screenSize > b.screenSize;
+        });
+    int occluderCount = std::min((int)m_occluders.size(), MAX_OCCLUDERS);
+    for (int i = 0; i < occluderCount; ++i)
+    {
+        if (RasterizeOccluder(m_occluders[i]))
+        {
+            m_hasDepth = true;
+            ++m_stats.occluders;
+        }
+    }
+    if (!m_hasDepth)
+        return;
+
+    for (size_t index = 1; index < m_levels.size(); ++index)
+    {
+        const DEPTH_LEVEL& below = m_levels[index - 1];
+        DEPTH_LEVEL& level = m_levels[index];
+        for (int y = 0; y < level.height; ++y)
+        {
+            int y0 = std::min(2 * y, below.height - 1) * below.width;
+            int y1 = std::min(2 * y + 1, below.height - 1) * below.width;
+            for (int x = 0; x < level.width; ++x)
+            {
+                int x0 = std::min(2 * x, below.width - 1);
+                int x1 = std::min(2 * x + 1, below.width - 1);
+                level.depth[y * level.width + x] = std::max(
+                    std::max(below.depth[y0 + x0], below.depth[y0 + x1]),
+                    std::max(below.depth[y1 + x0], below.depth[y1 + x1]));
+            }
+        }
+    }
+}
+
+/***********************************************************
+ *  IsOccluded()
+ *
+ *  This method compares the nearest depth of the box with
+ *  the farthest depth over its screen rectangle, read from
+ *  the level where that rectangle spans at most two texels
+ *  each way.
+ ***********************************************************/
+bool OcclusionCuller::IsOccluded(const FrustumCuller::BOUNDS& worldBounds)
+{
+    ++m_stats.tested;
+    if (!m_hasDepth)
+        return false;
+
+    glm::vec3 minimum(FLT_MAX);
+    glm::vec3 maximum(-FLT_MAX);
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        glm::vec4 clip = m_viewProjection * glm::vec4(GetBoxCorner(worldBounds, corner), 1.0f);
+        if (clip.w <= MIN_CLIP_W)
+            return false;
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        minimum = glm::min(minimum, ndc);
+        maximum = glm::max(maximum, ndc);
+    }
+    if (minimum.z <= -1.0f)
+        return false;
+
+    int left = (int)std::floor((minimum.x + 1.0f) * 0.5f * BUFFER_WIDTH);
+    int right = (int)std::floor((maximum.x + 1.0f) * 0.5f * BUFFER_WIDTH);
+    int bottom = (int)std::floor((minimum.y + 1.0f) * 0.5f * BUFFER_HEIGHT);
+    int top = (int)std::floor((maximum.y + 1.0f) * 0.5f * BUFFER_HEIGHT);
+    if (right < 0 || left >= BUFFER_WIDTH || top < 0 || bottom >= BUFFER_HEIGHT)
+        return false;
+
+    left = std::max(left, 0);
+    bottom = std::max(bottom, 0);
+    right = std::min(right, BUFFER_WIDTH - 1);
+    top = std::min(top, BUFFER_HEIGHT - 1);
+
+    if (minimum.z <= GetFarthestDepth(left, bottom, right, top) + DEPTH_EPSILON)
+        return false;
+
+    ++m_stats.occluded;
+    return true;
+}
+
+/***********************************************************
+ *  GetStats()
+ ***********************************************************/
+OcclusionCuller::OCCLUSION_STATS OcclusionCuller::GetStats() const
+{
+    return m_stats;
+}
+
+/***********************************************************
+ *  RasterizeOccluder()
+ *
+ *  This method covers the texels lying wholly inside the
+ *  outline of the projected box. A view ray enters the box
+ *  through the farthest of the planes of the faces turned
+ *  towards the camera, and as that depth is convex over the
+ *  screen, its farthest over a texel lies at a corner.
+ ***********************************************************/
+bool OcclusionCuller::RasterizeOccluder(const OCCLUDER& occluder)
+{
+    glm::mat4 clipFromLocal = m_viewProjection * occluder.model;
+    glm::vec3 corners[8];
+    glm::vec2 outline[8];
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        glm::vec4 clip = clipFromLocal * glm::vec4(GetBoxCorner(occluder.localBox, corner), 1.0f);
+        if (clip.w <= MIN_CLIP_W)
+            return false;
+        corners[corner] = glm::vec3(clip) / clip.w;
+        outline[corner] = glm::vec2(corners[corner].x, corners[corner].y);
+    }
+
+    std::vector<glm::vec2> hull;
+    BuildHull(outline, 8, hull);
+    if (hull.size() < 3)
+        return false;
+
+    // inward normals of the outline's edges
+    int edgeCount = (int)hull.size();
+    glm::vec3 edges[8];
+    for (int i = 0; i < edgeCount; ++i)
+    {
+        glm::vec2 start = hull[i];
+        glm::vec2 direction = hull[(i + 1) % edgeCount] - start;
+        float length = glm::length(direction);
+        if (length <= 0.0f)
+            return false;
+        glm::vec2 normal = glm::vec2(-direction.y, direction.x) / length;
+        edges[i] = glm::vec3(normal, -glm::dot(normal, start));
+    }
+
+    // planes z = a x + b y + c of the faces turned towards the camera
+    glm::vec3 camera = glm::vec3(glm::inverse(occluder.model) * glm::vec4(m_cameraPosition, 1.0f));
+    glm::vec3 planes[6];
+    int planeCount = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (int side = 0; side < 2; ++side)
+        {
+            float sign = side ? 1.0f : -1.0f;
+            float face = occluder.localBox.center[axis] + sign * occluder.localBox.extents[axis];
+            if ((camera[axis] - face) * sign <= 0.0f)
+                continue;
+
+            // the face's corners in order around it
+            int bit = 1 << axis;
+            int first = 1 << ((axis + 1) % 3);
+            int second = 1 << ((axis + 2) % 3);
+            int base = side ? bit : 0;
+            const glm::vec3* quad[4] = {
+                &corners[base], &corners[base | first], &corners[base | first | second], &corners[base | second] };
+
+            // solve the plane from the larger half of the projected face
+            glm::vec3 e1 = *quad[1] - *quad[0];
+            glm::vec3 e2 = *quad[2] - *quad[0];
+            glm::vec3 e3 = *quad[3] - *quad[0];
+            float area12 = e1.x * e2.y - e2.x * e1.y;
+            float area23 = e2.x * e3.y - e3.x * e2.y;
+            if (std::fabs(area23) > std::fabs(area12))
+            {
+                e1 = e2;
+                e2 = e3;
+                area12 = area23;
+            }
+            if (std::fabs(area12) < MIN_FACE_AREA)
+                continue;
+
+            float a = (e1.z * e2.y - e2.z * e1.y) / area12;
+            float b = (e1.x * e2.z - e2.x * e1.z) / area12;
+            planes[planeCount++] = glm::vec3(a, b, quad[0]->z - a * quad[0]->x - b * quad[0]->y);
+        }
+    }
+    if (planeCount == 0)
+        return false;
+
+    // texel corners spanned by the outline
+    glm::vec2 minimum = hull[0];
+    glm::vec2 maximum = hull[0];
+    for (const glm::vec2& point : hull)
+    {
+        minimum = glm::min(minimum, point);
+        maximum = glm::max(maximum, point);
+    }
+    int left = std::max((int)std::ceil((minimum.x + 1.0f) * 0.5f * BUFFER_WIDTH), 0);
+    int right = std::min((int)std::floor((maximum.x + 1.0f) * 0.5f * BUFFER_WIDTH), BUFFER_WIDTH);
+    int bottom = std::max((int)std::ceil((minimum.y + 1.0f) * 0.5f * BUFFER_HEIGHT), 0);
+    int top = std::min((int)std::floor((maximum.y + 1.0f) * 0.5f * BUFFER_HEIGHT), BUFFER_HEIGHT);
+    if (right <= left || top <= bottom)
+        return false;
+
+    int cornerColumns = right - left + 1;
+    m_corners.resize(cornerColumns * (top - bottom + 1));
+    for (int y = bottom; y <= top; ++y)
+    {
+        float ndcY = 2.0f * y / BUFFER_HEIGHT - 1.0f;
+        for (int x = left; x <= right; ++x)
+        {
+            float ndcX = 2.0f * x / BUFFER_WIDTH - 1.0f;
+            TEXEL_CORNER& corner = m_corners[(y - bottom) * cornerColumns + (x - left)];
+
+            corner.inside = true;
+            for (int i = 0; i < edgeCount && corner.inside; ++i)
+                corner.inside = edges[i].x * ndcX + edges[i].y * ndcY + edges[i].z >= OUTLINE_MARGIN;
+            if (!corner.inside)
+                continue;
+            corner.depth = -FLT_MAX;
+            for (int i = 0; i < planeCount; ++i)
+                corner.depth = std::max(corner.depth, planes[i].x * ndcX + planes[i].y * ndcY + planes[i].z);
+        }
+    }
+
+    DEPTH_LEVEL& level = m_levels[0];
+    bool covered = false;
+    for (int y = bottom; y < top; ++y)
+    {
+        const TEXEL_CORNER* lower = &m_corners[(y - bottom) * cornerColumns];
+        const TEXEL_CORNER* upper = lower + cornerColumns;
+        for (int x = 0; x < right - left; ++x)
+        {
+            if (!lower[x].inside || !lower[x + 1].inside || !upper[x].inside || !upper[x + 1].inside)
+                continue;
+
+            float depth = std::max(
+                std::max(lower[x].depth, lower[x + 1].depth),
+                std::max(upper[x].depth, upper[x + 1].depth));
+
+            float& texel = level.depth[y * BUFFER_WIDTH + left + x];
+            texel = std::min(texel, depth);
+            covered = true;
+        }
+    }
+    return covered;
+}
+
+/***********************************************************
+ *  GetFarthestDepth()
+ *
+ *  This method climbs the pyramid until the rectangle spans
+ *  at most two texels each way, then reads those texels.
+ ***********************************************************/
+float OcclusionCuller::GetFarthestDepth(int left, int bottom, int right, int top) const
+{
+    size_t index = 0;
+    while (index + 1 < m_levels.size() && (right - left > 1 || top - bottom > 1))
+    {
+        ++index;
+        left >>= 1;
+        bottom >>= 1;
+        right >>= 1;
+        top >>= 1;
+    }
+
+    const DEPTH_LEVEL& level = m_levels[index];
+    float farthest = -1.0f;
+    for (int y = bottom; y <= top; ++y)
+    {
+        for (int x = left; x <= right; ++x)
+            farthest = std::max(farthest, level.depth[y * level.width + x]);
+    }
+    return farthest;
+}
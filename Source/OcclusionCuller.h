@@ -0,0 +1,104 @@
+///////////////////////////////////////////////////////////////////////////////
+// OcclusionCuller.h
+// =================
+// Skips objects hidden behind large occluders, using a depth pyramid
+//
+//  Each frame the largest solid objects in view are rasterized in software
+//  into a small depth buffer, and a pyramid is built over it in which every
+//  texel holds the farthest depth of the four below it. An object is then
+//  tested by projecting its bounding box to a screen rectangle and reading
+//  the two by two texels of the level that cover it: if the box's nearest
+//  point lies behind all of them, the object cannot be seen.
+//
+//  Both steps are conservative. An occluder only covers a texel that lies
+//  wholly inside its outline, at a depth no nearer than the occluder's near
+//  side anywhere within the texel, so culling never removes a visible pixel.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FrustumCuller.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/***********************************************************
+ *  OcclusionCuller
+ *
+ *  This class collects the occluders of one frame, builds
+ *  their depth pyramid and tests bounding boxes against it.
+ ***********************************************************/
+class OcclusionCuller
+{
+public:
+    // resolution of the software depth buffer, the pyramid's base
+    static const int BUFFER_WIDTH = 256;
+    static const int BUFFER_HEIGHT = 128;
+
+    // culling results for one frame
+    struct OCCLUSION_STATS
+    {
+        int occluders;
+        int tested;
+        int occluded;
+    };
+
+    // constructor
+    OcclusionCuller();
+
+    // start a frame seen through the passed camera, with no occluders
+    void BeginFrame(const glm::mat4& view, const glm::mat4& projection);
+    // offer a solid box, placed by a model matrix, as an occluder
+    void AddOccluder(const glm::mat4& model, const FrustumCuller::BOUNDS& localBox);
+    // rasterize the largest occluders and build the pyramid over them
+    void BuildPyramid();
+    // true when a world box is certainly hidden by the occluders
+    bool IsOccluded(const FrustumCuller::BOUNDS& worldBounds);
+
+    // results of the current frame
+    OCCLUSION_STATS GetStats() const;
+
+private:
+    // occluders rasterized per frame, the largest on screen first
+    static const int MAX_OCCLUDERS = 16;
+
+    // an offered occluder and its size on screen
+    struct OCCLUDER
+    {
+        glm::mat4 model;
+        FrustumCuller::BOUNDS localBox;
+        float screenSize;
+    };
+
+    // one pyramid level, texels in rows
+    struct DEPTH_LEVEL
+    {
+        int width;
+        int height;
+        std::vector<float> depth;
+    };
+
+    // a texel corner of the occluder being rasterized and the
+    // depth where the view ray through it enters the occluder
+    struct TEXEL_CORNER
+    {
+        bool inside;
+        float depth;
+    };
+
+    glm::mat4 m_viewProjection;
+    glm::vec3 m_cameraPosition;
+    std::vector<OCCLUDER> m_occluders;
+    std::vector<DEPTH_LEVEL> m_levels;
+    std::vector<TEXEL_CORNER> m_corners;
+    // false until an occluder covered a texel this frame
+    bool m_hasDepth;
+
+    OCCLUSION_STATS m_stats;
+
+    // write one occluder into the base level, false when it covered no texel
+    bool RasterizeOccluder(const OCCLUDER& occluder);
+    // farthest depth of the texels covering a rectangle of base texels
+    float GetFarthestDepth(int left, int bottom, int right, int top) const;
+};
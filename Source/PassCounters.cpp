@@ -0,0 +1,126 @@
+///////////////////////////////////////////////////////////////////////////////
+// PassCounters.cpp
+// ================
+// Fragment counts and overdraw of each render pass from occlusion queries
+//
+//  Every pass of a frame is wrapped in a GL_SAMPLES_PASSED query, which
+//  counts the fragments that passed the depth test. Divided by the pixels
+//  of the viewport this is the pass's overdraw. Queries are kept in a small
+//  ring and read back a few frames later, so counting never stalls the
+//  frame being submitted.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "PassCounters.h"
+
+/***********************************************************
+ *  PassCounters()
+ ***********************************************************/
+PassCounters::PassCounters()
+{
+    for (int slot = 0; slot < QUERY_RING_SIZE; ++slot)
+    {
+        for (int pass = 0; pass < PASS_COUNT; ++pass)
+        {
+            m_queries[slot][pass] = 0;
+            m_issued[slot][pass] = false;
+        }
+        m_pending[slot] = false;
+    }
+    m_slot = 0;
+    m_activePass = -1;
+    m_pixelCount = 1;
+    m_stats = PASS_STATS();
+}
+
+/***********************************************************
+ *  ~PassCounters()
+ ***********************************************************/
+PassCounters::~PassCounters()
+{
+    if (m_queries[0][0])
+        glDeleteQueries(QUERY_RING_SIZE * PASS_COUNT, &m_queries[0][0]);
+}
+
+/***********************************************************
+ *  Initialize()
+ ***********************************************************/
+void PassCounters::Initialize()
+{
+    if (!m_queries[0][0])
+        glGenQueries(QUERY_RING_SIZE * PASS_COUNT, &m_queries[0][0]);
+}
+
+/***********************************************************
+ *  SetViewportSize()
+ ***********************************************************/
+void PassCounters::SetViewportSize(int width, int height)
+{
+    m_pixelCount = (width > 0 && height > 0) ? width * height : 1;
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method moves to the next ring slot. The frame that
+ *  last used it was submitted several frames ago, so its
+ *  results are normally ready and reading them does not wait.
+ ***********************************************************/
+void PassCounters::BeginFrame()
+{
+    m_slot = (m_slot + 1) % QUERY_RING_SIZE;
+    if (m_pending[m_slot])
+        ResolveSlot(m_slot);
+
+    for (int pass = 0; pass < PASS_COUNT; ++pass)
+        m_issued[m_slot][pass] = false;
+    m_pending[m_slot] = true;
+}
+
+/***********************************************************
+ *  BeginPass()
+ ***********************************************************/
+void PassCounters::BeginPass(COUNTED_PASS pass)
+{
+    if (!m_queries[0][0] || m_activePass >= 0)
+        return;
+
+    glBeginQuery(GL_SAMPLES_PASSED, m_queries[m_slot][pass]);
+    m_issued[m_slot][pass] = true;
+    m_activePass = pass;
+}
+
+/***********************************************************
+ *  EndPass()
+ ***********************************************************/
+void PassCounters::EndPass()
+{
+    if (m_activePass < 0)
+        return;
+
+    glEndQuery(GL_SAMPLES_PASSED);
+    m_activePass = -1;
+}
+
+/***********************************************************
+ *  GetStats()
+ ***********************************************************/
+PassCounters::PASS_STATS PassCounters::GetStats() const
+{
+    return m_stats;
+}
+
+/***********************************************************
+ *  ResolveSlot()
+ ***********************************************************/
+void PassCounters::ResolveSlot(int slot)
+{
+    for (int pass = 0; pass < PASS_COUNT; ++pass)
+    {
+        GLuint64 fragments = 0;
+        if (m_issued[slot][pass])
+            glGetQueryObjectui64v(m_queries[slot][pass], GL_QUERY_RESULT, &fragments);
+        m_stats.fragments[pass] = fragments;
+        m_stats.overdraw[pass] = (float)fragments / m_pixelCount;
+    }
+    m_pending[slot] = false;
+}
@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////
+// PassCounters.h
+// ==============
+// Fragment counts and overdraw of each render pass from occlusion queries
+//
+//  Every pass of a frame is wrapped in a GL_SAMPLES_PASSED query, which
+//  counts the fragments that passed the depth test. Divided by the pixels
+//  of the viewport this is the pass's overdraw. Queries are kept in a small
+//  ring and read back a few frames later, so counting never stalls the
+//  frame being submitted.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+
+/***********************************************************
+ *  PassCounters
+ *
+ *  This class owns the occlusion queries of the counted
+ *  passes and the results of the most recent resolved frame.
+ ***********************************************************/
+class PassCounters
+{
+public:
+    // passes of a frame, in submission order
+    enum COUNTED_PASS
+    {
+        PASS_DEPTH = 0,
+        PASS_OPAQUE,
+        PASS_TRANSPARENT,
+        PASS_COUNT
+    };
+
+    // fragment counts of one frame, zero for a pass that was skipped
+    struct PASS_STATS
+    {
+        uint64_t fragments[PASS_COUNT];
+        float overdraw[PASS_COUNT];
+    };
+
+    // constructor
+    PassCounters();
+    // destructor
+    ~PassCounters();
+
+    // create the queries once a context is current
+    void Initialize();
+    // pixels of the render target the overdraw is measured over
+    void SetViewportSize(int width, int height);
+
+    // start a frame, reading back the results of the slot it reuses
+    void BeginFrame();
+    // wrap the draws of one pass, passes must not nest
+    void BeginPass(COUNTED_PASS pass);
+    void EndPass();
+
+    // counts of the most recent frame whose results were read
+    PASS_STATS GetStats() const;
+
+private:
+    // number of frames a query may stay in flight
+    static const int QUERY_RING_SIZE = 3;
+
+    GLuint m_queries[QUERY_RING_SIZE][PASS_COUNT];
+    bool m_issued[QUERY_RING_SIZE][PASS_COUNT];
+    bool m_pending[QUERY_RING_SIZE];
+    int m_slot;
+    int m_activePass;
+    int m_pixelCount;
+
+    PASS_STATS m_stats;
+
+    // read back every query of a ring slot
+    void ResolveSlot(int slot);
+};
@@ -0,0 +1,285 @@
+///////////////////////////////////////////////////////////////////////////////
+// Profiler.cpp
+// ============
+// Nested CPU and GPU timing scopes of the render thread, exported as a trace
+//
+//  A scope records the CPU clock when it opens and closes, and a GPU scope
+//  also places a GL_TIMESTAMP query at each end. The queries of a frame are
+//  kept in a small ring and read back a few frames later, so timing never
+//  stalls the frame being submitted. Finished scopes are written as Chrome
+//  trace events, which chrome://tracing and Perfetto display as a timeline
+//  with the CPU and the GPU on separate tracks.
+//
+//  Recording only starts with Start, and each scope of an idle profiler
+//  costs a single test. Building with ENABLE_PROFILER defined as 0 removes
+//  the profiler entirely: every call below then compiles to nothing.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Profiler.h"
+
+#if ENABLE_PROFILER
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    // number of frames whose queries may stay in flight
+    const int QUERY_RING_SIZE = 4;
+    // queries created at a time when a frame runs out
+    const int QUERY_BATCH = 64;
+    // finished scopes kept for the trace, later ones are dropped
+    const size_t MAX_TRACE_EVENTS = 1000000;
+
+    // trace tracks of the render thread and the GPU
+    const int CPU_TRACK = 1;
+    const int GPU_TRACK = 2;
+
+    typedef std::chrono::steady_clock CLOCK;
+
+    // one scope of a frame, times in microseconds since Start
+    struct SCOPE_RECORD
+    {
+        const char* name;
+        double cpuBegin;
+        double cpuEnd;
+        // first of its two timestamp queries, -1 for a CPU scope
+        int query;
+    };
+
+    // scopes of one frame and the timestamp queries they placed
+    struct FRAME_SLOT
+    {
+        std::vector<SCOPE_RECORD> scopes;
+        std::vector<GLuint> queries;
+        int queriesUsed = 0;
+    };
+
+    // one finished scope on one track
+    struct TRACE_EVENT
+    {
+        const char* name;
+        int track;
+        double begin;
+        double duration;
+    };
+
+    struct PROFILER_STATE
+    {
+        bool recording = false;
+        bool drawScopes = false;
+        // CPU clock and GPU timestamp, in nanoseconds, at Start
+        CLOCK::time_point cpuStart;
+        GLint64 gpuStart = 0;
+
+        FRAME_SLOT slots[QUERY_RING_SIZE];
+        int slot = 0;
+        // scopes of the current slot still open, innermost last
+        std::vector<int> openScopes;
+
+        std::vector<TRACE_EVENT> events;
+        bool eventsDropped = false;
+    };
+
+    PROFILER_STATE g_Profiler;
+
+    double GetCpuMicroseconds()
+    {
+        std::chrono::duration<double, std::micro> elapsed = CLOCK::now() - g_Profiler.cpuStart;
+        return elapsed.count();
+    }
+
+    void AddEvent(const char* name, int track, double begin, double end)
+    {
+        if (g_Profiler.events.size() >= MAX_TRACE_EVENTS)
+        {
+            g_Profiler.eventsDropped = true;
+            return;
+        }
+
+        TRACE_EVENT event;
+        event.name = name;
+        event.track = track;
+        event.begin = begin;
+        event.duration = end - begin;
+        g_Profiler.events.push_back(event);
+    }
+
+    // read back a frame's timestamps and turn its scopes into events
+    void ResolveSlot(FRAME_SLOT& slot)
+    {
+        for (const SCOPE_RECORD& scope : slot.scopes)
+        {
+            AddEvent(scope.name, CPU_TRACK, scope.cpuBegin, scope.cpuEnd);
+            if (scope.query < 0)
+                continue;
+
+            GLuint64 begin = 0;
+            GLuint64 end = 0;
+            glGetQueryObjectui64v(slot.queries[scope.query], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(slot.queries[scope.query + 1], GL_QUERY_RESULT, &end);
+            AddEvent(scope.name, GPU_TRACK,
+                (double)((GLint64)begin - g_Profiler.gpuStart) / 1000.0,
+                (double)((GLint64)end - g_Profiler.gpuStart) / 1000.0);
+        }
+        slot.scopes.clear();
+        slot.queriesUsed = 0;
+    }
+}
+
+/***********************************************************
+ *  Start()
+ *
+ *  This method takes the GPU timestamp alongside the CPU
+ *  clock, so that both tracks of the trace share one time
+ *  line starting at zero.
+ ***********************************************************/
+bool Profiler::Start(bool drawScopes)
+{
+    g_Profiler.drawScopes = drawScopes;
+    if (g_Profiler.recording)
+        return true;
+
+    g_Profiler.cpuStart = CLOCK::now();
+    glGetInteger64v(GL_TIMESTAMP, &g_Profiler.gpuStart);
+    g_Profiler.recording = true;
+    return true;
+}
+
+/***********************************************************
+ *  IsRecording()
+ ***********************************************************/
+bool Profiler::IsRecording()
+{
+    return g_Profiler.recording;
+}
+
+/***********************************************************
+ *  IsRecordingDraws()
+ ***********************************************************/
+bool Profiler::IsRecordingDraws()
+{
+    return g_Profiler.recording && g_Profiler.drawScopes;
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method moves to the next ring slot. The frame that
+ *  last used it was submitted several frames ago, so its
+ *  queries are normally ready and reading them does not wait.
+ ***********************************************************/
+void Profiler::BeginFrame()
+{
+    if (!g_Profiler.recording)
+        return;
+
+    g_Profiler.openScopes.clear();
+    g_Profiler.slot = (g_Profiler.slot + 1) % QUERY_RING_SIZE;
+    ResolveSlot(g_Profiler.slots[g_Profiler.slot]);
+}
+
+/***********************************************************
+ *  BeginScope()
+ ***********************************************************/
+void Profiler::BeginScope(const char* name, bool gpu)
+{
+    FRAME_SLOT& slot = g_Profiler.slots[g_Profiler.slot];
+
+    SCOPE_RECORD scope;
+    scope.name = name;
+    scope.query = -1;
+    scope.cpuBegin = GetCpuMicroseconds();
+    scope.cpuEnd = scope.cpuBegin;
+
+    if (gpu)
+    {
+        if (slot.queriesUsed + 2 > (int)slot.queries.size())
+        {
+            size_t created = slot.queries.size();
+            slot.queries.resize(created + QUERY_BATCH);
+            glGenQueries(QUERY_BATCH, &slot.queries[created]);
+        }
+        scope.query = slot.queriesUsed;
+        slot.queriesUsed += 2;
+        glQueryCounter(slot.queries[scope.query], GL_TIMESTAMP);
+    }
+
+    g_Profiler.openScopes.push_back((int)slot.scopes.size());
+    slot.scopes.push_back(scope);
+}
+
+/***********************************************************
+ *  EndScope()
+ ***********************************************************/
+void Profiler::EndScope()
+{
+    if (g_Profiler.openScopes.empty())
+        return;
+
+    FRAME_SLOT& slot = g_Profiler.slots[g_Profiler.slot];
+    SCOPE_RECORD& scope = slot.scopes[g_Profiler.openScopes.back()];
+    g_Profiler.openScopes.pop_back();
+
+    if (scope.query >= 0)
+        glQueryCounter(slot.queries[scope.query + 1], GL_TIMESTAMP);
+    scope.cpuEnd = GetCpuMicroseconds();
+}
+
+/***********************************************************
+ *  WriteTrace()
+ *
+ *  This method stops recording, waits for the frames still
+ *  in flight and writes every scope as a complete event of
+ *  the Chrome trace event format, in microseconds.
+ ***********************************************************/
+bool Profiler::WriteTrace(const char* filename)
+{
+    if (!g_Profiler.recording)
+        return false;
+
+    for (int i = 1; i <= QUERY_RING_SIZE; ++i)
+    {
+        FRAME_SLOT& slot = g_Profiler.slots[(g_Profiler.slot + i) % QUERY_RING_SIZE];
+        ResolveSlot(slot);
+        if (!slot.queries.empty())
+            glDeleteQueries((GLsizei)slot.queries.size(), slot.queries.data());
+        slot.queries.clear();
+    }
+    g_Profiler.openScopes.clear();
+    g_Profiler.recording = false;
+
+    std::ofstream file(filename);
+    if (!file)
+    {
+        std::cout << "Failed to open " << filename << " for writing" << std::endl;
+        return false;
+    }
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\n\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [\n";
+    file << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << CPU_TRACK
+        << ", \"args\": { \"name\": \"Render thread\" } },\n";
+    file << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << GPU_TRACK
+        << ", \"args\": { \"name\": \"GPU\" } }";
+    for (const TRACE_EVENT& event : g_Profiler.events)
+    {
+        file << ",\n{ \"name\": \"" << event.name << "\", \"cat\": \""
+            << (event.track == GPU_TRACK ? "gpu" : "cpu") << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+            << event.track << ", \"ts\": " << event.begin << ", \"dur\": " << event.duration << " }";
+    }
+    file << "\n]\n}\n";
+
+    std::cout << "INFO: " << g_Profiler.events.size() << " profiler scopes written to " << filename << std::endl;
+    if (g_Profiler.eventsDropped)
+        std::cout << "INFO: the trace is incomplete, scopes past " << MAX_TRACE_EVENTS << " were dropped" << std::endl;
+    g_Profiler.events.clear();
+    return true;
+}
+
+#endif
@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////
+// Profiler.h
+// ==========
+// Nested CPU and GPU timing scopes of the render thread, exported as a trace
+//
+//  A scope records the CPU clock when it opens and closes, and a GPU scope
+//  also places a GL_TIMESTAMP query at each end. The queries of a frame are
+//  kept in a small ring and read back a few frames later, so timing never
+//  stalls the frame being submitted. Finished scopes are written as Chrome
+//  trace events, which chrome://tracing and Perfetto display as a timeline
+//  with the CPU and the GPU on separate tracks.
+//
+//  Recording only starts with Start, and each scope of an idle profiler
+//  costs a single test. Building with ENABLE_PROFILER defined as 0 removes
+//  the profiler entirely: every call below then compiles to nothing.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef ENABLE_PROFILER
+#define ENABLE_PROFILER 1
+#endif
+
+#if ENABLE_PROFILER
+
+/***********************************************************
+ *  Profiler
+ *
+ *  This class records the scopes of the render thread. Its
+ *  state is shared by the whole program, so scopes can be
+ *  placed anywhere without passing it around.
+ ***********************************************************/
+class Profiler
+{
+public:
+    // begin recording, per-draw scopes only when asked for
+    static bool Start(bool drawScopes);
+    static bool IsRecording();
+    static bool IsRecordingDraws();
+
+    // move to the next ring slot, reading back the frame that used it
+    static void BeginFrame();
+
+    // open and close a scope, name must outlive the profiler
+    static void BeginScope(const char* name, bool gpu);
+    static void EndScope();
+
+    // wait for every query still in flight and write the trace
+    static bool WriteTrace(const char* filename);
+};
+
+/***********************************************************
+ *  ProfileScope
+ *
+ *  This class opens a scope for the lifetime of a block.
+ ***********************************************************/
+class ProfileScope
+{
+public:
+    ProfileScope(const char* name, bool gpu, bool enabled = true)
+    {
+        m_open = enabled && Profiler::IsRecording();
+        if (m_open)
+            Profiler::BeginScope(name, gpu);
+    }
+
+    ~ProfileScope()
+    {
+        if (m_open)
+            Profiler::EndScope();
+    }
+
+private:
+    bool m_open;
+};
+
+#define PROFILE_JOIN_NAME(prefix, line) prefix##line
+#define PROFILE_SCOPE_NAME(line) PROFILE_JOIN_NAME(profileScope, line)
+
+// time the rest of the enclosing block on the CPU, or on both CPU and GPU
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_SCOPE_NAME(__LINE__)(name, false)
+#define PROFILE_GPU_SCOPE(name) ProfileScope PROFILE_SCOPE_NAME(__LINE__)(name, true)
+// time a single draw, recorded only when draw scopes were asked for
+#define PROFILE_DRAW_SCOPE(name) ProfileScope PROFILE_SCOPE_NAME(__LINE__)(name, true, Profiler::IsRecordingDraws())
+
+#else
+
+// the profiler compiled out, every call does nothing
+class Profiler
+{
+public:
+    static bool Start(bool) { return false; }
+    static bool IsRecording() { return false; }
+    static bool IsRecordingDraws() { return false; }
+    static void BeginFrame() {}
+    static void BeginScope(const char*, bool) {}
+    static void EndScope() {}
+    static bool WriteTrace(const char*) { return false; }
+};
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(name)
+#define PROFILE_DRAW_SCOPE(name)
+
+#endif
@@ -0,0 +1,237 @@
+///////////////////////////////////////////////////////////////////////////////
+// RenderQueue.cpp
+// ===============
+// Collects scene draws and orders them to minimize shader state changes
+//
+//  Each queued draw carries the full state it needs and a packed 64-bit
+//  sort key. Sorting the keys groups draws that share a pass, shader
+//  variant, mesh, texture and material so that submission only has to
+//  change the state that actually differs between neighbours. Opaque
+//  draws are ordered roughly front to back and transparent draws strictly
+//  back to front.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "RenderQueue.h"
+
+#include <cstring>
+#include <utility>
+
+namespace
+{
+    // sort key layout, most significant field first
+    //   63..62  render pass
+    // opaque draws
+    //   61..51  depth bucket, nearest first (0 = depth order off)
+    //   50..49  shader variant
+    //   48..41  mesh
+    //   40..37  level of detail
+    //   36..29  texture layer + 1 (0 = none)
+    //   28..21  material index + 1 (0 = none)
+    //   20..0   unused, zero
+    // transparent draws
+    //   61..30  depth, farthest first
+    //   29..0   unused, zero
+    // a depth bucket is an eighth of a doubling of distance, so nearby draws
+    // still group by state; mesh and level sit above texture and material so
+    // that draws of one mesh level stay adjacent and can be merged into a
+    // single instanced draw
+    const int PASS_SHIFT = 62;
+    const int DEPTH_BUCKET_SHIFT = 51;
+    const int VARIANT_SHIFT = 49;
+    const int MESH_SHIFT = 41;
+    const int LOD_SHIFT = 37;
+    const int TEXTURE_SHIFT = 29;
+    const int MATERIAL_SHIFT = 21;
+    const int FAR_DEPTH_SHIFT = 30;
+    const uint64_t FIELD_MASK = 0xFF;
+    const uint64_t LOD_MASK = 0xF;
+    // exponent and top three mantissa bits of a positive float
+    const int DEPTH_BUCKET_BITS_SHIFT = 20;
+    const uint64_t DEPTH_BUCKET_MASK = 0x7FF;
+
+    const int RADIX_BITS = 8;
+    const int RADIX_BUCKETS = 1 << RADIX_BITS;
+    const int RADIX_PASSES = 64 / RADIX_BITS;
+
+    // mesh names in MESH_ID order
+    const char* const MESH_NAMES[RenderQueue::MESH_COUNT] = {
+        "plane",
+        "box",
+        "cylinder",
+        "cylinder_open_top",
+        "cone",
+        "sphere",
+        "torus",
+        "tapered_cylinder"
+    };
+
+    /***********************************************************
+     *  DepthBits()
+     *
+     *  Bits of a depth clamped to zero or more, which order
+     *  like the depths themselves.
+     ***********************************************************/
+    uint32_t DepthBits(float depth)
+    {
+        float positive = (depth > 0.0f) ? depth : 0.0f;
+        uint32_t bits;
+        std::memcpy(&bits, &positive, sizeof(bits));
+        return bits;
+    }
+}
+
+/***********************************************************
+ *  RenderQueue()
+ ***********************************************************/
+RenderQueue::RenderQueue()
+{
+    m_opaqueDepthOrder = true;
+}
+
+/***********************************************************
+ *  SetOpaqueDepthOrder()
+ ***********************************************************/
+void RenderQueue::SetOpaqueDepthOrder(bool enable)
+{
+    m_opaqueDepthOrder = enable;
+}
+
+/***********************************************************
+ *  GetMeshName()
+ ***********************************************************/
+const char* RenderQueue::GetMeshName(MESH_ID mesh)
+{
+    return MESH_NAMES[mesh];
+}
+
+/***********************************************************
+ *  Clear()
+ ***********************************************************/
+void RenderQueue::Clear()
+{
+    m_items.clear();
+    m_entries.clear();
+}
+
+/***********************************************************
+ *  Submit()
+ ***********************************************************/
+void RenderQueue::Submit(const DRAW_ITEM& item)
+{
+    SORT_ENTRY entry;
+    entry.key = BuildSortKey(item);
+    entry.index = (uint32_t)m_items.size();
+
+    m_items.push_back(item);
+    m_entries.push_back(entry);
+}
+
+/***********************************************************
+ *  Sort()
+ ***********************************************************/
+void RenderQueue::Sort()
+{
+    RadixSort();
+}
+
+/***********************************************************
+ *  GetCount()
+ ***********************************************************/
+int RenderQueue::GetCount() const
+{
+    return (int)m_entries.size();
+}
+
+/***********************************************************
+ *  GetSorted()
+ ***********************************************************/
+const RenderQueue::DRAW_ITEM& RenderQueue::GetSorted(int position) const
+{
+    return m_items[m_entries[position].index];
+}
+
+/***********************************************************
+ *  BuildSortKey()
+ *
+ *  This method packs the state of a draw so that the most
+ *  expensive state to change sits in the highest bits, under
+ *  the pass and depth order. Blending needs transparent draws
+ *  in exact back to front order, so they sort by depth alone.
+ ***********************************************************/
+uint64_t RenderQueue::BuildSortKey(const DRAW_ITEM& item) const
+{
+    uint64_t pass = (uint64_t)item.pass << PASS_SHIFT;
+    if (item.pass == PASS_TRANSPARENT)
+        return pass | ((uint64_t)(~DepthBits(item.depth)) << FAR_DEPTH_SHIFT);
+
+    uint64_t depthBucket = 0;
+    if (m_opaqueDepthOrder)
+        depthBucket = (DepthBits(item.depth) >> DEPTH_BUCKET_BITS_SHIFT) & DEPTH_BUCKET_MASK;
+
+    uint64_t variant = item.useTexture ? VARIANT_TEXTURED : VARIANT_COLORED;
+    uint64_t texture = item.useTexture ? (uint64_t)(item.textureLayer + 1) & FIELD_MASK : 0;
+    uint64_t material = (uint64_t)(item.materialIndex + 1) & FIELD_MASK;
+    uint64_t mesh = (uint64_t)item.mesh & FIELD_MASK;
+    uint64_t lod = (uint64_t)item.lod & LOD_MASK;
+
+    return pass |
+        (depthBucket << DEPTH_BUCKET_SHIFT) |
+        (variant << VARIANT_SHIFT) |
+        (mesh << MESH_SHIFT) |
+        (lod << LOD_SHIFT) |
+        (texture << TEXTURE_SHIFT) |
+        (material << MATERIAL_SHIFT);
+}
+
+/***********************************************************
+ *  RadixSort()
+ *
+ *  This method sorts the entries eight bits at a time from
+ *  the least significant byte up. All byte histograms are
+ *  built in a single read of the keys, and any byte that is
+ *  the same for every entry is skipped, so unused key bits
+ *  cost nothing.
+ ***********************************************************/
+void RenderQueue::RadixSort()
+{
+    size_t count = m_entries.size();
+    if (count < 2)
+        return;
+
+    uint32_t histograms[RADIX_PASSES][RADIX_BUCKETS] = {};
+    for (const SORT_ENTRY& entry : m_entries)
+    {
+        for (int pass = 0; pass < RADIX_PASSES; ++pass)
+            ++histograms[pass][(entry.key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)];
+    }
+
+    m_scratch.resize(count);
+    std::vector<SORT_ENTRY>* source = &m_entries;
+    std::vector<SORT_ENTRY>* destination = &m_scratch;
+
+    for (int pass = 0; pass < RADIX_PASSES; ++pass)
+    {
+        uint32_t* histogram = histograms[pass];
+        int shift = pass * RADIX_BITS;
+
+        // every entry in one bucket means this byte cannot reorder anything
+        if (histogram[((*source)[0].key >> shift) & (RADIX_BUCKETS - 1)] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (int bucket = 0; bucket < RADIX_BUCKETS; ++bucket)
+        {
+            uint32_t bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+
+        for (const SORT_ENTRY& entry : *source)
+            (*destination)[histogram[(entry.key >> shift) & (RADIX_BUCKETS - 1)]++] = entry;
+
+        std::swap(source, destination);
+    }
+
+    if (source != &m_entries)
+        m_entries.swap(m_scratch);
+}
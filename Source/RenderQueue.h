@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////
+// RenderQueue.h
+// =============
+// Collects scene draws and orders them to minimize shader state changes
+//
+//  Each queued draw carries the full state it needs and a packed 64-bit
+//  sort key. Sorting the keys groups draws that share a pass, shader
+//  variant, mesh, texture and material so that submission only has to
+//  change the state that actually differs between neighbours. Opaque
+//  draws are ordered roughly front to back and transparent draws strictly
+//  back to front.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  RenderQueue
+ *
+ *  This class stores the draws for one frame and sorts them
+ *  by their state key with a stable LSD radix sort.
+ ***********************************************************/
+class RenderQueue
+{
+public:
+    // render passes, in submission order
+    enum RENDER_PASS
+    {
+        PASS_OPAQUE = 0,
+        PASS_TRANSPARENT
+    };
+
+    // shader variants a draw is drawn with, see ShaderVariants
+    enum SHADER_VARIANT
+    {
+        VARIANT_TEXTURED = 0,
+        VARIANT_COLORED
+    };
+
+    // meshes of the shared geometry buffers in InstancedMeshes
+    enum MESH_ID
+    {
+        MESH_PLANE = 0,
+        MESH_BOX,
+        MESH_CYLINDER,
+        MESH_CYLINDER_OPEN_TOP,
+        MESH_CONE,
+        MESH_SPHERE,
+        MESH_TORUS,
+        MESH_TAPERED_CYLINDER,
+        MESH_COUNT
+    };
+
+    // everything needed to issue one draw
+    struct DRAW_ITEM
+    {
+        glm::mat4 model;
+        glm::vec4 color;
+        glm::vec2 uvScale;
+        int textureLayer;
+        int materialIndex;
+        bool useTexture;
+        MESH_ID mesh;
+        int lod;
+        RENDER_PASS pass;
+        // view depth of the bounds center
+        float depth;
+    };
+
+    // state change counts for one submitted frame
+    struct QUEUE_STATS
+    {
+        int draws;
+        int drawCalls;
+        int stateChanges;
+        int naiveStateChanges;
+        int indirectCommands;
+        int triangles;
+    };
+
+    // constructor
+    RenderQueue();
+
+    // name of a mesh in scene files and reports
+    static const char* GetMeshName(MESH_ID mesh);
+
+    // order opaque draws by depth before state, off when a depth prepass resolves visibility
+    void SetOpaqueDepthOrder(bool enable);
+
+    // remove all queued draws
+    void Clear();
+    // add a draw and build its sort key
+    void Submit(const DRAW_ITEM& item);
+    // order the queued draws by sort key
+    void Sort();
+
+    // number of queued draws
+    int GetCount() const;
+    // queued draw at a position of the sorted order
+    const DRAW_ITEM& GetSorted(int position) const;
+
+private:
+    // sort key and the draw it belongs to
+    struct SORT_ENTRY
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<DRAW_ITEM> m_items;
+    std::vector<SORT_ENTRY> m_entries;
+    std::vector<SORT_ENTRY> m_scratch;
+    bool m_opaqueDepthOrder;
+
+    // pack the pass, depth and state of a draw into its sort key
+    uint64_t BuildSortKey(const DRAW_ITEM& item) const;
+    // stable radix sort of m_entries by key
+    void RadixSort();
+};
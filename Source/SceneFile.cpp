@@ -0,0 +1,728 @@
+///////////////////////////////////////////////////////////////////////////////
+// SceneFile.cpp
+// =============
+// Compiled scene descriptions loaded by memory mapping
+//
+//  Scenes are written as text, one texture, material, light, pivot or
+//  object per line, and compiled into a flat binary file of fixed-size
+//  records. At runtime the binary file is mapped and its records are read
+//  in place, so loading a scene does no parsing and no per-object
+//  allocation however many objects it holds.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SceneFile.h"
+#include "RenderQueue.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace
+{
+    const char SCENE_MAGIC[4] = { 'S', 'C', 'N', 'B' };
+    const uint32_t SCENE_VERSION = 3;
+    const char* SOURCE_EXTENSION = ".scene";
+    const char* BINARY_EXTENSION = ".scnb";
+
+    // fixed-size header at the start of every compiled scene,
+    // followed by the record tables and the string table
+    struct SCENE_HEADER
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t textureCount;
+        uint32_t textureOffset;
+        uint32_t materialCount;
+        uint32_t materialOffset;
+        uint32_t lightCount;
+        uint32_t lightOffset;
+        uint32_t pivotCount;
+        uint32_t pivotOffset;
+        uint32_t objectCount;
+        uint32_t objectOffset;
+        uint32_t stringsOffset;
+        uint32_t stringsSize;
+    };
+
+    // records and names gathered while compiling a source
+    struct SCENE_BUILDER
+    {
+        std::vector<SceneFile::SCENE_TEXTURE> textures;
+        std::vector<SceneFile::SCENE_MATERIAL> materials;
+        std::vector<SceneFile::SCENE_LIGHT> lights;
+        std::vector<SceneFile::SCENE_PIVOT> pivots;
+        std::vector<SceneFile::SCENE_OBJECT> objects;
+        std::string strings;
+        std::unordered_map<std::string, int> textureIndices;
+        std::unordered_map<std::string, int> materialIndices;
+        std::unordered_map<std::string, int> pivotIndices;
+
+        uint32_t AddString(const std::string& text)
+        {
+            uint32_t offset = (uint32_t)strings.size();
+            strings += text;
+            strings.push_back('\0');
+            return offset;
+        }
+    };
+
+    bool ReadFloats(std::istringstream& line, float* values, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            if (!(line >> values[i]))
+                return false;
+        }
+        return true;
+    }
+
+    // index of a name defined earlier in the source, -1 if unknown
+    int FindIndex(const std::unordered_map<std::string, int>& indices, const std::string& name)
+    {
+        auto found = indices.find(name);
+        return (found != indices.end()) ? found->second : -1;
+    }
+
+    /***********************************************************
+     *  ParseTexture()
+     *
+     *  texture <tag> <image path>
+     ***********************************************************/
+    bool ParseTexture(std::istringstream& line, SCENE_BUILDER& builder, std::string& error)
+    {
+        std::string tag, path;
+        if (!(line >> tag >> path))
+        {
+            error = "expected texture <tag> <path>";
+            return false;
+        }
+        if (builder.textureIndices.count(tag))
+        {
+            error = "texture " + tag + " is already defined";
+            return false;
+        }
+
+        SceneFile::SCENE_TEXTURE texture;
+        texture.tag = builder.AddString(tag);
+        texture.path = builder.AddString(path);
+        builder.textureIndices[tag] = (int)builder.textures.size();
+        builder.textures.push_back(texture);
+        return true;
+    }
+
+    /***********************************************************
+     *  ParseMaterial()
+     *
+     *  material <tag> strength S ambient R G B diffuse R G B
+     *           specular R G B shininess S [opacity A]
+     ***********************************************************/
+    bool ParseMaterial(std::istringstream& line, SCENE_BUILDER& builder, std::string& error)
+    {
+        std::string tag;
+        if (!(line >> tag))
+        {
+            error = "expected material <tag>";
+            return false;
+        }
+        if (builder.materialIndices.count(tag))
+        {
+            error = "material " + tag + " is already defined";
+            return false;
+        }
+
+        SceneFile::SCENE_MATERIAL material = SceneFile::SCENE_MATERIAL();
+        material.tag = builder.AddString(tag);
+        material.opacity = 1.0f;
+
+        std::string property;
+        while (line >> property)
+        {
+            bool read = false;
+            if (property == "strength")
+                read = ReadFloats(line, &material.ambientStrength, 1);
+            else if (property == "ambient")
+                read = ReadFloats(line, material.ambientColor, 3);
+            else if (property == "diffuse")
+                read = ReadFloats(line, material.diffuseColor, 3);
+            else if (property == "specular")
+                read = ReadFloats(line, material.specularColor, 3);
+            else if (property == "shininess")
+                read = ReadFloats(line, &material.shininess, 1);
+            else if (property == "opacity")
+                read = ReadFloats(line, &material.opacity, 1);
+
+            if (!read)
+            {
+                error = "bad material property " + property;
+                return false;
+            }
+        }
+
+        builder.materialIndices[tag] = (int)builder.materials.size();
+        builder.materials.push_back(material);
+        return true;
+    }
+
+    /***********************************************************
+     *  ParseLight()
+     *
+     *  light position X Y Z ambient R G B diffuse R G B
+     *        specular R G B [focal F] [intensity I] [range R]
+     ***********************************************************/
+    bool ParseLight(std::istringstream& line, SCENE_BUILDER& builder, std::string& error)
+    {
+        SceneFile::SCENE_LIGHT light = SceneFile::SCENE_LIGHT();
+
+        std::string property;
+        while (line >> property)
+        {
+            bool read = false;
+            if (property == "position")
+                read = ReadFloats(line, light.position, 3);
+            else if (property == "ambient")
+                read = ReadFloats(line, light.ambientColor, 3);
+            else if (property == "diffuse")
+                read = ReadFloats(line, light.diffuseColor, 3);
+            else if (property == "specular")
+                read = ReadFloats(line, light.specularColor, 3);
+            else if (property == "focal")
+                read = ReadFloats(line, &light.focalStrength, 1);
+            else if (property == "intensity")
+                read = ReadFloats(line, &light.specularIntensity, 1);
+            else if (property == "range")
+                read = ReadFloats(line, &light.range, 1) && light.range >= 0.0f;
+
+            if (!read)
+            {
+                error = "bad light property " + property;
+                return false;
+            }
+        }
+
+        builder.lights.push_back(light);
+        return true;
+    }
+
+    /***********************************************************
+     *  ParsePivot()
+     *
+     *  pivot <name> center X Y Z [spin DEGREES_PER_TICK]
+     ***********************************************************/
+    bool ParsePivot(std::istringstream& line, SCENE_BUILDER& builder, std::string& error)
+    {
+        std::string name;
+        if (!(line >> name))
+        {
+            error = "expected pivot <name>";
+            return false;
+        }
+        if (builder.pivotIndices.count(name))
+        {
+            error = "pivot " + name + " is already defined";
+            return false;
+        }
+
+        SceneFile::SCENE_PIVOT pivot = SceneFile::SCENE_PIVOT();
+        pivot.name = builder.AddString(name);
+
+        std::string property;
+        while (line >> property)
+        {
+            bool read = false;
+            if (property == "center")
+                read = ReadFloats(line, pivot.center, 3);
+            else if (property == "spin")
+                read = ReadFloats(line, &pivot.degreesPerTick, 1);
+
+            if (!read)
+            {
+                error = "bad pivot property " + property;
+                return false;
+            }
+        }
+
+        builder.pivotIndices[name] = (int)builder.pivots.size();
+        builder.pivots.push_back(pivot);
+        return true;
+    }
+
+    /***********************************************************
+     *  ParseObject()
+     *
+     *  object <mesh> [scale X Y Z] [rotation X Y Z]
+     *         [position X Y Z] [texture TAG | color R G B A]
+     *         [material TAG] [uv U V] [pivot NAME]
+     ***********************************************************/
+    bool ParseObject(std::istringstream& line, SCENE_BUILDER& builder, std::string& error)
+    {
+        std::string meshName;
+        if (!(line >> meshName))
+        {
+            error = "expected object <mesh>";
+            return false;
+        }
+
+        SceneFile::SCENE_OBJECT object = SceneFile::SCENE_OBJECT();
+        object.mesh = -1;
+        for (int mesh = 0; mesh < RenderQueue::MESH_COUNT; ++mesh)
+        {
+            if (meshName == RenderQueue::GetMeshName((RenderQueue::MESH_ID)mesh))
+                object.mesh = mesh;
+        }
+        if (object.mesh < 0)
+        {
+            error = "unknown mesh " + meshName;
+            return false;
+        }
+
+        for (int axis = 0; axis < 3; ++axis)
+            object.scale[axis] = 1.0f;
+        for (int channel = 0; channel < 4; ++channel)
+            object.color[channel] = 1.0f;
+        object.uvScale[0] = 1.0f;
+        object.uvScale[1] = 1.0f;
+        object.texture = -1;
+        object.material = -1;
+        object.pivot = -1;
+
+        std::string property;
+        while (line >> property)
+        {
+            bool read = false;
+            std::string name;
+            if (property == "scale")
+                read = ReadFloats(line, object.scale, 3);
+            else if (property == "rotation")
+                read = ReadFloats(line, object.rotationDegrees, 3);
+            else if (property == "position")
+                read = ReadFloats(line, object.position, 3);
+            else if (property == "color")
+                read = ReadFloats(line, object.color, 4);
+            else if (property == "uv")
+                read = ReadFloats(line, object.uvScale, 2);
+            else if (property == "texture" && (line >> name))
+                read = (object.texture = FindIndex(builder.textureIndices, name)) >= 0;
+            else if (property == "material" && (line >> name))
+                read = (object.material = FindIndex(builder.materialIndices, name)) >= 0;
+            else if (property == "pivot" && (line >> name))
+                read = (object.pivot = FindIndex(builder.pivotIndices, name)) >= 0;
+
+            if (!read)
+            {
+                error = name.empty() ? "bad object property " + property : "undefined " + property + " " + name;
+                return false;
+            }
+        }
+
+        builder.objects.push_back(object);
+        return true;
+    }
+
+    /***********************************************************
+     *  AppendTable()
+     ***********************************************************/
+    template <typename RECORD>
+    void AppendTable(std::vector<unsigned char>& file, const std::vector<RECORD>& records, uint32_t& count, uint32_t& offset)
+    {
+        count = (uint32_t)records.size();
+        offset = (uint32_t)file.size();
+        if (!records.empty())
+        {
+            const unsigned char* bytes = (const unsigned char*)records.data();
+            file.insert(file.end(), bytes, bytes + records.size() * sizeof(RECORD));
+        }
+    }
+
+    /***********************************************************
+     *  TableFits()
+     ***********************************************************/
+    bool TableFits(uint32_t offset, uint32_t count, size_t recordSize, size_t fileSize)
+    {
+        return offset % 4 == 0 && offset <= fileSize &&
+            (uint64_t)count * recordSize <= (uint64_t)(fileSize - offset);
+    }
+
+    /***********************************************************
+     *  GetModifiedTime()
+     *
+     *  Last write time of a file in seconds, -1 if it does not
+     *  exist.
+     ***********************************************************/
+    long long GetModifiedTime(const std::string& filename)
+    {
+#ifdef _WIN32
+        struct _stat64 fileStatus;
+        if (_stat64(filename.c_str(), &fileStatus) != 0)
+            return -1;
+#else
+        struct stat fileStatus;
+        if (stat(filename.c_str(), &fileStatus) != 0)
+            return -1;
+#endif
+        return (long long)fileStatus.st_mtime;
+    }
+}
+
+/***********************************************************
+ *  SceneFile()
+ ***********************************************************/
+SceneFile::SceneFile()
+{
+    m_data = nullptr;
+    Close();
+}
+
+/***********************************************************
+ *  Compile()
+ *
+ *  This method parses the text source, resolving every tag
+ *  and name to a record index, and writes the records and
+ *  string table behind a header. The file is written under
+ *  a temporary name and renamed into place, so a reader
+ *  never maps a partly written scene.
+ ***********************************************************/
+bool SceneFile::Compile(const std::string& sourceFilename, const std::string& binaryFilename)
+{
+    std::ifstream source(sourceFilename);
+    if (!source)
+    {
+        std::cout << "Failed to open scene source: " << sourceFilename << std::endl;
+        return false;
+    }
+
+    SCENE_BUILDER builder;
+    std::string text;
+    int lineNumber = 0;
+    while (std::getline(source, text))
+    {
+        ++lineNumber;
+        size_t comment = text.find('#');
+        if (comment != std::string::npos)
+            text.erase(comment);
+
+        std::istringstream line(text);
+        std::string keyword;
+        if (!(line >> keyword))
+            continue;
+
+        bool parsed = false;
+        std::string error;
+        if (keyword == "texture")
+            parsed = ParseTexture(line, builder, error);
+        else if (keyword == "material")
+            parsed = ParseMaterial(line, builder, error);
+        else if (keyword == "light")
+            parsed = ParseLight(line, builder, error);
+        else if (keyword == "pivot")
+            parsed = ParsePivot(line, builder, error);
+        else if (keyword == "object")
+            parsed = ParseObject(line, builder, error);
+        else
+            error = "unknown keyword " + keyword;
+
+        if (!parsed)
+        {
+            std::cout << "Scene error in " << sourceFilename << " line " << lineNumber << ": " << error << std::endl;
+            return false;
+        }
+    }
+
+    // keep the string table, and so the whole file, a multiple of four bytes
+    builder.AddString("");
+    while (builder.strings.size() % 4 != 0)
+        builder.strings.push_back('\0');
+
+    SCENE_HEADER header = SCENE_HEADER();
+    memcpy(header.magic, SCENE_MAGIC, sizeof(header.magic));
+    header.version = SCENE_VERSION;
+
+    std::vector<unsigned char> file(sizeof(SCENE_HEADER));
+    AppendTable(file, builder.textures, header.textureCount, header.textureOffset);
+    AppendTable(file, builder.materials, header.materialCount, header.materialOffset);
+    AppendTable(file, builder.lights, header.lightCount, header.lightOffset);
+    AppendTable(file, builder.pivots, header.pivotCount, header.pivotOffset);
+    AppendTable(file, builder.objects, header.objectCount, header.objectOffset);
+    header.stringsOffset = (uint32_t)file.size();
+    header.stringsSize = (uint32_t)builder.strings.size();
+    file.insert(file.end(), builder.strings.begin(), builder.strings.end());
+    memcpy(file.data(), &header, sizeof(header));
+
+    std::string temporaryFilename = binaryFilename + ".tmp";
+    {
+        std::ofstream binary(temporaryFilename, std::ios::binary | std::ios::trunc);
+        if (!binary)
+        {
+            std::cout << "Failed to write compiled scene: " << binaryFilename << std::endl;
+            return false;
+        }
+        binary.write((const char*)file.data(), (std::streamsize)file.size());
+        if (!binary)
+        {
+            std::cout << "Failed to write compiled scene: " << binaryFilename << std::endl;
+            return false;
+        }
+    }
+
+    std::remove(binaryFilename.c_str());
+    if (std::rename(temporaryFilename.c_str(), binaryFilename.c_str()) != 0)
+    {
+        std::cout << "Failed to write compiled scene: " << binaryFilename << std::endl;
+        return false;
+    }
+
+    std::cout << "Compiled scene " << sourceFilename << ": " << builder.objects.size() << " objects" << std::endl;
+    return true;
+}
+
+/***********************************************************
+ *  GetBinaryFilename()
+ ***********************************************************/
+std::string SceneFile::GetBinaryFilename(const std::string& sourceFilename)
+{
+    size_t extensionLength = strlen(SOURCE_EXTENSION);
+    if (sourceFilename.size() > extensionLength &&
+        sourceFilename.compare(sourceFilename.size() - extensionLength, extensionLength, SOURCE_EXTENSION) == 0)
+        return sourceFilename.substr(0, sourceFilename.size() - extensionLength) + BINARY_EXTENSION;
+    return sourceFilename + BINARY_EXTENSION;
+}
+
+/***********************************************************
+ *  Load()
+ *
+ *  This method maps the file and checks the header, that
+ *  every table lies inside the file, and that every index
+ *  and name offset of the records is in range. The records
+ *  are then read straight from the mapping.
+ ***********************************************************/
+bool SceneFile::Load(const std::string& binaryFilename)
+{
+    Close();
+    if (!m_file.Open(binaryFilename))
+        return false;
+
+    size_t fileSize = m_file.GetSize();
+    const unsigned char* data = m_file.GetData();
+    SCENE_HEADER header;
+    if (fileSize < sizeof(header))
+    {
+        Close();
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    bool valid = memcmp(header.magic, SCENE_MAGIC, sizeof(header.magic)) == 0 &&
+        header.version == SCENE_VERSION &&
+        TableFits(header.textureOffset, header.textureCount, sizeof(SCENE_TEXTURE), fileSize) &&
+        TableFits(header.materialOffset, header.materialCount, sizeof(SCENE_MATERIAL), fileSize) &&
+        TableFits(header.lightOffset, header.lightCount, sizeof(SCENE_LIGHT), fileSize) &&
+        TableFits(header.pivotOffset, header.pivotCount, sizeof(SCENE_PIVOT), fileSize) &&
+        TableFits(header.objectOffset, header.objectCount, sizeof(SCENE_OBJECT), fileSize) &&
+        TableFits(header.stringsOffset, header.stringsSize, 1, fileSize) &&
+        header.stringsSize > 0 && data[header.stringsOffset + header.stringsSize - 1] == '\0';
+    if (!valid)
+    {
+        std::cout << "Compiled scene is invalid or out of date: " << binaryFilename << std::endl;
+        Close();
+        return false;
+    }
+
+    m_data = data;
+    m_strings = (const char*)(data + header.stringsOffset);
+    m_textureCount = (int)header.textureCount;
+    m_materialCount = (int)header.materialCount;
+    m_lightCount = (int)header.lightCount;
+    m_pivotCount = (int)header.pivotCount;
+    m_objectCount = (int)header.objectCount;
+    m_textures = (const SCENE_TEXTURE*)(data + header.textureOffset);
+    m_materials = (const SCENE_MATERIAL*)(data + header.materialOffset);
+    m_lights = (const SCENE_LIGHT*)(data + header.lightOffset);
+    m_pivots = (const SCENE_PIVOT*)(data + header.pivotOffset);
+    m_objects = (const SCENE_OBJECT*)(data + header.objectOffset);
+
+    if (!ValidateRecords(header.stringsSize))
+    {
+        std::cout << "Compiled scene has records out of range: " << binaryFilename << std::endl;
+        Close();
+        return false;
+    }
+    return true;
+}
+
+/***********************************************************
+ *  LoadOrCompile()
+ *
+ *  This method loads the compiled scene next to the source.
+ *  The source is compiled first when the compiled file is
+ *  missing, older than the source or fails to load. Without
+ *  a source, a compiled scene shipped on its own still loads.
+ ***********************************************************/
+bool SceneFile::LoadOrCompile(const std::string& sourceFilename)
+{
+    std::string binaryFilename = GetBinaryFilename(sourceFilename);
+    long long sourceTime = GetModifiedTime(sourceFilename);
+    long long binaryTime = GetModifiedTime(binaryFilename);
+
+    if (sourceTime <= binaryTime && Load(binaryFilename))
+        return true;
+
+    if (sourceTime < 0)
+    {
+        std::cout << "Failed to load scene: " << sourceFilename << std::endl;
+        return false;
+    }
+
+    if (!Compile(sourceFilename, binaryFilename) && binaryTime >= 0)
+        std::cout << "Using the previously compiled scene: " << binaryFilename << std::endl;
+    return Load(binaryFilename);
+}
+
+/***********************************************************
+ *  Close()
+ ***********************************************************/
+void SceneFile::Close()
+{
+    m_file.Close();
+    m_data = nullptr;
+    m_strings = nullptr;
+    m_textureCount = 0;
+    m_materialCount = 0;
+    m_lightCount = 0;
+    m_pivotCount = 0;
+    m_objectCount = 0;
+    m_textures = nullptr;
+    m_materials = nullptr;
+    m_lights = nullptr;
+    m_pivots = nullptr;
+    m_objects = nullptr;
+}
+
+/***********************************************************
+ *  GetTextureCount()
+ ***********************************************************/
+int SceneFile::GetTextureCount() const
+{
+    return m_textureCount;
+}
+
+/***********************************************************
+ *  GetTextures()
+ ***********************************************************/
+const SceneFile::SCENE_TEXTURE* SceneFile::GetTextures() const
+{
+    return m_textures;
+}
+
+/***********************************************************
+ *  GetMaterialCount()
+ ***********************************************************/
+int SceneFile::GetMaterialCount() const
+{
+    return m_materialCount;
+}
+
+/***********************************************************
+ *  GetMaterials()
+ ***********************************************************/
+const SceneFile::SCENE_MATERIAL* SceneFile::GetMaterials() const
+{
+    return m_materials;
+}
+
+/***********************************************************
+ *  GetLightCount()
+ ***********************************************************/
+int SceneFile::GetLightCount() const
+{
+    return m_lightCount;
+}
+
+/***********************************************************
+ *  GetLights()
+ ***********************************************************/
+const SceneFile::SCENE_LIGHT* SceneFile::GetLights() const
+{
+    return m_lights;
+}
+
+/***********************************************************
+ *  GetPivotCount()
+ ***********************************************************/
+int SceneFile::GetPivotCount() const
+{
+    return m_pivotCount;
+}
+
+/***********************************************************
+ *  GetPivots()
+ ***********************************************************/
+const SceneFile::SCENE_PIVOT* SceneFile::GetPivots() const
+{
+    return m_pivots;
+}
+
+/***********************************************************
+ *  GetObjectCount()
+ ***********************************************************/
+int SceneFile::GetObjectCount() const
+{
+    return m_objectCount;
+}
+
+/***********************************************************
+ *  GetObjects()
+ ***********************************************************/
+const SceneFile::SCENE_OBJECT* SceneFile::GetObjects() const
+{
+    return m_objects;
+}
+
+/***********************************************************
+ *  GetString()
+ ***********************************************************/
+const char* SceneFile::GetString(uint32_t offset) const
+{
+    return m_strings + offset;
+}
+
+/***********************************************************
+ *  ValidateRecords()
+ ***********************************************************/
+bool SceneFile::ValidateRecords(uint32_t stringsSize) const
+{
+    for (int i = 0; i < m_textureCount; ++i)
+    {
+        if (m_textures[i].tag >= stringsSize || m_textures[i].path >= stringsSize)
+            return false;
+    }
+    for (int i = 0; i < m_materialCount; ++i)
+    {
+        if (m_materials[i].tag >= stringsSize)
+            return false;
+    }
+    for (int i = 0; i < m_lightCount; ++i)
+    {
+        if (!(m_lights[i].range >= 0.0f))
+            return false;
+    }
+    for (int i = 0; i < m_pivotCount; ++i)
+    {
+        if (m_pivots[i].name >= stringsSize)
+            return false;
+    }
+    for (int i = 0; i < m_objectCount; ++i)
+    {
+        const SCENE_OBJECT& object = m_objects[i];
+        if (object.mesh < 0 || object.mesh >= RenderQueue::MESH_COUNT ||
+            object.texture < -1 || object.texture >= m_textureCount ||
+            object.material < -1 || object.material >= m_materialCount ||
+            object.pivot < -1 || object.pivot >= m_pivotCount)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////////////
+// SceneFile.h
+// ===========
+// Compiled scene descriptions loaded by memory mapping
+//
+//  Scenes are written as text, one texture, material, light, pivot or
+//  object per line, and compiled into a flat binary file of fixed-size
+//  records. At runtime the binary file is mapped and its records are read
+//  in place, so loading a scene does no parsing and no per-object
+//  allocation however many objects it holds.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+
+/***********************************************************
+ *  SceneFile
+ *
+ *  This class compiles scene sources and gives read access
+ *  to the records of a mapped compiled scene. Names are
+ *  stored as offsets into a string table of the file.
+ ***********************************************************/
+class SceneFile
+{
+public:
+    // image file shared by every object using the tag
+    struct SCENE_TEXTURE
+    {
+        uint32_t tag;
+        uint32_t path;
+    };
+
+    struct SCENE_MATERIAL
+    {
+        uint32_t tag;
+        float ambientStrength;
+        float ambientColor[3];
+        float diffuseColor[3];
+        float specularColor[3];
+        float shininess;
+        float opacity;
+    };
+
+    // point light, a range of 0 lights the whole scene without falloff
+    struct SCENE_LIGHT
+    {
+        float position[3];
+        float ambientColor[3];
+        float diffuseColor[3];
+        float specularColor[3];
+        float focalStrength;
+        float specularIntensity;
+        float range;
+    };
+
+    // vertical axis that objects can be attached to and turn around
+    struct SCENE_PIVOT
+    {
+        uint32_t name;
+        float center[3];
+        float degreesPerTick;
+    };
+
+    // one draw, texture, material and pivot are indices or -1
+    struct SCENE_OBJECT
+    {
+        float scale[3];
+        float rotationDegrees[3];
+        float position[3];
+        float color[4];
+        float uvScale[2];
+        int32_t mesh;
+        int32_t texture;
+        int32_t material;
+        int32_t pivot;
+    };
+
+    // constructor
+    SceneFile();
+
+    // compile a text scene into a binary scene file
+    static bool Compile(const std::string& sourceFilename, const std::string& binaryFilename);
+    // binary file name used for a scene source
+    static std::string GetBinaryFilename(const std::string& sourceFilename);
+
+    // map and validate a binary scene file
+    bool Load(const std::string& binaryFilename);
+    // load the compiled scene, compiling it first when it is missing or older than the source
+    bool LoadOrCompile(const std::string& sourceFilename);
+    void Close();
+
+    // records of the loaded scene
+    int GetTextureCount() const;
+    const SCENE_TEXTURE* GetTextures() const;
+    int GetMaterialCount() const;
+    const SCENE_MATERIAL* GetMaterials() const;
+    int GetLightCount() const;
+    const SCENE_LIGHT* GetLights() const;
+    int GetPivotCount() const;
+    const SCENE_PIVOT* GetPivots() const;
+    int GetObjectCount() const;
+    const SCENE_OBJECT* GetObjects() const;
+
+    // name stored at an offset of the string table
+    const char* GetString(uint32_t offset) const;
+
+private:
+    MappedFile m_file;
+    const unsigned char* m_data;
+    const char* m_strings;
+
+    int m_textureCount;
+    int m_materialCount;
+    int m_lightCount;
+    int m_pivotCount;
+    int m_objectCount;
+    const SCENE_TEXTURE* m_textures;
+    const SCENE_MATERIAL* m_materials;
+    const SCENE_LIGHT* m_lights;
+    const SCENE_PIVOT* m_pivots;
+    const SCENE_OBJECT* m_objects;
+
+    // check that every index and name of the records is in range
+    bool ValidateRecords(uint32_t stringsSize) const;
+};
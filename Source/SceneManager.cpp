@@ -8,7 +8,12 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "SceneManager.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <limits>
 
 #ifndef STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
@@ -21,190 +26,1090 @@ namespace {
     const char* g_ModelName = "model";
     const char* g_ColorValueName = "objectColor";
     const char* g_TextureValueName = "objectTexture";
-    const char* g_UseTextureName = "bUseTexture";
-    const char* g_UseLightingName = "bUseLighting";
+    const char* g_MaterialIndexName = "materialIndex";
+    const char* g_TextureLayerName = "textureLayer";
+    const char* g_UseInstancingName = "bUseInstancing";
+    const char* g_UseIndirectName = "bUseIndirect";
+    const char* g_PositionScaleName = "positionScale";
+    const char* g_PositionOffsetName = "positionOffset";
+
+    // size of the shader's material table and its uniform block binding
+    const int MAX_MATERIALS = 64;
+    const GLuint MATERIAL_BLOCK_BINDING = 0;
+
+    // shortest run of matching draws worth an instanced draw
+    const int MIN_INSTANCE_RUN = 2;
+
+    // scene objects handed to a job as one chunk
+    const int OBJECTS_PER_CHUNK = 32;
+
+    // scene loaded unless SetSceneFilename names another
+    const char* DEFAULT_SCENE_FILENAME = "Scenes/still_life.scene";
+
+    // shared course assets used unchanged, such as the textures a scene
+    // names; files the project owns are found relative to the project
+    const char* UTILITIES_DIRECTORY = "../../Utilities/";
 }
 
-SceneManager::SceneManager(ShaderManager* pShaderManager)
+SceneManager::SceneManager(GLStateCache* pStateCache, ShaderVariants* pShaderVariants)
 {
-    m_pShaderManager = pShaderManager;
-    m_basicMeshes = new ShapeMeshes();
+    m_pStateCache = pStateCache;
+    m_pShaderVariants = pShaderVariants;
+    m_useLighting = false;
+    m_instancedMeshes = new InstancedMeshes();
+    m_materialBuffer = 0;
+    m_defaultMaterial = -1;
+    m_pendingTextures = 0;
+    m_sceneFilename = DEFAULT_SCENE_FILENAME;
+    m_view = glm::mat4(1.0f);
+    m_projection = glm::mat4(1.0f);
+    m_extraLightCount = 0;
+    m_viewportHeight = 1;
+    m_useIndirect = true;
+    m_depthPrepass = false;
+    m_depthOnlyPass = false;
+    m_transformCursor = 0;
+    m_pendingTransform = -1;
+    m_transformUpdateCount = 0;
+    m_cullStats = FrustumCuller::CULL_STATS();
+    m_useOcclusionCulling = true;
+    m_occlusionStats = OcclusionCuller::OCCLUSION_STATS();
+    m_threadedSimulation = false;
+
+    m_pendingDraw.model = glm::mat4(1.0f);
+    m_pendingDraw.color = glm::vec4(1.0f);
+    m_pendingDraw.uvScale = glm::vec2(1.0f, 1.0f);
+    m_pendingDraw.textureLayer = -1;
+    m_pendingDraw.materialIndex = -1;
+    m_pendingDraw.useTexture = true;
+    m_pendingDraw.mesh = RenderQueue::MESH_PLANE;
+    m_pendingDraw.lod = 0;
+    m_pendingDraw.pass = RenderQueue::PASS_OPAQUE;
+    m_pendingDraw.depth = 0.0f;
+
+    m_renderStats = RenderQueue::QUEUE_STATS();
 }
 
 SceneManager::~SceneManager()
 {
-    m_pShaderManager = nullptr;
-    delete m_basicMeshes;
-    m_basicMeshes = nullptr;
+    m_pStateCache = nullptr;
+    delete m_instancedMeshes;
+    m_instancedMeshes = nullptr;
+
+    if (m_materialBuffer)
+    {
+        glDeleteBuffers(1, &m_materialBuffer);
+        m_materialBuffer = 0;
+    }
 }
 
 bool SceneManager::CreateGLTexture(const char* filename, std::string tag)
 {
-    int width = 0, height = 0, colorChannels = 0;
-    GLuint textureID = 0;
-    stbi_set_flip_vertically_on_load(true);
-
-    unsigned char* image = stbi_load(filename, &width, &height, &colorChannels, 0);
-    if (image)
-    {
-        std::cout << "Successfully loaded image: " << filename << std::endl;
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        if (colorChannels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (colorChannels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else {
-            std::cout << "Unsupported image format." << std::endl;
-            stbi_image_free(image);
-            return false;
-        }
+    int layer = -1;
+    if (!m_textureCache.Acquire(filename, layer))
+        return false;
 
-        glGenerateMipmap(GL_TEXTURE_2D);
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0);
+    TEXTURE_INFO info;
+    info.tag = tag;
+    info.layer = layer;
+    m_textureIDs.push_back(info);
+    m_textureLayers[tag] = layer;
+    return true;
+}
 
-        m_textureIDs[m_loadedTextures].ID = textureID;
-        m_textureIDs[m_loadedTextures].tag = tag;
-        m_loadedTextures++;
-        return true;
+/***********************************************************
+ *  BindGLTextures()
+ *
+ *  This method binds the texture array holding every loaded
+ *  texture. The state cache only rebinds when the array has
+ *  grown into a new texture object, so it is cheap to call
+ *  every frame.
+ ***********************************************************/
+void SceneManager::BindGLTextures()
+{
+    m_pStateCache->BindTexture(0, GL_TEXTURE_2D_ARRAY, m_textureCache.GetArrayTexture());
+    m_pStateCache->SetIntValue(g_TextureValueName, 0);
+}
+
+void SceneManager::DestroyGLTextures()
+{
+    for (const TEXTURE_INFO& info : m_textureIDs)
+    {
+        m_textureCache.Release(info.layer);
     }
+    m_textureIDs.clear();
+    m_textureLayers.clear();
+}
 
-    std::cout << "Failed to load image: " << filename << std::endl;
-    return false;
+int SceneManager::FindTextureLayer(const std::string& tag) const
+{
+    auto texture = m_textureLayers.find(tag);
+    if (texture != m_textureLayers.end())
+        return texture->second;
+    return -1;
 }
 
-void SceneManager::BindGLTextures()
+/***********************************************************
+ *  DefineMaterial()
+ *
+ *  This method adds a material to the material table and
+ *  returns the handle that draws select it with.
+ ***********************************************************/
+int SceneManager::DefineMaterial(const OBJECT_MATERIAL& material)
 {
-    for (int i = 0; i < m_loadedTextures; ++i)
+    if ((int)m_objectMaterials.size() >= MAX_MATERIALS)
     {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, m_textureIDs[i].ID);
+        std::cout << "Material table is full, ignoring material: " << material.tag << std::endl;
+        return -1;
     }
+
+    m_objectMaterials.push_back(material);
+    return (int)m_objectMaterials.size() - 1;
 }
 
-void SceneManager::DestroyGLTextures()
+/***********************************************************
+ *  UploadMaterialBuffer()
+ *
+ *  This method packs the material table into the std140
+ *  layout of the shader's MaterialBlock and uploads it once,
+ *  so a draw only has to select its material by index.
+ ***********************************************************/
+void SceneManager::UploadMaterialBuffer()
 {
-    for (int i = 0; i < m_loadedTextures; ++i)
+    std::vector<GPU_MATERIAL> table(MAX_MATERIALS, GPU_MATERIAL());
+    for (size_t i = 0; i < m_objectMaterials.size(); ++i)
     {
-        glDeleteTextures(1, &m_textureIDs[i].ID);
+        const OBJECT_MATERIAL& material = m_objectMaterials[i];
+        table[i].ambientColor = material.ambientColor;
+        table[i].ambientStrength = material.ambientStrength;
+        table[i].diffuseColor = material.diffuseColor;
+        table[i].opacity = material.opacity;
+        table[i].specularColor = material.specularColor;
+        table[i].shininess = material.shininess;
     }
+
+    if (!m_materialBuffer)
+        glGenBuffers(1, &m_materialBuffer);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, m_materialBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, table.size() * sizeof(GPU_MATERIAL), table.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, m_materialBuffer);
 }
 
-int SceneManager::FindTextureID(std::string tag)
+/***********************************************************
+ *  SetTransformations()
+ *
+ *  This method sets the transform used by the next queued
+ *  draw from the scale, rotation and position values. Each
+ *  call of a frame owns one stored transform, matched by call
+ *  order, so the scene must make the same calls every frame.
+ *  Values equal to last frame's leave the cached matrix as
+ *  it is.
+ ***********************************************************/
+void SceneManager::SetTransformations(glm::vec3 scaleXYZ, float Xrot, float Yrot, float Zrot, glm::vec3 positionXYZ)
 {
-    for (int i = 0; i < m_loadedTextures; ++i)
-        if (m_textureIDs[i].tag == tag)
-            return m_textureIDs[i].ID;
-    return -1;
+    if (m_transformCursor == (int)m_sceneTransforms.size())
+    {
+        int parent = m_transformParents.empty() ? -1 : m_transformParents.back();
+        m_sceneTransforms.push_back(m_transforms.Create(parent));
+    }
+
+    m_pendingTransform = m_sceneTransforms[m_transformCursor++];
+    m_transforms.SetLocal(m_pendingTransform, scaleXYZ, glm::vec3(Xrot, Yrot, Zrot), positionXYZ);
 }
 
-int SceneManager::FindTextureSlot(std::string tag)
+/***********************************************************
+ *  PushTransformParent()
+ *
+ *  This method makes the transforms created by the following
+ *  SetTransformations calls children of the passed one.
+ ***********************************************************/
+void SceneManager::PushTransformParent(int transform)
 {
-    for (int i = 0; i < m_loadedTextures; ++i)
-        if (m_textureIDs[i].tag == tag)
-            return i;
-    return -1;
+    m_transformParents.push_back(transform);
 }
 
-bool SceneManager::FindMaterial(std::string tag, OBJECT_MATERIAL& material)
+/***********************************************************
+ *  PopTransformParent()
+ ***********************************************************/
+void SceneManager::PopTransformParent()
+{
+    if (!m_transformParents.empty())
+        m_transformParents.pop_back();
+}
+
+/***********************************************************
+ *  QueueMeshDraw()
+ *
+ *  This method collects a draw of the passed mesh with the
+ *  pending draw state, which QueueSceneObject fills in whole
+ *  for every object, and the transform set for it. A draw
+ *  whose color or material is not fully opaque is blended
+ *  in the transparent pass.
+ ***********************************************************/
+void SceneManager::QueueMeshDraw(RenderQueue::MESH_ID mesh)
+{
+    m_pendingDraw.pass = ClassifyPass(m_pendingDraw);
+    m_pendingDraw.mesh = mesh;
+    m_frameDraws.push_back(m_pendingDraw);
+    m_frameTransforms.push_back(m_pendingTransform);
+}
+
+/***********************************************************
+ *  ClassifyPass()
+ ***********************************************************/
+RenderQueue::RENDER_PASS SceneManager::ClassifyPass(const RenderQueue::DRAW_ITEM& draw) const
+{
+    bool seeThrough = (!draw.useTexture && draw.color.w < 1.0f) ||
+        (draw.materialIndex >= 0 && m_objectMaterials[draw.materialIndex].opacity < 1.0f);
+    return seeThrough ? RenderQueue::PASS_TRANSPARENT : RenderQueue::PASS_OPAQUE;
+}
+
+/***********************************************************
+ *  CullFrameDraws()
+ *
+ *  This method brings the world matrices up to date, places
+ *  each collected draw with its transform, and queues the
+ *  draws whose bounds are inside the view frustum and not
+ *  hidden in the order they were made, at the level of
+ *  detail their size on screen needs.
+ ***********************************************************/
+void SceneManager::CullFrameDraws()
+{
+    m_transformUpdateCount = m_transforms.UpdateWorldMatrices();
+
+    m_frustumCuller.Clear();
+    for (size_t i = 0; i < m_frameDraws.size(); ++i)
+    {
+        RenderQueue::DRAW_ITEM& draw = m_frameDraws[i];
+        int transform = m_frameTransforms[i];
+        draw.model = (transform >= 0) ? m_transforms.GetWorldMatrix(transform) : glm::mat4(1.0f);
+        m_frustumCuller.AddObject(FrustumCuller::TransformBounds(
+            m_instancedMeshes->GetLocalBounds(draw.mesh), draw.model));
+    }
+
+    m_frustumCuller.Cull(m_visibleDraws);
+    m_cullStats = m_frustumCuller.GetStats();
+
+    m_lodSelector.BeginFrame();
+    m_visibleItems.clear();
+    for (int index : m_visibleDraws)
+    {
+        RenderQueue::DRAW_ITEM& draw = m_frameDraws[index];
+        FrustumCuller::BOUNDS worldBounds = FrustumCuller::TransformBounds(
+            m_instancedMeshes->GetLocalBounds(draw.mesh), draw.model);
+        draw.lod = m_lodSelector.SelectLevel(index, draw.model, worldBounds,
+            m_instancedMeshes->GetLodErrors(draw.mesh), m_instancedMeshes->GetLodCount(draw.mesh));
+        draw.depth = -(m_view * glm::vec4(worldBounds.center, 1.0f)).z;
+        m_visibleItems.push_back(&draw);
+    }
+    QueueVisibleDraws();
+}
+
+/***********************************************************
+ *  BuildDrawPackets()
+ *
+ *  This method does the work of QueueSceneObject and
+ *  CullFrameDraws on the job system. The scene objects are
+ *  cut into chunks; a first loop sets each object's transform
+ *  and draw state, and after the changed local matrices are
+ *  composed in one batch, a second loop places each object
+ *  and hands its world bounds to the frustum culler. The
+ *  culler builds its hierarchy and tests the top of it here,
+ *  and the subtrees below are walked as jobs that mark the
+ *  objects they keep. A last loop over the object chunks
+ *  picks the level of detail of each kept object and lists
+ *  it in its chunk's packet, so merging the packets in chunk
+ *  order queues the draws in the order the serial path does.
+ ***********************************************************/
+void SceneManager::BuildDrawPackets()
 {
-    for (const auto& mat : m_objectMaterials)
+    const SceneFile::SCENE_OBJECT* objects = m_sceneFile.GetObjects();
+    int objectCount = m_sceneFile.GetObjectCount();
+
+    // transforms are created in object order, as SetTransformations would
+    while ((int)m_sceneTransforms.size() < objectCount)
     {
-        if (mat.tag == tag)
+        const SceneFile::SCENE_OBJECT& object = objects[m_sceneTransforms.size()];
+        int parent = (object.pivot >= 0) ? m_pivotTransforms[object.pivot] : -1;
+        m_sceneTransforms.push_back(m_transforms.Create(parent));
+    }
+    m_frameDraws.resize(objectCount);
+    m_frameVisible.resize(objectCount);
+    m_frustumCuller.SetObjectCount(objectCount);
+    int chunkCount = JobSystem::GetChunkCount(objectCount, OBJECTS_PER_CHUNK);
+    if ((int)m_drawPackets.size() < chunkCount)
+        m_drawPackets.resize(chunkCount);
+
+    m_jobSystem.ParallelFor(objectCount, OBJECTS_PER_CHUNK, [this, objects](int, int first, int end) {
+        for (int i = first; i < end; ++i)
+        {
+            const SceneFile::SCENE_OBJECT& object = objects[i];
+            m_transforms.SetLocal(m_sceneTransforms[i],
+                glm::vec3(object.scale[0], object.scale[1], object.scale[2]),
+                glm::vec3(object.rotationDegrees[0], object.rotationDegrees[1], object.rotationDegrees[2]),
+                glm::vec3(object.position[0], object.position[1], object.position[2]));
+            FillSceneDraw(object, m_frameDraws[i]);
+        }
+    });
+
+    // scene objects only hang from pivots, so the pivots are updated first
+    m_transforms.ComposeDirtyLocals();
+    m_transformUpdateCount = 0;
+    for (int pivot : m_pivotTransforms)
+        m_transformUpdateCount += m_transforms.UpdateWorldRange(pivot, pivot + 1);
+
+    m_jobSystem.ParallelFor(objectCount, OBJECTS_PER_CHUNK, [this](int chunk, int first, int end) {
+        DRAW_PACKET& packet = m_drawPackets[chunk];
+        packet.transformsUpdated = 0;
+        for (int i = first; i < end; ++i)
+            PlaceSceneDraw(i, packet);
+    });
+    for (int chunk = 0; chunk < chunkCount; ++chunk)
+        m_transformUpdateCount += m_drawPackets[chunk].transformsUpdated;
+
+    int taskCount = m_frustumCuller.BeginCull();
+    if ((int)m_drawPackets.size() < taskCount)
+        m_drawPackets.resize(taskCount);
+
+    m_jobSystem.ParallelFor(taskCount, 1, [this](int chunk, int first, int end) {
+        DRAW_PACKET& packet = m_drawPackets[chunk];
+        packet.nodesTested = 0;
+        packet.visible.clear();
+        for (int task = first; task < end; ++task)
+            m_frustumCuller.CullTask(task, packet.visible, packet.nodesTested);
+        for (int object : packet.visible)
+            m_frameVisible[object] = 1;
+    });
+    int nodesTested = 0;
+    for (int chunk = 0; chunk < taskCount; ++chunk)
+        nodesTested += m_drawPackets[chunk].nodesTested;
+
+    m_lodSelector.BeginFrame();
+    m_lodSelector.ReserveObjects(objectCount);
+
+    m_jobSystem.ParallelFor(objectCount, OBJECTS_PER_CHUNK, [this](int chunk, int first, int end) {
+        DRAW_PACKET& packet = m_drawPackets[chunk];
+        packet.lodStats = LodSelector::LOD_STATS();
+        packet.visible.clear();
+        for (int i = first; i < end; ++i)
         {
-            material = mat;
-            return true;
+            if (!m_frameVisible[i])
+                continue;
+            SelectSceneDrawLevel(i, packet);
+            packet.visible.push_back(i);
         }
+    });
+
+    m_visibleItems.clear();
+    for (int chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        const DRAW_PACKET& packet = m_drawPackets[chunk];
+        for (int index : packet.visible)
+            m_visibleItems.push_back(&m_frameDraws[index]);
+        m_lodSelector.AddStats(packet.lodStats);
     }
-    return false;
+    m_frustumCuller.EndCull((int)m_visibleItems.size(), nodesTested);
+    m_cullStats = m_frustumCuller.GetStats();
+    QueueVisibleDraws();
 }
 
-void SceneManager::SetTransformations(glm::vec3 scaleXYZ, float Xrot, float Yrot, float Zrot, glm::vec3 positionXYZ)
+/***********************************************************
+ *  FillSceneDraw()
+ *
+ *  This method sets the draw state of one scene object from
+ *  its description alone. Both the serial and the parallel
+ *  paths use it, so neither depends on the object before.
+ ***********************************************************/
+void SceneManager::FillSceneDraw(const SceneFile::SCENE_OBJECT& object, RenderQueue::DRAW_ITEM& draw) const
+{
+    draw.useTexture = object.texture >= 0;
+    draw.textureLayer = draw.useTexture ? m_sceneTextureLayers[object.texture] : -1;
+    draw.color = glm::vec4(object.color[0], object.color[1], object.color[2], object.color[3]);
+    draw.materialIndex = (object.material >= 0) ? m_sceneMaterials[object.material] : m_defaultMaterial;
+    draw.uvScale = glm::vec2(object.uvScale[0], object.uvScale[1]);
+    draw.mesh = (RenderQueue::MESH_ID)object.mesh;
+    draw.lod = 0;
+    draw.depth = 0.0f;
+    draw.pass = ClassifyPass(draw);
+}
+
+/***********************************************************
+ *  PlaceSceneDraw()
+ *
+ *  This method brings one object's world matrix up to date
+ *  and hands the frustum culler its world bounds. The object
+ *  starts the frame outside the frustum until a cull job
+ *  marks it.
+ ***********************************************************/
+void SceneManager::PlaceSceneDraw(int object, DRAW_PACKET& packet)
+{
+    RenderQueue::DRAW_ITEM& draw = m_frameDraws[object];
+    int transform = m_sceneTransforms[object];
+    packet.transformsUpdated += m_transforms.UpdateWorldRange(transform, transform + 1);
+    draw.model = m_transforms.GetWorldMatrix(transform);
+
+    m_frustumCuller.SetObject(object, FrustumCuller::TransformBounds(
+        m_instancedMeshes->GetLocalBounds(draw.mesh), draw.model));
+    m_frameVisible[object] = 0;
+}
+
+/***********************************************************
+ *  SelectSceneDrawLevel()
+ *
+ *  This method picks the level of detail and view depth of
+ *  one object inside the frustum.
+ ***********************************************************/
+void SceneManager::SelectSceneDrawLevel(int object, DRAW_PACKET& packet)
+{
+    RenderQueue::DRAW_ITEM& draw = m_frameDraws[object];
+    const FrustumCuller::BOUNDS& worldBounds = m_frustumCuller.GetObject(object);
+
+    draw.lod = m_lodSelector.SelectLevel(object, draw.model, worldBounds,
+        m_instancedMeshes->GetLodErrors(draw.mesh), m_instancedMeshes->GetLodCount(draw.mesh), packet.lodStats);
+    draw.depth = -(m_view * glm::vec4(worldBounds.center, 1.0f)).z;
+}
+
+/***********************************************************
+ *  QueueVisibleDraws()
+ *
+ *  This method queues the draws inside the frustum, less
+ *  those the occlusion culler finds hidden. The solid boxes
+ *  of the opaque draws are offered as occluders, and every
+ *  draw, occluders included, is tested against them.
+ ***********************************************************/
+void SceneManager::QueueVisibleDraws()
 {
-    glm::mat4 scale = glm::scale(scaleXYZ);
-    glm::mat4 rotationX = glm::rotate(glm::radians(Xrot), glm::vec3(1, 0, 0));
-    glm::mat4 rotationY = glm::rotate(glm::radians(Yrot), glm::vec3(0, 1, 0));
-    glm::mat4 rotationZ = glm::rotate(glm::radians(Zrot), glm::vec3(0, 0, 1));
-    glm::mat4 translation = glm::translate(positionXYZ);
-    glm::mat4 modelView = translation * rotationX * rotationY * rotationZ * scale;
+    m_renderQueue.Clear();
+    m_occlusionStats = OcclusionCuller::OCCLUSION_STATS();
+    if (!m_useOcclusionCulling)
+    {
+        for (const RenderQueue::DRAW_ITEM* draw : m_visibleItems)
+            m_renderQueue.Submit(*draw);
+        return;
+    }
+
+    PROFILE_SCOPE("OcclusionCulling");
+    m_occlusionCuller.BeginFrame(m_view, m_projection);
+    for (const RenderQueue::DRAW_ITEM* draw : m_visibleItems)
+    {
+        FrustumCuller::BOUNDS box;
+        if (draw->pass == RenderQueue::PASS_OPAQUE && GetOccluderBox(draw->mesh, box))
+            m_occlusionCuller.AddOccluder(draw->model, box);
+    }
+    m_occlusionCuller.BuildPyramid();
 
-    if (m_pShaderManager)
-        m_pShaderManager->setMat4Value(g_ModelName, modelView);
+    for (const RenderQueue::DRAW_ITEM* draw : m_visibleItems)
+    {
+        FrustumCuller::BOUNDS worldBounds = FrustumCuller::TransformBounds(
+            m_instancedMeshes->GetLocalBounds(draw->mesh), draw->model);
+        if (!m_occlusionCuller.IsOccluded(worldBounds))
+            m_renderQueue.Submit(*draw);
+    }
+    m_occlusionStats = m_occlusionCuller.GetStats();
 }
 
-void SceneManager::SetShaderColor(float r, float g, float b, float a)
+/***********************************************************
+ *  GetOccluderBox()
+ *
+ *  This method returns a local box lying within the solid
+ *  of a mesh. Boxes and planes fill their bounds; a closed
+ *  cylinder holds the square inscribed in the polygon of
+ *  its coarsest level, whose sides sit inside the circle by
+ *  that level's error.
+ ***********************************************************/
+bool SceneManager::GetOccluderBox(RenderQueue::MESH_ID mesh, FrustumCuller::BOUNDS& box) const
 {
-    glm::vec4 color(r, g, b, a);
-    if (m_pShaderManager)
+    box = m_instancedMeshes->GetLocalBounds(mesh);
+    switch (mesh)
+    {
+    case RenderQueue::MESH_BOX:
+    case RenderQueue::MESH_PLANE:
+        return true;
+    case RenderQueue::MESH_CYLINDER:
     {
-        m_pShaderManager->setIntValue(g_UseTextureName, false);
-        m_pShaderManager->setVec4Value(g_ColorValueName, color);
+        const float* errors = m_instancedMeshes->GetLodErrors(mesh);
+        float error = 0.0f;
+        for (int lod = 0; lod < m_instancedMeshes->GetLodCount(mesh); ++lod)
+            error = std::max(error, errors[lod]);
+        box.extents.x = std::max(box.extents.x - error, 0.0f) / std::sqrt(2.0f);
+        box.extents.z = std::max(box.extents.z - error, 0.0f) / std::sqrt(2.0f);
+        return true;
+    }
+    default:
+        return false;
     }
 }
 
-void SceneManager::SetShaderTexture(std::string textureTag)
+/***********************************************************
+ *  SubmitRenderQueue()
+ *
+ *  This method sorts the queued draws and issues them in
+ *  passes. With the depth prepass the opaque draws first
+ *  write only depth, so the opaque pass shades each pixel
+ *  once. Opaque draws are drawn without blending, then the
+ *  transparent ones are blended over them back to front
+ *  without writing depth. The fragments of each pass are
+ *  counted with occlusion queries.
+ ***********************************************************/
+void SceneManager::SubmitRenderQueue()
 {
-    if (m_pShaderManager)
+    PROFILE_GPU_SCOPE("SubmitRenderQueue");
+    {
+        PROFILE_SCOPE("SortRenderQueue");
+        m_renderQueue.Sort();
+    }
+
+    int count = m_renderQueue.GetCount();
+    int transparentStart = 0;
+    while (transparentStart < count && m_renderQueue.GetSorted(transparentStart).pass == RenderQueue::PASS_OPAQUE)
+        ++transparentStart;
+
+    RenderQueue::QUEUE_STATS stats = RenderQueue::QUEUE_STATS();
+    m_passCounters.BeginFrame();
+    // every mesh shares one vertex array, bound once for all the passes
+    m_instancedMeshes->BindMeshes();
+
+    if (m_depthPrepass && transparentStart > 0)
+    {
+        m_pStateCache->SetColorMask(false);
+        m_depthOnlyPass = true;
+        {
+            PROFILE_GPU_SCOPE("DepthPrepass");
+            m_passCounters.BeginPass(PassCounters::PASS_DEPTH);
+            SubmitDraws(0, transparentStart, stats);
+            m_passCounters.EndPass();
+        }
+        m_depthOnlyPass = false;
+        m_pStateCache->SetColorMask(true);
+
+        // the same geometry passes only where it is the nearest surface
+        m_pStateCache->SetDepthFunc(GL_LEQUAL);
+        m_pStateCache->SetDepthMask(false);
+    }
+
+    {
+        PROFILE_GPU_SCOPE("OpaquePass");
+        m_passCounters.BeginPass(PassCounters::PASS_OPAQUE);
+        SubmitDraws(0, transparentStart, stats);
+        m_passCounters.EndPass();
+    }
+    m_pStateCache->SetDepthFunc(GL_LESS);
+
+    if (transparentStart < count)
     {
-        m_pShaderManager->setIntValue(g_UseTextureName, true);
-        int slot = FindTextureSlot(textureTag);
-        m_pShaderManager->setSampler2DValue(g_TextureValueName, slot);
+        m_pStateCache->SetCapability(GL_BLEND, true);
+        m_pStateCache->SetDepthMask(false);
+        {
+            PROFILE_GPU_SCOPE("TransparentPass");
+            m_passCounters.BeginPass(PassCounters::PASS_TRANSPARENT);
+            SubmitDraws(transparentStart, count, stats);
+            m_passCounters.EndPass();
+        }
+        m_pStateCache->SetCapability(GL_BLEND, false);
     }
+    m_pStateCache->SetDepthMask(true);
+    m_instancedMeshes->UnbindMeshes();
+
+    stats.draws = count;
+    m_renderStats = stats;
+}
+
+/***********************************************************
+ *  SubmitDraws()
+ ***********************************************************/
+void SceneManager::SubmitDraws(int first, int end, RenderQueue::QUEUE_STATS& stats)
+{
+    if (first >= end)
+        return;
+
+    if (m_useIndirect && m_instancedMeshes->SupportsIndirect())
+        SubmitIndirect(first, end, stats);
+    else
+        SubmitDirect(first, end, stats);
 }
 
-void SceneManager::SetTextureUVScale(float u, float v)
+/***********************************************************
+ *  SubmitDirect()
+ *
+ *  This method issues a range of the sorted draws, only
+ *  setting the shader state that differs from the previous
+ *  draw. Runs of draws that differ only in transform, UV
+ *  scale, texture layer and material are merged into one
+ *  instanced draw.
+ *  The state that immediate drawing would have set for
+ *  every draw is counted alongside for comparison.
+ ***********************************************************/
+void SceneManager::SubmitDirect(int first, int end, RenderQueue::QUEUE_STATS& stats)
 {
-    if (m_pShaderManager)
-        m_pShaderManager->setVec2Value("UVscale", glm::vec2(u, v));
+    // values that never match, so the first draw sets every state
+    const float unknown = std::numeric_limits<float>::quiet_NaN();
+    glm::vec4 appliedColor(unknown);
+    glm::vec2 appliedUVScale(unknown, unknown);
+    int appliedUseTexture = -1;
+    int appliedUseInstancing = -1;
+    int appliedTextureLayer = -1;
+    int appliedMaterial = -1;
+    int appliedMesh = -1;
+    bool packedVertices = m_instancedMeshes->GetVertexFormat() == InstancedMeshes::VERTEX_PACKED;
+
+    int i = first;
+    while (i < end)
+    {
+        const RenderQueue::DRAW_ITEM& item = m_renderQueue.GetSorted(i);
+        PROFILE_DRAW_SCOPE(RenderQueue::GetMeshName(item.mesh));
+        int runEnd = FindInstanceRun(i);
+        int runLength = runEnd - i;
+        bool instanced = runLength >= MIN_INSTANCE_RUN;
+
+        if ((int)instanced != appliedUseInstancing)
+        {
+            m_pStateCache->SetBoolValue(g_UseInstancingName, instanced);
+            appliedUseInstancing = instanced;
+            ++stats.stateChanges;
+        }
+
+        if ((int)item.useTexture != appliedUseTexture)
+        {
+            UseShaderVariant(item.useTexture);
+            appliedUseTexture = item.useTexture;
+            ++stats.stateChanges;
+        }
+
+        if (!item.useTexture && item.color != appliedColor)
+        {
+            m_pStateCache->SetVec4Value(g_ColorValueName, item.color);
+            appliedColor = item.color;
+            ++stats.stateChanges;
+        }
+
+        if (item.mesh != appliedMesh)
+        {
+            if (packedVertices)
+            {
+                m_pStateCache->SetVec3Value(g_PositionScaleName, m_instancedMeshes->GetPositionScale(item.mesh));
+                m_pStateCache->SetVec3Value(g_PositionOffsetName, m_instancedMeshes->GetPositionOffset(item.mesh));
+            }
+            appliedMesh = item.mesh;
+            ++stats.stateChanges;
+        }
+
+        if (instanced)
+        {
+            // transform, UV scale, material and layer come from the instance buffer
+            m_instanceData.resize(runLength);
+            for (int j = 0; j < runLength; ++j)
+            {
+                const RenderQueue::DRAW_ITEM& instance = m_renderQueue.GetSorted(i + j);
+                m_instanceData[j].model = instance.model;
+                m_instanceData[j].uvScale = instance.uvScale;
+                m_instanceData[j].materialIndex = instance.materialIndex;
+                m_instanceData[j].textureLayer = instance.textureLayer;
+            }
+            m_instancedMeshes->DrawInstances(item.mesh, item.lod, m_instanceData.data(), runLength);
+        }
+        else
+        {
+            m_pStateCache->SetMat4Value(g_ModelName, item.model);
+
+            if (item.useTexture && item.textureLayer != appliedTextureLayer)
+            {
+                m_pStateCache->SetIntValue(g_TextureLayerName, item.textureLayer);
+                appliedTextureLayer = item.textureLayer;
+                ++stats.stateChanges;
+            }
+
+            if (item.materialIndex != appliedMaterial)
+            {
+                m_pStateCache->SetIntValue(g_MaterialIndexName, item.materialIndex);
+                appliedMaterial = item.materialIndex;
+                ++stats.stateChanges;
+            }
+
+            if (item.uvScale != appliedUVScale)
+            {
+                m_pStateCache->SetVec2Value("UVscale", item.uvScale);
+                appliedUVScale = item.uvScale;
+                ++stats.stateChanges;
+            }
+
+            m_instancedMeshes->DrawMesh(item.mesh, item.lod);
+        }
+
+        stats.triangles += runLength * m_instancedMeshes->GetIndexCount(item.mesh, item.lod) / 3;
+
+        // shader path, texture or color, material, UV scale and mesh
+        for (int j = i; j < runEnd; ++j)
+            stats.naiveStateChanges += 5;
+
+        ++stats.drawCalls;
+        i = runEnd;
+    }
 }
 
-void SceneManager::SetShaderMaterial(std::string tag)
+/***********************************************************
+ *  SubmitIndirect()
+ *
+ *  This method issues a range of the sorted draws as one
+ *  multi-draw indirect call per stretch of draws that use
+ *  the same shader variant. The sort key places the variant
+ *  right below the pass and depth bucket, so the stretches
+ *  are long and the calls few.
+ ***********************************************************/
+void SceneManager::SubmitIndirect(int first, int end, RenderQueue::QUEUE_STATS& stats)
 {
-    OBJECT_MATERIAL mat;
-    if (FindMaterial(tag, mat))
+    int batchFirst = first;
+    while (batchFirst < end)
     {
-        m_pShaderManager->setVec3Value("material.ambientColor", mat.ambientColor);
-        m_pShaderManager->setFloatValue("material.ambientStrength", mat.ambientStrength);
-        m_pShaderManager->setVec3Value("material.diffuseColor", mat.diffuseColor);
-        m_pShaderManager->setVec3Value("material.specularColor", mat.specularColor);
-        m_pShaderManager->setFloatValue("material.shininess", mat.shininess);
+        bool textured = m_renderQueue.GetSorted(batchFirst).useTexture;
+        int batchEnd = batchFirst + 1;
+        while (batchEnd < end && (m_depthOnlyPass || m_renderQueue.GetSorted(batchEnd).useTexture == textured))
+            ++batchEnd;
+
+        UseShaderVariant(textured);
+        ++stats.stateChanges;
+        SubmitIndirectBatch(batchFirst, batchEnd, stats);
+        batchFirst = batchEnd;
     }
 }
+
+/***********************************************************
+ *  SubmitIndirectBatch()
+ *
+ *  This method issues a range of the sorted draws as one
+ *  multi-draw indirect call. Every run that SubmitDirect
+ *  would draw becomes one command over a slice of a single
+ *  instance buffer, and its color becomes the per-draw data
+ *  read by gl_DrawID, so no uniform changes between draws.
+ ***********************************************************/
+void SceneManager::SubmitIndirectBatch(int first, int end, RenderQueue::QUEUE_STATS& stats)
+{
+    int drawCount = end - first;
+    m_instanceData.resize(drawCount);
+    m_drawCommands.clear();
+    m_drawData.clear();
+
+    int i = first;
+    while (i < end)
+    {
+        const RenderQueue::DRAW_ITEM& item = m_renderQueue.GetSorted(i);
+        int runEnd = FindInstanceRun(i);
+        int runLength = runEnd - i;
+
+        for (int j = i; j < runEnd; ++j)
+        {
+            const RenderQueue::DRAW_ITEM& instance = m_renderQueue.GetSorted(j);
+
+            InstancedMeshes::INSTANCE_DATA& instanceData = m_instanceData[j - first];
+            instanceData.model = instance.model;
+            instanceData.uvScale = instance.uvScale;
+            instanceData.materialIndex = instance.materialIndex;
+            instanceData.textureLayer = instance.textureLayer;
+            stats.naiveStateChanges += 5;
+        }
+
+        InstancedMeshes::DRAW_DATA drawData = InstancedMeshes::DRAW_DATA();
+        drawData.color = item.color;
+        drawData.positionScale = glm::vec4(m_instancedMeshes->GetPositionScale(item.mesh), 0.0f);
+        drawData.positionOffset = glm::vec4(m_instancedMeshes->GetPositionOffset(item.mesh), 0.0f);
+        m_drawData.push_back(drawData);
+        m_drawCommands.push_back(m_instancedMeshes->MakeCommand(item.mesh, item.lod, runLength, i - first));
+        stats.triangles += runLength * m_instancedMeshes->GetIndexCount(item.mesh, item.lod) / 3;
+        i = runEnd;
+    }
+
+    // transform, UV scale, material and layer come from the instance buffer
+    m_pStateCache->SetBoolValue(g_UseInstancingName, true);
+    m_pStateCache->SetBoolValue(g_UseIndirectName, true);
+    {
+        PROFILE_DRAW_SCOPE("MultiDrawIndirect");
+        m_instancedMeshes->DrawIndirect(m_drawCommands.data(), m_drawData.data(), (int)m_drawCommands.size(),
+            m_instanceData.data(), drawCount);
+    }
+    m_pStateCache->SetBoolValue(g_UseIndirectName, false);
+
+    stats.stateChanges += 2;
+    ++stats.drawCalls;
+    stats.indirectCommands += (int)m_drawCommands.size();
+}
+
+/***********************************************************
+ *  UseShaderVariant()
+ *
+ *  This method makes the program built for a draw's
+ *  features current. The depth prepass writes no color, so
+ *  every draw of it uses the plainest variant.
+ ***********************************************************/
+void SceneManager::UseShaderVariant(bool textured)
+{
+    if (m_depthOnlyPass)
+        m_pStateCache->UseProgram(m_pShaderVariants->GetProgram(false, false));
+    else
+        m_pStateCache->UseProgram(m_pShaderVariants->GetProgram(textured, m_useLighting));
+}
+
+/***********************************************************
+ *  SetVertexFormat()
+ ***********************************************************/
+void SceneManager::SetVertexFormat(InstancedMeshes::VERTEX_FORMAT format)
+{
+    m_instancedMeshes->SetVertexFormat(format);
+}
+
+/***********************************************************
+ *  SetDepthPrepass()
+ *
+ *  This method turns the depth prepass on or off. With it,
+ *  visibility is settled before shading, so opaque draws
+ *  sort purely by state rather than front to back.
+ ***********************************************************/
+void SceneManager::SetDepthPrepass(bool enable)
+{
+    m_depthPrepass = enable;
+    m_renderQueue.SetOpaqueDepthOrder(!enable);
+}
+
+/***********************************************************
+ *  GetPassStats()
+ ***********************************************************/
+PassCounters::PASS_STATS SceneManager::GetPassStats() const
+{
+    return m_passCounters.GetStats();
+}
+
+/***********************************************************
+ *  SetIndirectDrawing()
+ ***********************************************************/
+void SceneManager::SetIndirectDrawing(bool enable)
+{
+    m_useIndirect = enable;
+}
+
+/***********************************************************
+ *  FindInstanceRun()
+ *
+ *  This method returns the end of the run of sorted draws
+ *  starting at the passed position that share pass, shader
+ *  path, color, mesh and level, and so can be drawn as instances
+ *  of one draw. Textured draws may differ in layer.
+ ***********************************************************/
+int SceneManager::FindInstanceRun(int first) const
+{
+    const RenderQueue::DRAW_ITEM& item = m_renderQueue.GetSorted(first);
+    int count = m_renderQueue.GetCount();
+
+    int end = first + 1;
+    while (end < count)
+    {
+        const RenderQueue::DRAW_ITEM& next = m_renderQueue.GetSorted(end);
+        if (next.pass != item.pass || next.useTexture != item.useTexture ||
+            next.mesh != item.mesh || next.lod != item.lod)
+            break;
+        if (!item.useTexture && next.color != item.color)
+            break;
+        ++end;
+    }
+    return end;
+}
+
+/***********************************************************
+ *  SetViewProjection()
+ ***********************************************************/
+void SceneManager::SetViewProjection(const glm::mat4& view, const glm::mat4& projection)
+{
+    m_view = view;
+    m_projection = projection;
+    m_frustumCuller.SetFrustum(projection * view);
+    m_lodSelector.SetView(view, projection, m_viewportHeight);
+}
+
+/***********************************************************
+ *  SetViewportSize()
+ ***********************************************************/
+void SceneManager::SetViewportSize(int width, int height)
+{
+    m_lightClusters.SetViewportSize(width, height);
+    m_passCounters.SetViewportSize(width, height);
+    m_viewportHeight = height;
+}
+
+/***********************************************************
+ *  SetMaxScreenError()
+ ***********************************************************/
+void SceneManager::SetMaxScreenError(float pixels)
+{
+    m_lodSelector.SetMaxScreenError(pixels);
+}
+
+/***********************************************************
+ *  GetLodStats()
+ ***********************************************************/
+LodSelector::LOD_STATS SceneManager::GetLodStats() const
+{
+    return m_lodSelector.GetStats();
+}
+
+/***********************************************************
+ *  GetRenderStats()
+ ***********************************************************/
+RenderQueue::QUEUE_STATS SceneManager::GetRenderStats() const
+{
+    return m_renderStats;
+}
+
+/***********************************************************
+ *  GetTextureCacheStats()
+ ***********************************************************/
+TextureCache::CACHE_STATS SceneManager::GetTextureCacheStats() const
+{
+    return m_textureCache.GetStats();
+}
+
+/***********************************************************
+ *  GetCullStats()
+ ***********************************************************/
+FrustumCuller::CULL_STATS SceneManager::GetCullStats() const
+{
+    return m_cullStats;
+}
+
+/***********************************************************
+ *  SetOcclusionCulling()
+ ***********************************************************/
+void SceneManager::SetOcclusionCulling(bool enable)
+{
+    m_useOcclusionCulling = enable;
+}
+
+/***********************************************************
+ *  GetOcclusionStats()
+ ***********************************************************/
+OcclusionCuller::OCCLUSION_STATS SceneManager::GetOcclusionStats() const
+{
+    return m_occlusionStats;
+}
+
+/***********************************************************
+ *  GetTransformUpdateCount()
+ ***********************************************************/
+int SceneManager::GetTransformUpdateCount() const
+{
+    return m_transformUpdateCount;
+}
+
+/***********************************************************
+ *  SetThreadedSimulation()
+ ***********************************************************/
+void SceneManager::SetThreadedSimulation(bool enable)
+{
+    m_threadedSimulation = enable;
+}
+
+/***********************************************************
+ *  SetAnimationPaused()
+ ***********************************************************/
+void SceneManager::SetAnimationPaused(bool paused)
+{
+    m_simulation.SetPaused(paused);
+}
+
+/***********************************************************
+ *  SetWorkerThreadCount()
+ ***********************************************************/
+void SceneManager::SetWorkerThreadCount(int count)
+{
+    m_jobSystem.Start(count);
+}
+
+/***********************************************************
+ *  GetJobStats()
+ ***********************************************************/
+JobSystem::JOB_STATS SceneManager::GetJobStats() const
+{
+    return m_jobSystem.GetStats();
+}
+
+/***********************************************************
+ *  SetTextureFormat()
+ ***********************************************************/
+void SceneManager::SetTextureFormat(TextureCooker::TEXTURE_FORMAT format)
+{
+    m_textureCache.SetTextureFormat(format);
+}
+
+/***********************************************************
+ *  SetSceneFilename()
+ ***********************************************************/
+void SceneManager::SetSceneFilename(const std::string& filename)
+{
+    m_sceneFilename = filename;
+}
+
+/***********************************************************
+ *  SetExtraLightCount()
+ ***********************************************************/
+void SceneManager::SetExtraLightCount(int count)
+{
+    m_extraLightCount = count;
+}
+
+/***********************************************************
+ *  GetLightStats()
+ ***********************************************************/
+LightClusters::CLUSTER_STATS SceneManager::GetLightStats() const
+{
+    return m_lightClusters.GetStats();
+}
+
 /***********************************************************
  *  PrepareScene()
  *
  *  This method is used for preparing the 3D scene by loading
- *  the shapes and textures into memory to support 3D rendering.
+ *  the scene description, shapes and textures into memory to
+ *  support 3D rendering.
  ***********************************************************/
 void SceneManager::PrepareScene()
 {
+    // Map the compiled scene, compiling its source when needed
+    std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+    if (m_sceneFile.LoadOrCompile(m_sceneFilename))
+    {
+        std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - loadStart;
+        std::cout << "INFO: scene " << m_sceneFilename << "  " << m_sceneFile.GetObjectCount() << " objects  loaded in "
+            << loadTime.count() << " ms" << std::endl;
+    }
+
     // Define materials and lighting setup
     DefineObjectMaterials();
     SetupSceneLights();
 
-    // Load all basic mesh shapes used in the scene
-    m_basicMeshes->LoadPlaneMesh();
-    m_basicMeshes->LoadCylinderMesh();
-    m_basicMeshes->LoadTorusMesh();
-    m_basicMeshes->LoadSphereMesh();
-    m_basicMeshes->LoadBoxMesh();
-    m_basicMeshes->LoadConeMesh();
-    m_basicMeshes->LoadTaperedCylinderMesh();
+    // Load all basic mesh shapes used in the scene into the shared buffers
+    m_instancedMeshes->LoadMeshes();
+    m_passCounters.Initialize();
+
+    // pivots are created ahead of the objects so they update before them
+    const SceneFile::SCENE_PIVOT* pivots = m_sceneFile.GetPivots();
+    std::vector<float> degreesPerTick;
+    for (int i = 0; i < m_sceneFile.GetPivotCount(); ++i)
+    {
+        m_pivotTransforms.push_back(m_transforms.Create(-1));
+        m_pivotAngles.push_back(0.0f);
+        degreesPerTick.push_back(pivots[i].degreesPerTick);
+    }
+    m_simulation.Initialize(degreesPerTick);
+    if (m_threadedSimulation)
+        m_simulation.Start();
 
     // Load texture assets and assign tags
-    CreateGLTexture("../../Utilities/textures/rusticwood.jpg", "bowl");
-    CreateGLTexture("../../Utilities/textures/rusticwood.jpg", "bowl_inner");
-    CreateGLTexture("../../Utilities/textures/rusticwood.jpg", "rim");
-    CreateGLTexture("../../Utilities/textures/rusticwood.jpg", "base");
-    CreateGLTexture("../../Utilities/textures/blackwood.jpg", "blackwood");
-    CreateGLTexture("../../Utilities/textures/rusticwood.jpg", "cuttingboard");
-    CreateGLTexture("../../Utilities/textures/glass.jpg", "glass");
+    const SceneFile::SCENE_TEXTURE* textures = m_sceneFile.GetTextures();
+    for (int i = 0; i < m_sceneFile.GetTextureCount(); ++i)
+    {
+        const char* tag = m_sceneFile.GetString(textures[i].tag);
+        std::string path = std::string(UTILITIES_DIRECTORY) + m_sceneFile.GetString(textures[i].path);
+        CreateGLTexture(path.c_str(), tag);
+        m_sceneTextureLayers.push_back(FindTextureLayer(tag));
+    }
 
     // Bind all loaded textures to their respective slots
     BindGLTextures();
@@ -214,192 +1119,178 @@ void SceneManager::PrepareScene()
 /***********************************************************
  *  DefineObjectMaterials()
  *
- *  This method is used for defining the materials
- *  to be used in the scene
+ *  This method is used for defining the materials of the
+ *  scene description and uploading them to the shader's
+ *  material table. A plain white material is defined ahead
+ *  of them for the draws that name no material, so every
+ *  draw selects a definite one whatever was drawn before.
  ***********************************************************/
 void SceneManager::DefineObjectMaterials()
 {
-    m_objectMaterials.push_back({ "wood", 0.3f, {0.3f, 0.2f, 0.1f}, {0.55f, 0.27f, 0.07f}, {0.2f, 0.2f, 0.2f}, 12.0f });
-    m_objectMaterials.push_back({ "blackwood", 0.3f, {0.2f, 0.1f, 0.05f}, {0.55f, 0.27f, 0.07f}, {0.3f, 0.2f, 0.1f}, 12.0f });
-    m_objectMaterials.push_back({ "apple", 0.3f, {0.4f, 0.1f, 0.1f}, {0.85f, 0.2f, 0.2f}, {1.0f, 0.6f, 0.6f}, 32.0f });
-    m_objectMaterials.push_back({ "orange", 0.3f, {0.6f, 0.3f, 0.1f}, {1.0f, 0.6f, 0.1f}, {1.0f, 0.7f, 0.3f}, 24.0f });
-    m_objectMaterials.push_back({ "lemon", 0.2f, {0.8f, 0.8f, 0.2f}, {1.0f, 1.0f, 0.3f}, {0.9f, 0.9f, 0.4f}, 16.0f });
-    m_objectMaterials.push_back({ "pear", 0.3f, {0.2f, 0.6f, 0.2f}, {0.3f, 0.8f, 0.3f}, {0.6f, 0.9f, 0.6f}, 20.0f });
-    m_objectMaterials.push_back({ "stem", 0.2f, {0.1f, 0.3f, 0.1f}, {0.1f, 0.4f, 0.1f}, {0.2f, 0.2f, 0.2f}, 8.0f });
-    m_objectMaterials.push_back({ "ceramic", 0.3f, {0.8f, 0.8f, 0.8f}, {0.9f, 0.9f, 0.9f}, {1.0f, 1.0f, 1.0f}, 40.0f });
-    m_objectMaterials.push_back({ "glass", 0.2f, {0.6f, 0.5f, 0.6f}, {0.8f, 0.7f, 0.8f}, {1.0f, 1.0f, 1.0f}, 64.0f });
-    m_objectMaterials.push_back({ "petal", 0.3f, {1.0f, 0.8f, 0.8f}, {1.0f, 0.6f, 0.6f}, {1.0f, 0.9f, 0.9f}, 24.0f });
-    m_objectMaterials.push_back({ "center", 0.3f, {1.0f, 1.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, 16.0f });
+    OBJECT_MATERIAL plain;
+    plain.tag = "default";
+    plain.ambientStrength = 0.3f;
+    plain.ambientColor = glm::vec3(1.0f);
+    plain.diffuseColor = glm::vec3(1.0f);
+    plain.specularColor = glm::vec3(0.0f);
+    plain.shininess = 1.0f;
+    plain.opacity = 1.0f;
+    m_defaultMaterial = DefineMaterial(plain);
+    m_pendingDraw.materialIndex = m_defaultMaterial;
+
+    const SceneFile::SCENE_MATERIAL* materials = m_sceneFile.GetMaterials();
+    for (int i = 0; i < m_sceneFile.GetMaterialCount(); ++i)
+    {
+        const SceneFile::SCENE_MATERIAL& material = materials[i];
+        OBJECT_MATERIAL definition;
+        definition.tag = m_sceneFile.GetString(material.tag);
+        definition.ambientStrength = material.ambientStrength;
+        definition.ambientColor = glm::vec3(material.ambientColor[0], material.ambientColor[1], material.ambientColor[2]);
+        definition.diffuseColor = glm::vec3(material.diffuseColor[0], material.diffuseColor[1], material.diffuseColor[2]);
+        definition.specularColor = glm::vec3(material.specularColor[0], material.specularColor[1], material.specularColor[2]);
+        definition.shininess = material.shininess;
+        definition.opacity = material.opacity;
+        int handle = DefineMaterial(definition);
+        m_sceneMaterials.push_back((handle >= 0) ? handle : m_defaultMaterial);
+    }
+
+    UploadMaterialBuffer();
 }
 
 /***********************************************************
  *  SetupSceneLights()
  *
  *  This method is used for setting up the lighting
- *  for the scene
+ *  for the scene from the scene description. The lights
+ *  are binned into view clusters every frame.
  ***********************************************************/
 void SceneManager::SetupSceneLights()
 {
-    m_pShaderManager->setBoolValue("bUseLighting", true);
+    m_useLighting = true;
 
-    // Warm key light from front-right
-    m_pShaderManager->setVec3Value("lightSources[0].position", 4.0f, 6.0f, 4.0f);
-    m_pShaderManager->setVec3Value("lightSources[0].ambientColor", 0.3f, 0.2f, 0.2f);
-    m_pShaderManager->setVec3Value("lightSources[0].diffuseColor", 0.9f, 0.6f, 0.5f);
-    m_pShaderManager->setVec3Value("lightSources[0].specularColor", 1.0f, 0.8f, 0.7f);
+    m_lightClusters.ClearLights();
+    const SceneFile::SCENE_LIGHT* lights = m_sceneFile.GetLights();
+    for (int i = 0; i < m_sceneFile.GetLightCount(); ++i)
+    {
+        const SceneFile::SCENE_LIGHT& light = lights[i];
+        LightClusters::GPU_LIGHT gpuLight = LightClusters::GPU_LIGHT();
+        gpuLight.position = glm::vec3(light.position[0], light.position[1], light.position[2]);
+        gpuLight.range = light.range;
+        gpuLight.ambientColor = glm::vec3(light.ambientColor[0], light.ambientColor[1], light.ambientColor[2]);
+        gpuLight.focalStrength = light.focalStrength;
+        gpuLight.diffuseColor = glm::vec3(light.diffuseColor[0], light.diffuseColor[1], light.diffuseColor[2]);
+        gpuLight.specularIntensity = light.specularIntensity;
+        gpuLight.specularColor = glm::vec3(light.specularColor[0], light.specularColor[1], light.specularColor[2]);
+        m_lightClusters.AddLight(gpuLight);
+    }
+
+    AddExtraLights();
+}
+
+/***********************************************************
+ *  AddExtraLights()
+ *
+ *  This method scatters small coloured lights over the table
+ *  from a fixed seed, so that runs with many lights render
+ *  the same frames.
+ ***********************************************************/
+void SceneManager::AddExtraLights()
+{
+    unsigned int seed = 330;
+    auto random = [&seed]()
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / 16777216.0f;
+    };
 
-    // Soft white fill light from back-left
-    m_pShaderManager->setVec3Value("lightSources[1].position", -4.0f, 3.0f, -3.0f);
-    m_pShaderManager->setVec3Value("lightSources[1].ambientColor", 0.05f, 0.05f, 0.05f);
-    m_pShaderManager->setVec3Value("lightSources[1].diffuseColor", 0.4f, 0.4f, 0.4f);
-    m_pShaderManager->setVec3Value("lightSources[1].specularColor", 0.6f, 0.6f, 0.6f);
+    for (int i = 0; i < m_extraLightCount; ++i)
+    {
+        LightClusters::GPU_LIGHT light = LightClusters::GPU_LIGHT();
+        light.position = glm::vec3(-9.0f + 18.0f * random(), 0.2f + 2.0f * random(), -11.0f + 12.0f * random());
+        light.range = 1.0f + 1.5f * random();
+        light.diffuseColor = glm::vec3(random(), random(), random()) * 0.6f;
+        light.specularColor = light.diffuseColor;
+        light.focalStrength = 16.0f;
+        light.specularIntensity = 0.5f;
+        m_lightClusters.AddLight(light);
+    }
 }
 /***********************************************************
  *  RenderScene()
  *
  *  This method is used for rendering the 3D scene by
- *  transforming and drawing the basic 3D shapes
+ *  transforming and queueing every object of the scene
+ *  description, then submitting the queue sorted by shader
+ *  state. The objects are spread over the job system's
+ *  threads when it has any.
  ***********************************************************/
 void SceneManager::RenderScene()
 {
-    glm::vec3 scaleXYZ;
-    glm::vec3 positionXYZ;
-
-    m_pShaderManager->setBoolValue("bUseLighting", true);
-    m_pShaderManager->setBoolValue("bUseTexture", true);
-    m_pShaderManager->setVec4Value("objectColor", glm::vec4(1.0f));
-
-    // Background plane 
-    scaleXYZ = glm::vec3(20.0f, 1.0f, 20.0f);
-    positionXYZ = glm::vec3(0.0f, 10.0f, -15.0f);
-    SetTransformations(scaleXYZ, 90.0f, 0.0f, 0.0f, positionXYZ);
-    SetShaderColor(0.25f, 0.23f, 0.22f, 1.0f); 
-    m_basicMeshes->DrawPlaneMesh();
-
-    // Base plane
-    scaleXYZ = glm::vec3(20.0f, 1.0f, 20.0f);
-    positionXYZ = glm::vec3(0.0f, 0.0f, 0.0f);
-    SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-    SetShaderTexture("blackwood");
-    SetShaderMaterial("blackwood");
-    SetTextureUVScale(1.0f, 1.0f);
-    m_basicMeshes->DrawPlaneMesh();
-
-    // Bowl outer wall
-    scaleXYZ = glm::vec3(3.0f, 2.0f, 3.0f);
-    positionXYZ = glm::vec3(0.0f, 1.0f, -5.0f);
-    SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-    SetShaderTexture("bowl");
-    SetShaderMaterial("wood");
-    SetTextureUVScale(2.0f, 2.0f);
-    m_basicMeshes->DrawCylinderMesh();
-
-    // Bowl inner hollow
-    scaleXYZ = glm::vec3(2.9f, 0.5f, 2.9f);
-    positionXYZ = glm::vec3(0.0f, 0.525f, -5.0f);
-    SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-    SetShaderTexture("bowl_inner");
-    SetShaderMaterial("wood");
-    SetTextureUVScale(1.5f, 1.5f);
-    m_basicMeshes->DrawCylinderMesh(true, true, true);
-
-    // Bowl rim
-    scaleXYZ = glm::vec3(3.05f, 0.05f, 3.05f);
-    positionXYZ = glm::vec3(0.0f, 1.025f, -5.0f);
-    SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-    SetShaderTexture("rim");
-    SetShaderMaterial("wood");
-    SetTextureUVScale(1.0f, 1.0f);
-    m_basicMeshes->DrawCylinderMesh(true, true, true);
-
-    // Bowl base
-    scaleXYZ = glm::vec3(1.2f, 0.1f, 1.2f);
-    positionXYZ = glm::vec3(0.0f, 0.1f, -5.0f);
-    SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-    SetShaderTexture("base");
-    SetShaderMaterial("wood");
-    SetTextureUVScale(1.0f, 1.0f);
-    m_basicMeshes->DrawCylinderMesh(true, true, true);
-
-    // Fruits
-    SetTransformations(glm::vec3(0.8f), 0, 0, 0, glm::vec3(-0.7f, 3.0f, -5.0f));
-    SetShaderMaterial("apple");
-    m_basicMeshes->DrawSphereMesh();
-
-    SetTransformations(glm::vec3(0.9f), 0, 0, 0, glm::vec3(0.5f, 3.0f, -5.2f));
-    SetShaderMaterial("orange");
-    m_basicMeshes->DrawSphereMesh();
-
-    SetTransformations(glm::vec3(1.0f, 0.8f, 0.8f), 0, 0, 0, glm::vec3(0.0f, 2.80f, -4.8f));
-    SetShaderMaterial("lemon");
-    m_basicMeshes->DrawSphereMesh();
-
-    SetTransformations(glm::vec3(0.8f, 1.2f, 0.8f), 0, 0, 0, glm::vec3(0.2f, 3.0f, -5.0f));
-    SetShaderMaterial("pear");
-    m_basicMeshes->DrawSphereMesh();
-
-    SetTransformations(glm::vec3(0.05f, 0.3f, 0.05f), 15.0f, 0.0f, 0.0f, glm::vec3(0.2f, 3.1f, -5.0f));
-    SetShaderMaterial("stem");
-    m_basicMeshes->DrawCylinderMesh(true, true, true);
-
-    // Cutting board 
-    scaleXYZ = glm::vec3(4.0f, 0.12f, 2.2f);      
-    positionXYZ = glm::vec3(-4.5f, 0.06f, -4.5f);  
-    SetTransformations(scaleXYZ, 0.0f, 15.0f, 0.0f, positionXYZ);
-    SetShaderTexture("cuttingboard");
-    SetShaderMaterial("wood");
-    SetTextureUVScale(2.0f, 1.2f);
-    m_basicMeshes->DrawBoxMesh();
-
-    // Coffee mug 
-    scaleXYZ = glm::vec3(0.85f, 1.2f, 0.85f);     
-    positionXYZ = glm::vec3(4.2f, 0.6f, -4.2f);   
-    SetTransformations(scaleXYZ, 0.0f, -25.0f, 0.0f, positionXYZ);
-    SetShaderMaterial("ceramic");
-    m_basicMeshes->DrawCylinderMesh(false, true, true);
-
-    // Mug handle 
-    scaleXYZ = glm::vec3(0.32f);                   
-    positionXYZ = glm::vec3(4.8f, 1.1f, -4.2f);   
-    SetTransformations(scaleXYZ, 0.0f, 90.0f, 0.0f, positionXYZ);
-    SetShaderMaterial("ceramic");
-    m_basicMeshes->DrawTorusMesh();
-
-    // Vase 
-    scaleXYZ = glm::vec3(0.8f, 2.0f, 0.8f);       
-    positionXYZ = glm::vec3(-5.0f, 1.0f, -7.0f);  
-    SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-    SetShaderMaterial("glass");
-    m_basicMeshes->DrawTaperedCylinderMesh(true, true, true);
-
-    // Flower positions 
-    const glm::vec3 flowerPositions[3] = {
-        glm::vec3(-5.1f, 3.2f, -6.9f),    
-        glm::vec3(-4.8f, 3.0f, -7.2f),    
-        glm::vec3(-5.4f, 3.0f, -7.2f)     
-    };
+    PROFILE_GPU_SCOPE("RenderScene");
+
+    // textures still decoding draw with their placeholder
+    {
+        PROFILE_GPU_SCOPE("TextureUploads");
+        m_pendingTextures = m_textureCache.ProcessUploads();
+        BindGLTextures();
+    }
 
+    m_pStateCache->SetVec4Value("objectColor", glm::vec4(1.0f));
+    m_pStateCache->SetBoolValue("bPackedVertices",
+        m_instancedMeshes->GetVertexFormat() == InstancedMeshes::VERTEX_PACKED);
 
+    {
+        PROFILE_GPU_SCOPE("LightClusters");
+        m_lightClusters.Update(m_view, m_projection);
+        m_lightClusters.Bind(m_pStateCache);
+    }
 
-    for (int i = 0; i < 3; i++) {
-        scaleXYZ = glm::vec3(0.015f, 0.9f, 0.015f);
-        positionXYZ = flowerPositions[i] - glm::vec3(0.0f, 0.45f, 0.0f);
-        SetTransformations(scaleXYZ, -5.0f + i * 6.0f, 0.0f, 0.0f, positionXYZ);
-        SetShaderMaterial("stem");
-        m_basicMeshes->DrawCylinderMesh(true, true, true);
+    // with worker threads the draw list is built in parallel chunks
+    m_jobSystem.ResetStats();
+    {
+        PROFILE_SCOPE("BuildDrawList");
+        if (m_jobSystem.GetWorkerCount() > 0)
+        {
+            BuildDrawPackets();
+        }
+        else
+        {
+            m_frameDraws.clear();
+            m_frameTransforms.clear();
+            m_transformCursor = 0;
 
-        scaleXYZ = glm::vec3(0.09f, 0.14f, 0.09f);
-        positionXYZ = flowerPositions[i];
-        SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-        SetShaderMaterial("petal");
-        m_basicMeshes->DrawConeMesh(true);
+            // objects are read in place from the mapped scene file
+            const SceneFile::SCENE_OBJECT* objects = m_sceneFile.GetObjects();
+            int objectCount = m_sceneFile.GetObjectCount();
+            for (int i = 0; i < objectCount; ++i)
+                QueueSceneObject(objects[i]);
 
-        scaleXYZ = glm::vec3(0.04f);
-        positionXYZ = flowerPositions[i] + glm::vec3(0.0f, 0.03f, 0.0f);
-        SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-        SetShaderMaterial("center");
-        m_basicMeshes->DrawSphereMesh();
+            CullFrameDraws();
+        }
     }
+    SubmitRenderQueue();
+}
+
+/***********************************************************
+ *  QueueSceneObject()
+ *
+ *  This method sets every state of one scene object, so no
+ *  state carries over from the object before it, and queues
+ *  its draw.
+ ***********************************************************/
+void SceneManager::QueueSceneObject(const SceneFile::SCENE_OBJECT& object)
+{
+    if (object.pivot >= 0)
+        PushTransformParent(m_pivotTransforms[object.pivot]);
+    SetTransformations(
+        glm::vec3(object.scale[0], object.scale[1], object.scale[2]),
+        object.rotationDegrees[0], object.rotationDegrees[1], object.rotationDegrees[2],
+        glm::vec3(object.position[0], object.position[1], object.position[2]));
+    if (object.pivot >= 0)
+        PopTransformParent();
+
+    FillSceneDraw(object, m_pendingDraw);
+    QueueMeshDraw((RenderQueue::MESH_ID)object.mesh);
 }
 
 /********************************************
@@ -407,13 +1298,33 @@ void SceneManager::RenderScene()
  *
  *  This method is called every frame for
  *  updating scene geometry, animations, etc.
+ *  The pivot angles come from the fixed-step
+ *  simulation, which is stepped here once
+ *  per frame unless it runs on its own
+ *  thread. It returns true while the scene
+ *  changes from frame to frame, either
+ *  because a pivot spins and is not paused
+ *  or textures are still being streamed in.
  ********************************************/
-void SceneManager::Update()
+bool SceneManager::Update()
 {
-    static float angle = 0.0f;
-    angle += 0.01f; // Increment the rotation angle
+    PROFILE_SCOPE("Update");
+
+    m_simulation.Step();
+    m_simulation.Sample(m_pivotAngles);
+
+    // Turn each pivot about its vertical axis, carrying its children with it
+    const SceneFile::SCENE_PIVOT* pivots = m_sceneFile.GetPivots();
+    for (size_t i = 0; i < m_pivotTransforms.size(); ++i)
+    {
+        const SceneFile::SCENE_PIVOT& pivot = pivots[i];
+        if (pivot.degreesPerTick == 0.0f)
+            continue;
+
+        glm::vec3 center(pivot.center[0], pivot.center[1], pivot.center[2]);
+        glm::mat4 rotation = glm::rotate(glm::radians(m_pivotAngles[i]), glm::vec3(0.0f, 1.0f, 0.0f));
+        m_transforms.SetLocalMatrix(m_pivotTransforms[i], glm::translate(center) * rotation * glm::translate(-center));
+    }
 
-    // Rotate the bowl on its Y axis
-    glm::mat4 bowlRotation = glm::rotate(glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    m_pShaderManager->setMat4Value("bowlRotation", bowlRotation);
+    return m_simulation.IsAnimating() || m_pendingTextures > 0;
 }
@@ -9,10 +9,23 @@
 
 #pragma once
 
-#include "ShaderManager.h"
-#include "ShapeMeshes.h"
+#include "GLStateCache.h"
+#include "RenderQueue.h"
+#include "InstancedMeshes.h"
+#include "JobSystem.h"
+#include "FrustumCuller.h"
+#include "LightClusters.h"
+#include "LodSelector.h"
+#include "OcclusionCuller.h"
+#include "PassCounters.h"
+#include "TransformStore.h"
+#include "SceneFile.h"
+#include "SceneSimulation.h"
+#include "ShaderVariants.h"
+#include "TextureCache.h"
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 /***********************************************************
@@ -25,7 +38,7 @@ class SceneManager
 {
 public:
     // constructor
-    SceneManager(ShaderManager* pShaderManager);
+    SceneManager(GLStateCache* pStateCache, ShaderVariants* pShaderVariants);
     // destructor
     ~SceneManager();
 
@@ -33,7 +46,7 @@ public:
     struct TEXTURE_INFO
     {
         std::string tag;
-        uint32_t ID;
+        int layer;
     };
 
     // material info struct
@@ -45,42 +58,208 @@ public:
         glm::vec3 diffuseColor;
         glm::vec3 specularColor;
         float shininess;
+        // below 1 the material is drawn in the transparent pass
+        float opacity;
     };
 
 private:
-    // shader and mesh managers
-    ShaderManager* m_pShaderManager;
-    ShapeMeshes* m_basicMeshes;
+    // std140 layout of one entry of the shader's MaterialBlock
+    struct GPU_MATERIAL
+    {
+        glm::vec3 ambientColor;
+        float ambientStrength;
+        glm::vec3 diffuseColor;
+        float opacity;
+        glm::vec3 specularColor;
+        float shininess;
+    };
+
+    // shader state and mesh managers
+    GLStateCache* m_pStateCache;
+    ShaderVariants* m_pShaderVariants;
+    // lit variants are drawn once the scene has lights
+    bool m_useLighting;
+    InstancedMeshes* m_instancedMeshes;
 
-    // texture tracking
-    int m_loadedTextures = 0;
-    TEXTURE_INFO m_textureIDs[16];
+    // texture tracking, tags sharing an image share its array layer
+    std::vector<TEXTURE_INFO> m_textureIDs;
+    std::unordered_map<std::string, int> m_textureLayers;
+    TextureCache m_textureCache;
+    // textures still decoding after the last ProcessUploads
+    int m_pendingTextures;
 
-    // material definitions
+    // material definitions and their uniform buffer
     std::vector<OBJECT_MATERIAL> m_objectMaterials;
+    GLuint m_materialBuffer;
+    // material of draws that name none, defined ahead of the scene's
+    int m_defaultMaterial;
+
+    // compiled scene description, read in place every frame
+    std::string m_sceneFilename;
+    SceneFile m_sceneFile;
+    // texture layers and material handles by scene record index
+    std::vector<int> m_sceneTextureLayers;
+    std::vector<int> m_sceneMaterials;
+    // transforms and current angles of the scene's pivots
+    std::vector<int> m_pivotTransforms;
+    std::vector<float> m_pivotAngles;
+    // fixed-timestep animation of the pivots, on its own thread if enabled
+    SceneSimulation m_simulation;
+    bool m_threadedSimulation;
+
+    // object transforms, one per SetTransformations call of a frame
+    TransformStore m_transforms;
+    std::vector<int> m_sceneTransforms;
+    int m_transformCursor;
+    std::vector<int> m_transformParents;
+
+    // draws collected for the current frame, before and after culling
+    std::vector<RenderQueue::DRAW_ITEM> m_frameDraws;
+    std::vector<int> m_frameTransforms;
+    int m_pendingTransform;
+    RenderQueue m_renderQueue;
+    // state the next queued draw will be issued with
+    RenderQueue::DRAW_ITEM m_pendingDraw;
+    // state change counts of the last submitted frame
+    RenderQueue::QUEUE_STATS m_renderStats;
+    // per-instance data of the run being drawn, or of the whole frame
+    std::vector<InstancedMeshes::INSTANCE_DATA> m_instanceData;
+    // commands and per-draw data of a multi-draw indirect frame
+    bool m_useIndirect;
+    std::vector<InstancedMeshes::DRAW_COMMAND> m_drawCommands;
+    std::vector<InstancedMeshes::DRAW_DATA> m_drawData;
+    // depth-only pass ahead of the opaque pass, and fragments of each pass
+    bool m_depthPrepass;
+    bool m_depthOnlyPass;
+    PassCounters m_passCounters;
+
+    // view frustum culling of the collected draws
+    FrustumCuller m_frustumCuller;
+    std::vector<int> m_visibleDraws;
+    FrustumCuller::CULL_STATS m_cullStats;
+    int m_transformUpdateCount;
+    // draws inside the frustum, before occlusion culling
+    std::vector<const RenderQueue::DRAW_ITEM*> m_visibleItems;
+
+    // occlusion culling of the draws inside the frustum
+    bool m_useOcclusionCulling;
+    OcclusionCuller m_occlusionCuller;
+    OcclusionCuller::OCCLUSION_STATS m_occlusionStats;
+
+    // results of one chunk of a parallel loop, written only by the thread
+    // that ran the chunk
+    struct DRAW_PACKET
+    {
+        int transformsUpdated;
+        int nodesTested;
+        // objects kept by the chunk, in index order once levels are picked
+        std::vector<int> visible;
+        LodSelector::LOD_STATS lodStats;
+    };
+
+    // threads that build the draw list, the packets of a frame and
+    // whether each scene object is inside the frustum
+    JobSystem m_jobSystem;
+    std::vector<DRAW_PACKET> m_drawPackets;
+    std::vector<unsigned char> m_frameVisible;
+
+    // camera of the next rendered frame, used to bin the lights
+    glm::mat4 m_view;
+    glm::mat4 m_projection;
+    LightClusters m_lightClusters;
+    int m_viewportHeight;
+    // tessellation level of each visible draw
+    LodSelector m_lodSelector;
+    // ranged lights scattered over the table in addition to the scene's
+    int m_extraLightCount;
 
     // texture and material setup
     bool CreateGLTexture(const char* filename, std::string tag);
     void BindGLTextures();
     void DestroyGLTextures();
-    int FindTextureID(std::string tag);
-    int FindTextureSlot(std::string tag);
-    bool FindMaterial(std::string tag, OBJECT_MATERIAL& material);
+    int FindTextureLayer(const std::string& tag) const;
+    int DefineMaterial(const OBJECT_MATERIAL& material);
+    void UploadMaterialBuffer();
 
-    // shader and transform utilities
+    // transform utilities
     void SetTransformations(glm::vec3 scaleXYZ, float XrotationDegrees, float YrotationDegrees, float ZrotationDegrees, glm::vec3 positionXYZ);
-    void SetShaderColor(float redColorValue, float greenColorValue, float blueColorValue, float alphaValue);
-    void SetShaderTexture(std::string textureTag);
-    void SetTextureUVScale(float u, float v);
-    void SetShaderMaterial(std::string materialTag);
+    void PushTransformParent(int transform);
+    void PopTransformParent();
+
+    // render queue submission
+    void QueueMeshDraw(RenderQueue::MESH_ID mesh);
+    void QueueSceneObject(const SceneFile::SCENE_OBJECT& object);
+    RenderQueue::RENDER_PASS ClassifyPass(const RenderQueue::DRAW_ITEM& draw) const;
+    void CullFrameDraws();
+    void BuildDrawPackets();
+    void FillSceneDraw(const SceneFile::SCENE_OBJECT& object, RenderQueue::DRAW_ITEM& draw) const;
+    void PlaceSceneDraw(int object, DRAW_PACKET& packet);
+    void SelectSceneDrawLevel(int object, DRAW_PACKET& packet);
+    void QueueVisibleDraws();
+    bool GetOccluderBox(RenderQueue::MESH_ID mesh, FrustumCuller::BOUNDS& box) const;
+    void SubmitRenderQueue();
+    void SubmitDraws(int first, int end, RenderQueue::QUEUE_STATS& stats);
+    void SubmitDirect(int first, int end, RenderQueue::QUEUE_STATS& stats);
+    void SubmitIndirect(int first, int end, RenderQueue::QUEUE_STATS& stats);
+    void SubmitIndirectBatch(int first, int end, RenderQueue::QUEUE_STATS& stats);
+    void UseShaderVariant(bool textured);
+    int FindInstanceRun(int first) const;
 
     // scene setup
     void DefineObjectMaterials();
     void SetupSceneLights();
+    void AddExtraLights();
 
 public:
     // student-customizable methods
     void PrepareScene();
     void RenderScene();
-    void Update();
+    bool Update();
+
+    // camera used to cull and light the next rendered frame
+    void SetViewProjection(const glm::mat4& view, const glm::mat4& projection);
+    // size in pixels of the render target
+    void SetViewportSize(int width, int height);
+
+    // state change statistics for the last rendered frame
+    RenderQueue::QUEUE_STATS GetRenderStats() const;
+    // visible and culled objects of the last rendered frame
+    FrustumCuller::CULL_STATS GetCullStats() const;
+    // skip draws hidden behind the largest opaque objects
+    void SetOcclusionCulling(bool enable);
+    // occluders and occluded objects of the last rendered frame
+    OcclusionCuller::OCCLUSION_STATS GetOcclusionStats() const;
+    // world matrices recomputed for the last rendered frame
+    int GetTransformUpdateCount() const;
+    // light binning results for the last rendered frame
+    LightClusters::CLUSTER_STATS GetLightStats() const;
+    // level of detail choices for the last rendered frame
+    LodSelector::LOD_STATS GetLodStats() const;
+    // largest projected tessellation error in pixels, 0 for full detail
+    void SetMaxScreenError(float pixels);
+    // texture sharing statistics
+    TextureCache::CACHE_STATS GetTextureCacheStats() const;
+    // storage format of the scene textures, set before PrepareScene
+    void SetTextureFormat(TextureCooker::TEXTURE_FORMAT format);
+    // scene source to load, set before PrepareScene
+    void SetSceneFilename(const std::string& filename);
+    // ranged lights to add to the scene's, set before PrepareScene
+    void SetExtraLightCount(int count);
+    // submit each frame as one multi-draw indirect call where supported
+    void SetIndirectDrawing(bool enable);
+    // layout of the shared vertex buffer, set before PrepareScene
+    void SetVertexFormat(InstancedMeshes::VERTEX_FORMAT format);
+    // write depth for the opaque draws before shading them
+    void SetDepthPrepass(bool enable);
+    // fragments and overdraw of each pass of a recent frame
+    PassCounters::PASS_STATS GetPassStats() const;
+    // tick the animation on its own thread instead of once per Update,
+    // set before PrepareScene
+    void SetThreadedSimulation(bool enable);
+    // hold the animation still, so on-demand rendering can idle
+    void SetAnimationPaused(bool paused);
+    // threads besides the render thread that build the draw list, 0 for none
+    void SetWorkerThreadCount(int count);
+    // parallel loops and chunks of the last rendered frame
+    JobSystem::JOB_STATS GetJobStats() const;
 };
@@ -0,0 +1,212 @@
+///////////////////////////////////////////////////////////////////////////////
+// SceneSimulation.cpp
+// ===================
+// Fixed-timestep animation of the scene, stepped apart from rendering
+//
+//  The animated state of the scene, the angle of each pivot, advances in
+//  ticks of a fixed length, so animation runs at the same speed at any
+//  frame rate. On its own thread the simulation ticks by the clock while
+//  the render thread draws; each tick is computed into a spare buffer and
+//  published together with the tick before it, and rendering interpolates
+//  between the two, one tick behind, so motion stays smooth when frames
+//  and ticks do not line up. Without the thread the caller steps one tick
+//  per frame, which keeps headless runs repeatable.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SceneSimulation.h"
+
+#include <algorithm>
+#include <utility>
+
+// sixty ticks a second, the frame rate the scene's pivot speeds were tuned at
+const double SceneSimulation::TICK_SECONDS = 1.0 / 60.0;
+
+namespace
+{
+    // ticks the thread may fall behind the clock before it skips ahead
+    const int MAX_CATCH_UP_TICKS = 5;
+}
+
+/***********************************************************
+ *  SceneSimulation()
+ ***********************************************************/
+SceneSimulation::SceneSimulation()
+{
+    m_running = false;
+    m_stopping = false;
+    m_paused = false;
+}
+
+/***********************************************************
+ *  ~SceneSimulation()
+ ***********************************************************/
+SceneSimulation::~SceneSimulation()
+{
+    Stop();
+}
+
+/***********************************************************
+ *  Initialize()
+ ***********************************************************/
+void SceneSimulation::Initialize(const std::vector<float>& degreesPerTick)
+{
+    Stop();
+
+    m_degreesPerTick = degreesPerTick;
+    CLOCK::time_point now = CLOCK::now();
+    for (SIM_STATE* state : { &m_previous, &m_current, &m_next })
+    {
+        state->pivotAngles.assign(degreesPerTick.size(), 0.0f);
+        state->time = now;
+    }
+}
+
+/***********************************************************
+ *  IsAnimating()
+ ***********************************************************/
+bool SceneSimulation::IsAnimating() const
+{
+    if (m_paused)
+        return false;
+
+    for (float degrees : m_degreesPerTick)
+    {
+        if (degrees != 0.0f)
+            return true;
+    }
+    return false;
+}
+
+/***********************************************************
+ *  SetPaused()
+ *
+ *  This method freezes the pivots at the latest tick. The
+ *  thread keeps its clock while paused, so it resumes from
+ *  there without a burst of catch-up ticks.
+ ***********************************************************/
+void SceneSimulation::SetPaused(bool paused)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_paused = paused;
+}
+
+/***********************************************************
+ *  Start()
+ ***********************************************************/
+void SceneSimulation::Start()
+{
+    if (m_running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_previous.time = m_current.time = CLOCK::now();
+    }
+    m_stopping = false;
+    m_running = true;
+    m_thread = std::thread(&SceneSimulation::ThreadLoop, this);
+}
+
+/***********************************************************
+ *  Stop()
+ ***********************************************************/
+void SceneSimulation::Stop()
+{
+    if (!m_running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_stopRequested.notify_all();
+    m_thread.join();
+    m_running = false;
+}
+
+/***********************************************************
+ *  Step()
+ ***********************************************************/
+void SceneSimulation::Step()
+{
+    if (!m_running && !m_paused)
+        Advance(CLOCK::now());
+}
+
+/***********************************************************
+ *  Sample()
+ *
+ *  This method draws the state one tick behind the clock,
+ *  between the two latest ticks, so it never has to guess
+ *  ahead. Stepped by the caller or paused, it draws the
+ *  latest tick.
+ ***********************************************************/
+void SceneSimulation::Sample(std::vector<float>& pivotAngles)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    pivotAngles.resize(m_current.pivotAngles.size());
+    if (!m_running || m_paused)
+    {
+        std::copy(m_current.pivotAngles.begin(), m_current.pivotAngles.end(), pivotAngles.begin());
+        return;
+    }
+
+    std::chrono::duration<double> sinceTick = CLOCK::now() - m_current.time;
+    float blend = (float)std::min(std::max(sinceTick.count() / TICK_SECONDS, 0.0), 1.0);
+    for (size_t i = 0; i < pivotAngles.size(); ++i)
+    {
+        float previous = m_previous.pivotAngles[i];
+        pivotAngles[i] = previous + (m_current.pivotAngles[i] - previous) * blend;
+    }
+}
+
+/***********************************************************
+ *  ThreadLoop()
+ *
+ *  This method ticks at fixed points in time. After a stall
+ *  longer than a few ticks it skips ahead rather than
+ *  running a burst of ticks to catch up.
+ ***********************************************************/
+void SceneSimulation::ThreadLoop()
+{
+    std::chrono::duration<double> tickLength(TICK_SECONDS);
+    CLOCK::time_point nextTick = CLOCK::now() + std::chrono::duration_cast<CLOCK::duration>(tickLength);
+
+    for (;;)
+    {
+        bool paused;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_stopRequested.wait_until(lock, nextTick, [this] { return m_stopping; }))
+                return;
+            paused = m_paused;
+        }
+
+        if (!paused)
+            Advance(nextTick);
+
+        nextTick += std::chrono::duration_cast<CLOCK::duration>(tickLength);
+        CLOCK::time_point now = CLOCK::now();
+        if (now - nextTick > tickLength * MAX_CATCH_UP_TICKS)
+            nextTick = now;
+    }
+}
+
+/***********************************************************
+ *  Advance()
+ *
+ *  This method computes the next tick from the current one
+ *  without holding the lock, which only the publishing swap
+ *  needs. The render thread never sees the spare buffer.
+ ***********************************************************/
+void SceneSimulation::Advance(CLOCK::time_point time)
+{
+    for (size_t i = 0; i < m_degreesPerTick.size(); ++i)
+        m_next.pivotAngles[i] = m_current.pivotAngles[i] + m_degreesPerTick[i];
+    m_next.time = time;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::swap(m_previous, m_current);
+    std::swap(m_current, m_next);
+}
@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////////
+// SceneSimulation.h
+// =================
+// Fixed-timestep animation of the scene, stepped apart from rendering
+//
+//  The animated state of the scene, the angle of each pivot, advances in
+//  ticks of a fixed length, so animation runs at the same speed at any
+//  frame rate. On its own thread the simulation ticks by the clock while
+//  the render thread draws; each tick is computed into a spare buffer and
+//  published together with the tick before it, and rendering interpolates
+//  between the two, one tick behind, so motion stays smooth when frames
+//  and ticks do not line up. Without the thread the caller steps one tick
+//  per frame, which keeps headless runs repeatable.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/***********************************************************
+ *  SceneSimulation
+ *
+ *  This class owns the ticked pivot angles and the thread
+ *  that advances them.
+ ***********************************************************/
+class SceneSimulation
+{
+public:
+    // length of one tick, the scene's pivot speeds are per tick
+    static const double TICK_SECONDS;
+
+    // constructor
+    SceneSimulation();
+    // destructor
+    ~SceneSimulation();
+
+    // degrees each pivot turns per tick, all pivots start at 0
+    void Initialize(const std::vector<float>& degreesPerTick);
+    // true when any pivot turns and the animation is not paused
+    bool IsAnimating() const;
+    // hold every pivot at its current angle until unpaused
+    void SetPaused(bool paused);
+
+    // tick by the clock on a thread of its own until Stop
+    void Start();
+    void Stop();
+    // advance one tick on the calling thread, when not started
+    void Step();
+
+    // pivot angles to draw now, interpolated when running on the thread
+    void Sample(std::vector<float>& pivotAngles);
+
+private:
+    typedef std::chrono::steady_clock CLOCK;
+
+    // scene state at the end of one tick
+    struct SIM_STATE
+    {
+        std::vector<float> pivotAngles;
+        CLOCK::time_point time;
+    };
+
+    std::vector<float> m_degreesPerTick;
+    // ticks before the latest, the latest, and the one being computed;
+    // the first two are shared with the render thread under the mutex
+    SIM_STATE m_previous;
+    SIM_STATE m_current;
+    SIM_STATE m_next;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_stopRequested;
+    bool m_running;
+    bool m_stopping;
+    // written by the render thread under the mutex
+    bool m_paused;
+
+    void ThreadLoop();
+    // compute the tick after the current one and publish it
+    void Advance(CLOCK::time_point time);
+};
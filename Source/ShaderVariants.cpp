@@ -0,0 +1,380 @@
+///////////////////////////////////////////////////////////////////////////////
+// ShaderVariants.cpp
+// ==================
+// Programs built from one shader pair with features switched at compile time
+//
+//  Rather than branching on uniforms in every fragment, the shader is built
+//  once per combination of features, each with a #define per enabled
+//  feature inserted after its #version line, and the renderer picks the
+//  program matching each draw. Linked programs are kept on disk in the
+//  Cooked directory, keyed by a hash of their sources and the driver that
+//  built them, so later launches load the binaries instead of compiling.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderVariants.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    // shared with TextureCooker's cooked textures
+    const char* BINARY_DIRECTORY = "Cooked";
+    const char BINARY_MAGIC[4] = { 'C', 'P', 'R', 'G' };
+    const uint32_t BINARY_VERSION = 1;
+
+    const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+    const uint64_t FNV_PRIME = 1099511628211ull;
+
+    // fixed-size header in front of the driver's program binary
+    struct BINARY_HEADER
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t binaryFormat;
+        uint32_t binarySize;
+    };
+
+    // defines of the features, by bit
+    const char* const FEATURE_DEFINES[] = { "TEXTURED", "LIT" };
+    const int FEATURE_COUNT = 2;
+}
+
+/***********************************************************
+ *  ShaderVariants()
+ ***********************************************************/
+ShaderVariants::ShaderVariants()
+{
+    for (int variant = 0; variant < VARIANT_COUNT; ++variant)
+        m_programs[variant] = 0;
+    m_stats = LOAD_STATS();
+}
+
+/***********************************************************
+ *  ~ShaderVariants()
+ ***********************************************************/
+ShaderVariants::~ShaderVariants()
+{
+    DeletePrograms();
+}
+
+/***********************************************************
+ *  LoadShaders()
+ *
+ *  This method builds a program for every combination of
+ *  features. Each is looked up in the binary cache under
+ *  the hash of its final sources and the driver, so editing
+ *  a shader or updating the driver simply misses the cache.
+ ***********************************************************/
+bool ShaderVariants::LoadShaders(const char* vertexFilename, const char* fragmentFilename)
+{
+    auto start = std::chrono::steady_clock::now();
+    DeletePrograms();
+    m_stats = LOAD_STATS();
+
+    std::string vertexSource;
+    std::string fragmentSource;
+    if (!ReadSource(vertexFilename, vertexSource) || !ReadSource(fragmentFilename, fragmentSource))
+        return false;
+
+    m_driver.clear();
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+    {
+        const GLubyte* value = glGetString(name);
+        m_driver += value ? (const char*)value : "";
+        m_driver += '\n';
+    }
+
+    bool success = true;
+    for (int variant = 0; variant < VARIANT_COUNT; ++variant)
+    {
+        m_programs[variant] = LoadVariant(vertexSource, fragmentSource, variant);
+        if (!m_programs[variant])
+            success = false;
+        ++m_stats.programs;
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    m_stats.milliseconds = elapsed.count();
+    std::cout << "INFO: Loaded " << m_stats.programs << " shader variants, " << m_stats.cacheHits
+        << " from the program binary cache, in " << m_stats.milliseconds << " ms" << std::endl;
+    return success;
+}
+
+/***********************************************************
+ *  GetProgram()
+ ***********************************************************/
+GLuint ShaderVariants::GetProgram(bool textured, bool lit) const
+{
+    int variant = (textured ? FEATURE_TEXTURED : 0) | (lit ? FEATURE_LIT : 0);
+    return m_programs[variant];
+}
+
+/***********************************************************
+ *  GetLoadStats()
+ ***********************************************************/
+ShaderVariants::LOAD_STATS ShaderVariants::GetLoadStats() const
+{
+    return m_stats;
+}
+
+/***********************************************************
+ *  DeletePrograms()
+ ***********************************************************/
+void ShaderVariants::DeletePrograms()
+{
+    for (int variant = 0; variant < VARIANT_COUNT; ++variant)
+    {
+        if (m_programs[variant])
+            glDeleteProgram(m_programs[variant]);
+        m_programs[variant] = 0;
+    }
+}
+
+/***********************************************************
+ *  LoadVariant()
+ *
+ *  This method loads one variant from the binary cache, or
+ *  compiles and links it and saves its binary for the next
+ *  launch. Drivers without program binaries always compile.
+ ***********************************************************/
+GLuint ShaderVariants::LoadVariant(const std::string& vertexSource, const std::string& fragmentSource, int features)
+{
+    std::string vertexVariant = AddDefines(vertexSource, features);
+    std::string fragmentVariant = AddDefines(fragmentSource, features);
+
+    uint64_t key = HashString(FNV_OFFSET_BASIS, vertexVariant);
+    key = HashString(key, fragmentVariant);
+    key = HashString(key, m_driver);
+    std::string filename = GetBinaryFilename(key);
+
+    bool useBinaries = GLEW_ARB_get_program_binary;
+    if (useBinaries)
+    {
+        GLuint program = LoadBinary(filename, key);
+        if (program)
+        {
+            ++m_stats.cacheHits;
+            return program;
+        }
+    }
+
+    GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexVariant);
+    GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentVariant);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    if (useBinaries)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+    glDetachShader(program, vertexShader);
+    glDetachShader(program, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    if (!CheckLinked(program))
+    {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        std::cout << "Failed to link shader variant " << features << std::endl << log << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    if (useBinaries)
+        SaveBinary(filename, key, program);
+    return program;
+}
+
+/***********************************************************
+ *  LoadBinary()
+ *
+ *  This method returns 0 when the file is missing, was
+ *  written for other sources, or is refused by the driver,
+ *  which may reject binaries at any time, for example after
+ *  an update that kept the version string.
+ ***********************************************************/
+GLuint ShaderVariants::LoadBinary(const std::string& filename, uint64_t key)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+        return 0;
+
+    BINARY_HEADER header;
+    if (!file.read((char*)&header, sizeof(header)) ||
+        memcmp(header.magic, BINARY_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != BINARY_VERSION ||
+        header.key != key)
+        return 0;
+
+    std::vector<char> binary(header.binarySize);
+    if (!file.read(binary.data(), (std::streamsize)binary.size()))
+        return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, (GLenum)header.binaryFormat, binary.data(), (GLsizei)binary.size());
+    if (!CheckLinked(program))
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+/***********************************************************
+ *  SaveBinary()
+ *
+ *  This method writes the file under a temporary name and
+ *  renames it into place, as cooked textures are written.
+ ***********************************************************/
+void ShaderVariants::SaveBinary(const std::string& filename, uint64_t key, GLuint program)
+{
+    GLint binarySize = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+    if (binarySize <= 0)
+        return;
+
+    std::vector<char> binary(binarySize);
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(program, binarySize, &binarySize, &binaryFormat, binary.data());
+
+    BINARY_HEADER header;
+    memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+    header.version = BINARY_VERSION;
+    header.key = key;
+    header.binaryFormat = binaryFormat;
+    header.binarySize = (uint32_t)binarySize;
+
+#ifdef _WIN32
+    _mkdir(BINARY_DIRECTORY);
+#else
+    mkdir(BINARY_DIRECTORY, 0755);
+#endif
+
+    std::string temporaryFilename = filename + ".tmp";
+    {
+        std::ofstream file(temporaryFilename, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return;
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), binarySize);
+        if (!file)
+            return;
+    }
+
+    std::remove(filename.c_str());
+    std::rename(temporaryFilename.c_str(), filename.c_str());
+}
+
+/***********************************************************
+ *  GetBinaryFilename()
+ ***********************************************************/
+std::string ShaderVariants::GetBinaryFilename(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.cprg", (unsigned long long)key);
+    return std::string(BINARY_DIRECTORY) + "/" + name;
+}
+
+/***********************************************************
+ *  ReadSource()
+ ***********************************************************/
+bool ShaderVariants::ReadSource(const char* filename, std::string& source)
+{
+    std::ifstream file(filename);
+    if (!file)
+    {
+        std::cout << "Failed to open " << filename << " for reading" << std::endl;
+        return false;
+    }
+
+    std::stringstream contents;
+    contents << file.rdbuf();
+    source = contents.str();
+    return true;
+}
+
+/***********************************************************
+ *  AddDefines()
+ *
+ *  This method places the defines on the line after
+ *  #version, which must stay the first directive.
+ ***********************************************************/
+std::string ShaderVariants::AddDefines(const std::string& source, int features)
+{
+    std::string defines;
+    for (int feature = 0; feature < FEATURE_COUNT; ++feature)
+    {
+        if (features & (1 << feature))
+            defines += std::string("#define ") + FEATURE_DEFINES[feature] + "\n";
+    }
+
+    // the directive starts a line, comments above it may mention it too
+    size_t version = 0;
+    if (source.compare(0, 8, "#version") != 0)
+    {
+        version = source.find("\n#version");
+        if (version != std::string::npos)
+            ++version;
+    }
+    size_t lineEnd = (version == std::string::npos) ? std::string::npos : source.find('\n', version);
+    if (lineEnd == std::string::npos)
+        return defines + source;
+    return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+/***********************************************************
+ *  CompileShader()
+ ***********************************************************/
+GLuint ShaderVariants::CompileShader(GLenum type, const std::string& source)
+{
+    const char* text = source.c_str();
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &text, nullptr);
+    glCompileShader(shader);
+
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled)
+    {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::cout << "Failed to compile shader" << std::endl << log << std::endl;
+    }
+    return shader;
+}
+
+/***********************************************************
+ *  CheckLinked()
+ ***********************************************************/
+bool ShaderVariants::CheckLinked(GLuint program)
+{
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    return linked == GL_TRUE;
+}
+
+/***********************************************************
+ *  HashString()
+ ***********************************************************/
+uint64_t ShaderVariants::HashString(uint64_t hash, const std::string& text)
+{
+    for (unsigned char c : text)
+    {
+        hash ^= c;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////
+// ShaderVariants.h
+// ================
+// Programs built from one shader pair with features switched at compile time
+//
+//  Rather than branching on uniforms in every fragment, the shader is built
+//  once per combination of features, each with a #define per enabled
+//  feature inserted after its #version line, and the renderer picks the
+//  program matching each draw. Linked programs are kept on disk in the
+//  Cooked directory, keyed by a hash of their sources and the driver that
+//  built them, so later launches load the binaries instead of compiling.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <string>
+
+/***********************************************************
+ *  ShaderVariants
+ *
+ *  This class builds, caches and hands out every variant of
+ *  the scene shader.
+ ***********************************************************/
+class ShaderVariants
+{
+public:
+    // features a variant is built with, as bits of its index
+    enum VARIANT_FEATURE
+    {
+        FEATURE_TEXTURED = 1,
+        FEATURE_LIT = 2
+    };
+    static const int VARIANT_COUNT = 4;
+
+    // work done by the last LoadShaders
+    struct LOAD_STATS
+    {
+        int programs;
+        int cacheHits;
+        double milliseconds;
+    };
+
+    // constructor
+    ShaderVariants();
+    // destructor
+    ~ShaderVariants();
+
+    // build every variant, from the binary cache where possible
+    bool LoadShaders(const char* vertexFilename, const char* fragmentFilename);
+    // program of one combination of features
+    GLuint GetProgram(bool textured, bool lit) const;
+
+    LOAD_STATS GetLoadStats() const;
+
+private:
+    GLuint m_programs[VARIANT_COUNT];
+    LOAD_STATS m_stats;
+    // vendor, renderer and version, binaries only load on the driver that saved them
+    std::string m_driver;
+
+    void DeletePrograms();
+    GLuint LoadVariant(const std::string& vertexSource, const std::string& fragmentSource, int features);
+
+    // program binary cache
+    GLuint LoadBinary(const std::string& filename, uint64_t key);
+    void SaveBinary(const std::string& filename, uint64_t key, GLuint program);
+    static std::string GetBinaryFilename(uint64_t key);
+
+    static bool ReadSource(const char* filename, std::string& source);
+    // the source with the defines of the features after its #version line
+    static std::string AddDefines(const std::string& source, int features);
+    static GLuint CompileShader(GLenum type, const std::string& source);
+    static bool CheckLinked(GLuint program);
+    static uint64_t HashString(uint64_t hash, const std::string& text);
+};
@@ -0,0 +1,297 @@
+///////////////////////////////////////////////////////////////////////////////
+// ShapeGeometry.cpp
+// =================
+// CPU-side generation of the basic shapes drawn by the scene
+//
+//  Produces indexed triangle lists with the same placement, size and
+//  texture mapping as ShapeMeshes, so that renderers which need direct
+//  access to vertex and index data can draw the same primitives. Normals
+//  are the smooth surface normals rather than ShapeMeshes' per-facet ones.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShapeGeometry.h"
+
+#include <cmath>
+
+namespace
+{
+    const float PI = 3.14159265358979f;
+    const float TWO_PI = 2.0f * PI;
+
+    void AddVertex(ShapeGeometry::SHAPE_MESH& mesh, glm::vec3 position, glm::vec3 normal, glm::vec2 uv)
+    {
+        ShapeGeometry::SHAPE_VERTEX vertex;
+        vertex.position = position;
+        vertex.normal = normal;
+        vertex.uv = uv;
+        mesh.vertices.push_back(vertex);
+    }
+
+    void AddTriangle(ShapeGeometry::SHAPE_MESH& mesh, uint32_t a, uint32_t b, uint32_t c)
+    {
+        mesh.indices.push_back(a);
+        mesh.indices.push_back(b);
+        mesh.indices.push_back(c);
+    }
+}
+
+/***********************************************************
+ *  BuildPlane()
+ ***********************************************************/
+void ShapeGeometry::BuildPlane(SHAPE_MESH& mesh)
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    glm::vec3 normal(0.0f, 1.0f, 0.0f);
+    AddVertex(mesh, glm::vec3(-1.0f, 0.0f, 1.0f), normal, glm::vec2(0.0f, 0.0f));
+    AddVertex(mesh, glm::vec3(1.0f, 0.0f, 1.0f), normal, glm::vec2(1.0f, 0.0f));
+    AddVertex(mesh, glm::vec3(1.0f, 0.0f, -1.0f), normal, glm::vec2(1.0f, 1.0f));
+    AddVertex(mesh, glm::vec3(-1.0f, 0.0f, -1.0f), normal, glm::vec2(0.0f, 1.0f));
+
+    AddTriangle(mesh, 0, 1, 2);
+    AddTriangle(mesh, 0, 2, 3);
+}
+
+/***********************************************************
+ *  BuildBox()
+ *
+ *  This method builds the six faces of the box with their
+ *  own vertices, so each face has a flat normal and the
+ *  full texture.
+ ***********************************************************/
+void ShapeGeometry::BuildBox(SHAPE_MESH& mesh)
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    // face normal followed by the face's U and V directions
+    const glm::vec3 faces[6][3] = {
+        { glm::vec3(0, 0, 1),  glm::vec3(1, 0, 0),  glm::vec3(0, 1, 0) },
+        { glm::vec3(0, 0, -1), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0) },
+        { glm::vec3(1, 0, 0),  glm::vec3(0, 0, -1), glm::vec3(0, 1, 0) },
+        { glm::vec3(-1, 0, 0), glm::vec3(0, 0, 1),  glm::vec3(0, 1, 0) },
+        { glm::vec3(0, 1, 0),  glm::vec3(1, 0, 0),  glm::vec3(0, 0, -1) },
+        { glm::vec3(0, -1, 0), glm::vec3(1, 0, 0),  glm::vec3(0, 0, 1) }
+    };
+
+    for (const glm::vec3* face : faces)
+    {
+        uint32_t first = (uint32_t)mesh.vertices.size();
+        glm::vec3 center = face[0] * 0.5f;
+        glm::vec3 u = face[1] * 0.5f;
+        glm::vec3 v = face[2] * 0.5f;
+
+        AddVertex(mesh, center - u - v, face[0], glm::vec2(0.0f, 0.0f));
+        AddVertex(mesh, center + u - v, face[0], glm::vec2(1.0f, 0.0f));
+        AddVertex(mesh, center + u + v, face[0], glm::vec2(1.0f, 1.0f));
+        AddVertex(mesh, center - u + v, face[0], glm::vec2(0.0f, 1.0f));
+
+        // split along the same diagonal as ShapeMeshes
+        AddTriangle(mesh, first, first + 1, first + 3);
+        AddTriangle(mesh, first + 1, first + 2, first + 3);
+    }
+}
+
+/***********************************************************
+ *  BuildSphere()
+ *
+ *  This method builds a UV sphere from pole to pole. As in
+ *  ShapeMeshes, the seam runs along -Z and U grows with the
+ *  angle around the Y axis scaled by the ring's radius, so
+ *  the texture narrows toward the poles instead of pinching.
+ *  The degenerate triangles at the poles are left out.
+ ***********************************************************/
+void ShapeGeometry::BuildSphere(SHAPE_MESH& mesh, int slices, int stacks)
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    for (int stack = 0; stack <= stacks; ++stack)
+    {
+        float phi = PI * stack / stacks;
+        float ringRadius = std::sin(phi);
+        float y = std::cos(phi);
+
+        for (int slice = 0; slice <= slices; ++slice)
+        {
+            float theta = TWO_PI * slice / slices - PI;
+            glm::vec3 position(ringRadius * std::sin(theta), y, ringRadius * std::cos(theta));
+            AddVertex(mesh, position, position, glm::vec2(0.5f + ringRadius * theta / TWO_PI, 1.0f - (float)stack / stacks));
+        }
+    }
+
+    uint32_t rowLength = slices + 1;
+    for (int stack = 0; stack < stacks; ++stack)
+    {
+        for (int slice = 0; slice < slices; ++slice)
+        {
+            uint32_t a = stack * rowLength + slice;
+            uint32_t b = a + rowLength;
+
+            if (stack != 0)
+                AddTriangle(mesh, a, b, a + 1);
+            if (stack != stacks - 1)
+                AddTriangle(mesh, a + 1, b, b + 1);
+        }
+    }
+}
+
+/***********************************************************
+ *  BuildCylinder()
+ ***********************************************************/
+void ShapeGeometry::BuildCylinder(SHAPE_MESH& mesh, int slices, bool drawTop, bool drawBottom, bool drawSides)
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    if (drawSides)
+        AddSides(mesh, slices, 1.0f, 1.0f);
+    if (drawTop)
+        AddCap(mesh, slices, 1.0f, 1.0f, true);
+    if (drawBottom)
+        AddCap(mesh, slices, 1.0f, 0.0f, false);
+}
+
+/***********************************************************
+ *  BuildTaperedCylinder()
+ ***********************************************************/
+void ShapeGeometry::BuildTaperedCylinder(SHAPE_MESH& mesh, int slices, bool drawTop, bool drawBottom, bool drawSides)
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    if (drawSides)
+        AddSides(mesh, slices, 1.0f, 0.5f);
+    if (drawTop)
+        AddCap(mesh, slices, 0.5f, 1.0f, true);
+    if (drawBottom)
+        AddCap(mesh, slices, 1.0f, 0.0f, false);
+}
+
+/***********************************************************
+ *  BuildCone()
+ ***********************************************************/
+void ShapeGeometry::BuildCone(SHAPE_MESH& mesh, int slices, bool drawBottom)
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    AddSides(mesh, slices, 1.0f, 0.0f);
+    if (drawBottom)
+        AddCap(mesh, slices, 1.0f, 0.0f, false);
+}
+
+/***********************************************************
+ *  BuildTorus()
+ *
+ *  This method sweeps a circular tube of the passed radius
+ *  around a ring of radius 1 in the XY plane.
+ ***********************************************************/
+void ShapeGeometry::BuildTorus(SHAPE_MESH& mesh, int ringSlices, int tubeSlices, float tubeRadius)
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    for (int ring = 0; ring <= ringSlices; ++ring)
+    {
+        float theta = TWO_PI * ring / ringSlices;
+        glm::vec3 center(std::cos(theta), std::sin(theta), 0.0f);
+
+        for (int tube = 0; tube <= tubeSlices; ++tube)
+        {
+            float phi = TWO_PI * tube / tubeSlices;
+            glm::vec3 normal = center * std::cos(phi) + glm::vec3(0.0f, 0.0f, std::sin(phi));
+            AddVertex(mesh, center + normal * tubeRadius, normal, glm::vec2((float)ring / ringSlices, (float)tube / tubeSlices));
+        }
+    }
+
+    uint32_t rowLength = tubeSlices + 1;
+    for (int ring = 0; ring < ringSlices; ++ring)
+    {
+        for (int tube = 0; tube < tubeSlices; ++tube)
+        {
+            uint32_t a = ring * rowLength + tube;
+            uint32_t b = a + rowLength;
+            AddTriangle(mesh, a, b, a + 1);
+            AddTriangle(mesh, a + 1, b, b + 1);
+        }
+    }
+}
+
+/***********************************************************
+ *  AddSides()
+ *
+ *  This method adds the wall of a cylinder, tapered cylinder
+ *  or cone between Y = 0 and Y = 1. A zero top radius makes
+ *  a cone, whose apex keeps a separate normal per slice.
+ *
+ *  Texture mapping follows ShapeMeshes: the seam lies on +X
+ *  and U runs from there toward -Z, narrowing with the wall
+ *  so the texture is not stretched on a tapered top. A cone
+ *  instead takes the texture projected down from above.
+ ***********************************************************/
+void ShapeGeometry::AddSides(SHAPE_MESH& mesh, int slices, float bottomRadius, float topRadius)
+{
+    uint32_t first = (uint32_t)mesh.vertices.size();
+    float slope = bottomRadius - topRadius;
+
+    for (int row = 0; row <= 1; ++row)
+    {
+        float radius = row ? topRadius : bottomRadius;
+        for (int slice = 0; slice <= slices; ++slice)
+        {
+            float theta = TWO_PI * slice / slices;
+            float s = std::sin(theta);
+            float c = std::cos(theta);
+            float scale = radius / bottomRadius;
+            glm::vec3 normal = glm::normalize(glm::vec3(c, slope, -s));
+
+            glm::vec2 uv(0.5f + ((float)slice / slices - 0.5f) * scale, (float)row);
+            if (topRadius <= 0.0f)
+                uv = glm::vec2(0.5f + 0.5f * scale * c, 0.5f + 0.5f * scale * s);
+            AddVertex(mesh, glm::vec3(radius * c, (float)row, -radius * s), normal, uv);
+        }
+    }
+
+    uint32_t rowLength = slices + 1;
+    for (int slice = 0; slice < slices; ++slice)
+    {
+        uint32_t bottom = first + slice;
+        uint32_t top = bottom + rowLength;
+
+        AddTriangle(mesh, bottom, bottom + 1, top + 1);
+        if (topRadius > 0.0f)
+            AddTriangle(mesh, bottom, top + 1, top);
+    }
+}
+
+/***********************************************************
+ *  AddCap()
+ *
+ *  This method adds a disc whose texture is laid over it as
+ *  in ShapeMeshes, with U along Z and V along X.
+ ***********************************************************/
+void ShapeGeometry::AddCap(SHAPE_MESH& mesh, int slices, float radius, float height, bool facingUp)
+{
+    uint32_t center = (uint32_t)mesh.vertices.size();
+    glm::vec3 normal(0.0f, facingUp ? 1.0f : -1.0f, 0.0f);
+
+    AddVertex(mesh, glm::vec3(0.0f, height, 0.0f), normal, glm::vec2(0.5f, 0.5f));
+    for (int slice = 0; slice <= slices; ++slice)
+    {
+        float theta = TWO_PI * slice / slices;
+        float s = std::sin(theta);
+        float c = std::cos(theta);
+        AddVertex(mesh, glm::vec3(radius * c, height, -radius * s), normal, glm::vec2(0.5f - 0.5f * s, 0.5f + 0.5f * c));
+    }
+
+    for (int slice = 0; slice < slices; ++slice)
+    {
+        uint32_t a = center + 1 + slice;
+        if (facingUp)
+            AddTriangle(mesh, center, a, a + 1);
+        else
+            AddTriangle(mesh, center, a + 1, a);
+    }
+}
@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////
+// ShapeGeometry.h
+// ===============
+// CPU-side generation of the basic shapes drawn by the scene
+//
+//  Produces indexed triangle lists with the same placement, size and
+//  texture mapping as ShapeMeshes, so that renderers which need direct
+//  access to vertex and index data can draw the same primitives. Normals
+//  are the smooth surface normals rather than ShapeMeshes' per-facet ones.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  ShapeGeometry
+ *
+ *  This class builds vertex and index data for the basic
+ *  3D shapes. All shapes are centered on the Y axis:
+ *    plane             2 x 2 in XZ, facing +Y
+ *    box               1 x 1 x 1, centered on the origin
+ *    sphere            radius 1, centered on the origin
+ *    cylinder, cone    radius 1, from Y = 0 to Y = 1
+ *    tapered cylinder  radius 1 at Y = 0, 0.5 at Y = 1
+ *    torus             ring radius 1 in the XY plane
+ ***********************************************************/
+class ShapeGeometry
+{
+public:
+    // interleaved vertex, matching shader locations 0, 1 and 2
+    struct SHAPE_VERTEX
+    {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec2 uv;
+    };
+
+    // indexed triangle list
+    struct SHAPE_MESH
+    {
+        std::vector<SHAPE_VERTEX> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    static void BuildPlane(SHAPE_MESH& mesh);
+    static void BuildBox(SHAPE_MESH& mesh);
+    static void BuildSphere(SHAPE_MESH& mesh, int slices, int stacks);
+    static void BuildCylinder(SHAPE_MESH& mesh, int slices, bool drawTop, bool drawBottom, bool drawSides);
+    static void BuildTaperedCylinder(SHAPE_MESH& mesh, int slices, bool drawTop, bool drawBottom, bool drawSides);
+    static void BuildCone(SHAPE_MESH& mesh, int slices, bool drawBottom);
+    static void BuildTorus(SHAPE_MESH& mesh, int ringSlices, int tubeSlices, float tubeRadius);
+
+private:
+    // side wall between two radii, shared by cylinders and cones
+    static void AddSides(SHAPE_MESH& mesh, int slices, float bottomRadius, float topRadius);
+    // flat disc closing a side wall at the given height
+    static void AddCap(SHAPE_MESH& mesh, int slices, float radius, float height, bool facingUp);
+};
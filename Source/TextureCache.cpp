@@ -0,0 +1,352 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureCache.cpp
+// ================
+// Shares one texture array layer between every request for the same image
+//
+//  Textures are keyed by file path and by a hash of the file contents, so
+//  loading the same image again, under a new tag or through a different
+//  path, returns the existing layer instead of decoding and uploading
+//  another copy. Each layer is reference counted and freed with its last
+//  user. New images are decoded in the background; their layers show a
+//  placeholder until the upload completes.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureCache.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace
+{
+    const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+    const uint64_t FNV_PRIME = 1099511628211ull;
+
+    // mid grey, close to the average of the scene's wood textures
+    const unsigned char PLACEHOLDER_PIXEL[4] = { 128, 128, 128, 255 };
+
+    // layers allocated up front, doubled whenever the array is full
+    const int INITIAL_LAYER_CAPACITY = 4;
+
+}
+
+/***********************************************************
+ *  TextureCache()
+ ***********************************************************/
+TextureCache::TextureCache()
+{
+    m_format = TextureCooker::FORMAT_RGBA8;
+    m_placeholder.levels = nullptr;
+    m_arrayTexture = 0;
+    m_layerCapacity = 0;
+    m_usedLayers = 0;
+    m_stats = CACHE_STATS();
+}
+
+/***********************************************************
+ *  ~TextureCache()
+ ***********************************************************/
+TextureCache::~TextureCache()
+{
+    if (m_arrayTexture)
+        glDeleteTextures(1, &m_arrayTexture);
+}
+
+/***********************************************************
+ *  SetTextureFormat()
+ *
+ *  This method selects the format of the texture array and
+ *  of the cooked files. Block compressed formats fall back
+ *  to RGBA8 when the driver lacks S3TC support.
+ ***********************************************************/
+void TextureCache::SetTextureFormat(TextureCooker::TEXTURE_FORMAT format)
+{
+    if (m_arrayTexture)
+        return;
+
+    if (TextureCooker::IsCompressed(format) && !GLEW_EXT_texture_compression_s3tc)
+    {
+        std::cout << "S3TC texture compression is not supported, using RGBA8" << std::endl;
+        format = TextureCooker::FORMAT_RGBA8;
+    }
+    m_format = format;
+    m_streamer.SetFormat(format);
+}
+
+/***********************************************************
+ *  Acquire()
+ *
+ *  This method returns the layer for the passed file. A
+ *  path seen before is served without touching the file; a
+ *  new path is read and hashed so that a copy of an image
+ *  already loaded is still shared. New contents get a layer
+ *  showing the placeholder right away and are queued to
+ *  decode in the background.
+ ***********************************************************/
+bool TextureCache::Acquire(const char* filename, int& layer)
+{
+    ++m_stats.requests;
+
+    auto path = m_pathLookup.find(filename);
+    if (path != m_pathLookup.end())
+    {
+        AddReference(path->second, layer);
+        return true;
+    }
+
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "Failed to load image: " << filename << std::endl;
+        return false;
+    }
+    std::vector<unsigned char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    uint64_t contentHash = HashContents(contents);
+    auto hash = m_hashLookup.find(contentHash);
+    if (hash != m_hashLookup.end())
+    {
+        m_pathLookup[filename] = hash->second;
+        AddReference(hash->second, layer);
+        return true;
+    }
+
+    CACHE_ENTRY entry;
+    entry.layer = AllocateLayer();
+    entry.contentHash = contentHash;
+    entry.decodeMilliseconds = 0.0;
+    entry.refCount = 1;
+    entry.sharedRequests = 0;
+    entry.resident = false;
+
+    size_t entryIndex = m_entries.size();
+    m_entries.push_back(entry);
+    m_pathLookup[filename] = entryIndex;
+    m_hashLookup[contentHash] = entryIndex;
+    ++m_stats.uniqueTextures;
+
+    m_streamer.QueueDecode(entry.layer, filename, contentHash, std::move(contents));
+
+    layer = entry.layer;
+    return true;
+}
+
+/***********************************************************
+ *  Release()
+ ***********************************************************/
+void TextureCache::Release(int layer)
+{
+    for (size_t i = 0; i < m_entries.size(); ++i)
+    {
+        CACHE_ENTRY& entry = m_entries[i];
+        if (entry.refCount <= 0 || entry.layer != layer)
+            continue;
+
+        if (--entry.refCount > 0)
+            return;
+
+        // a layer still loading is freed once its upload lands
+        if (entry.resident)
+        {
+            m_freeLayers.push_back(entry.layer);
+            entry.layer = -1;
+        }
+        m_hashLookup.erase(entry.contentHash);
+        for (auto path = m_pathLookup.begin(); path != m_pathLookup.end();)
+        {
+            if (path->second == i)
+                path = m_pathLookup.erase(path);
+            else
+                ++path;
+        }
+        return;
+    }
+}
+
+/***********************************************************
+ *  ProcessUploads()
+ *
+ *  This method is called once per frame to upload images
+ *  loaded since the last call, each with its full mipmap
+ *  chain. Layers keep their index when the image replaces
+ *  the placeholder, so draws that already reference them
+ *  need no change.
+ ***********************************************************/
+int TextureCache::ProcessUploads()
+{
+    int pending = m_streamer.ProcessUploads(m_arrayTexture, m_completed);
+
+    for (const TextureStreamer::COMPLETED_UPLOAD& upload : m_completed)
+    {
+        if (upload.fromCookedFile)
+            ++m_stats.cookedLoads;
+
+        for (CACHE_ENTRY& entry : m_entries)
+        {
+            if (entry.resident || entry.layer != upload.layer)
+                continue;
+
+            entry.resident = true;
+            entry.decodeMilliseconds = upload.decodeMilliseconds;
+            m_stats.textureBytes += TextureCooker::GetChainBytes(m_format, TextureStreamer::LAYER_SIZE);
+            m_stats.decodeMilliseconds += upload.decodeMilliseconds;
+
+            if (entry.refCount <= 0)
+            {
+                m_freeLayers.push_back(entry.layer);
+                entry.layer = -1;
+            }
+            break;
+        }
+    }
+
+    if (pending == 0 && !m_completed.empty())
+        PrintStats();
+    return pending;
+}
+
+/***********************************************************
+ *  GetArrayTexture()
+ ***********************************************************/
+GLuint TextureCache::GetArrayTexture() const
+{
+    return m_arrayTexture;
+}
+
+/***********************************************************
+ *  GetStats()
+ *
+ *  This method totals the savings of every shared request,
+ *  including requests made before the image had loaded.
+ ***********************************************************/
+TextureCache::CACHE_STATS TextureCache::GetStats() const
+{
+    CACHE_STATS stats = m_stats;
+    size_t layerBytes = TextureCooker::GetChainBytes(m_format, TextureStreamer::LAYER_SIZE);
+    stats.bytesSaved = 0;
+    stats.decodeMillisecondsSaved = 0.0;
+    for (const CACHE_ENTRY& entry : m_entries)
+    {
+        stats.bytesSaved += layerBytes * entry.sharedRequests;
+        stats.decodeMillisecondsSaved += entry.decodeMilliseconds * entry.sharedRequests;
+    }
+    return stats;
+}
+
+/***********************************************************
+ *  PrintStats()
+ ***********************************************************/
+void TextureCache::PrintStats() const
+{
+    CACHE_STATS stats = GetStats();
+    std::cout << "INFO: texture cache  " << stats.requests << " requests  "
+        << stats.uniqueTextures << " textures  "
+        << stats.cookedLoads << " from cooked files  "
+        << stats.textureBytes / 1024 << " KB in VRAM  "
+        << stats.bytesSaved / 1024 << " KB saved  "
+        << stats.decodeMillisecondsSaved << " ms decode avoided" << std::endl;
+}
+
+/***********************************************************
+ *  AddReference()
+ ***********************************************************/
+void TextureCache::AddReference(size_t entryIndex, int& layer)
+{
+    CACHE_ENTRY& entry = m_entries[entryIndex];
+    ++entry.refCount;
+    ++entry.sharedRequests;
+    layer = entry.layer;
+}
+
+/***********************************************************
+ *  AllocateLayer()
+ ***********************************************************/
+int TextureCache::AllocateLayer()
+{
+    int layer;
+    if (!m_freeLayers.empty())
+    {
+        layer = m_freeLayers.back();
+        m_freeLayers.pop_back();
+    }
+    else
+    {
+        if (m_usedLayers == m_layerCapacity)
+            GrowArray(m_layerCapacity ? m_layerCapacity * 2 : INITIAL_LAYER_CAPACITY);
+        layer = m_usedLayers++;
+    }
+
+    FillPlaceholder(layer);
+    return layer;
+}
+
+/***********************************************************
+ *  GrowArray()
+ *
+ *  This method allocates immutable storage for the larger
+ *  array and copies every mip level of the existing layers
+ *  across on the GPU before deleting the old array. The
+ *  new array is left bound, as the old one was.
+ ***********************************************************/
+void TextureCache::GrowArray(int layerCapacity)
+{
+    int mipLevels = TextureCooker::GetMipLevelCount(TextureStreamer::LAYER_SIZE);
+    GLenum internalFormat = TextureCooker::GetInternalFormat(m_format);
+
+    GLuint arrayTexture = 0;
+    glGenTextures(1, &arrayTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrayTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, mipLevels, internalFormat, TextureStreamer::LAYER_SIZE, TextureStreamer::LAYER_SIZE, layerCapacity);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    if (m_arrayTexture)
+    {
+        for (int level = 0; level < mipLevels; ++level)
+        {
+            int size = TextureStreamer::LAYER_SIZE >> level;
+            glCopyImageSubData(m_arrayTexture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                arrayTexture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, size, size, m_usedLayers);
+        }
+        glDeleteTextures(1, &m_arrayTexture);
+    }
+
+    m_arrayTexture = arrayTexture;
+    m_layerCapacity = layerCapacity;
+}
+
+/***********************************************************
+ *  FillPlaceholder()
+ *
+ *  This method uploads the placeholder mip chain, cooked
+ *  once in the array's format, into a layer.
+ ***********************************************************/
+void TextureCache::FillPlaceholder(int layer)
+{
+    if (!m_placeholder.levels)
+    {
+        std::vector<unsigned char> pixels((size_t)TextureStreamer::LAYER_SIZE * TextureStreamer::LAYER_SIZE * 4);
+        for (size_t i = 0; i < pixels.size(); i += 4)
+            memcpy(&pixels[i], PLACEHOLDER_PIXEL, 4);
+        TextureCooker::Cook(pixels.data(), TextureStreamer::LAYER_SIZE, m_format, m_placeholder);
+    }
+
+    TextureStreamer::UploadLevels(m_arrayTexture, layer, m_placeholder, m_placeholder.levels);
+}
+
+/***********************************************************
+ *  HashContents()
+ ***********************************************************/
+uint64_t TextureCache::HashContents(const std::vector<unsigned char>& contents)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (unsigned char byte : contents)
+    {
+        hash ^= byte;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
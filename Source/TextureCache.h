@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureCache.h
+// ==============
+// Shares one texture array layer between every request for the same image
+//
+//  Textures are keyed by file path and by a hash of the file contents, so
+//  loading the same image again, under a new tag or through a different
+//  path, returns the existing layer instead of decoding and uploading
+//  another copy. Each layer is reference counted and freed with its last
+//  user. New images are decoded in the background; their layers show a
+//  placeholder until the upload completes.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "TextureStreamer.h"
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/***********************************************************
+ *  TextureCache
+ *
+ *  This class loads images into the layers of a single
+ *  GL_TEXTURE_2D_ARRAY and hands out shared references to
+ *  them by layer index. The array grows as layers are
+ *  needed, so the number of textures is not bounded by the
+ *  texture units, and drawing needs only the one binding.
+ ***********************************************************/
+class TextureCache
+{
+public:
+    // totals over every request made to the cache
+    struct CACHE_STATS
+    {
+        int requests;
+        int uniqueTextures;
+        int cookedLoads;
+        size_t textureBytes;
+        size_t bytesSaved;
+        double decodeMilliseconds;
+        double decodeMillisecondsSaved;
+    };
+
+    // constructor
+    TextureCache();
+    // destructor
+    ~TextureCache();
+
+    // storage format of the array, set before the first Acquire
+    void SetTextureFormat(TextureCooker::TEXTURE_FORMAT format);
+    // get a reference to the array layer holding an image file
+    bool Acquire(const char* filename, int& layer);
+    // drop a reference, freeing the layer with the last one
+    void Release(int layer);
+    // swap in finished images, returning how many are still loading
+    int ProcessUploads();
+
+    // the texture array holding every layer, changes when it grows
+    GLuint GetArrayTexture() const;
+
+    // sharing statistics
+    CACHE_STATS GetStats() const;
+    void PrintStats() const;
+
+private:
+    // one array layer and the cost of filling it
+    struct CACHE_ENTRY
+    {
+        int layer;
+        uint64_t contentHash;
+        double decodeMilliseconds;
+        int refCount;
+        // requests served by this entry after the first
+        int sharedRequests;
+        bool resident;
+    };
+
+    std::vector<CACHE_ENTRY> m_entries;
+    // file path and content hash to index in m_entries
+    std::unordered_map<std::string, size_t> m_pathLookup;
+    std::unordered_map<uint64_t, size_t> m_hashLookup;
+
+    // texture array storage
+    TextureCooker::TEXTURE_FORMAT m_format;
+    TextureCooker::COOKED_TEXTURE m_placeholder;
+    GLuint m_arrayTexture;
+    int m_layerCapacity;
+    int m_usedLayers;
+    std::vector<int> m_freeLayers;
+
+    CACHE_STATS m_stats;
+    TextureStreamer m_streamer;
+    std::vector<TextureStreamer::COMPLETED_UPLOAD> m_completed;
+
+    // count a request served by an existing entry
+    void AddReference(size_t entryIndex, int& layer);
+    // take a free layer, growing the array when none is left
+    int AllocateLayer();
+    // reallocate the array with more layers, keeping their contents
+    void GrowArray(int layerCapacity);
+    // fill every mip level of a layer with the placeholder color
+    void FillPlaceholder(int layer);
+    // 64-bit FNV-1a hash of a byte buffer
+    static uint64_t HashContents(const std::vector<unsigned char>& contents);
+};
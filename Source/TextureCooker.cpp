@@ -0,0 +1,451 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureCooker.cpp
+// =================
+// GPU-ready texture files with precomputed mipmap chains
+//
+//  The first load of an image cooks it into a small container file in the
+//  Cooked directory: a header naming the source hash, format and size,
+//  followed by every mip level in upload order, optionally block
+//  compressed. Later loads memory-map the cooked file and upload its
+//  levels directly, skipping image decoding and mipmap generation.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureCooker.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    const char* COOKED_DIRECTORY = "Cooked";
+    const char COOKED_MAGIC[4] = { 'C', 'T', 'E', 'X' };
+    // 2: images shrunk to the layer size are box filtered
+    const uint32_t COOKED_VERSION = 2;
+
+    // fixed-size header at the start of every cooked file
+    struct COOKED_HEADER
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        uint32_t format;
+        uint32_t size;
+        uint32_t mipLevels;
+        uint32_t reserved;
+        uint64_t levelsSize;
+    };
+
+    // RGB565 encode and decode of a block endpoint
+    uint16_t PackColor(const int color[3])
+    {
+        int r = (color[0] * 31 + 127) / 255;
+        int g = (color[1] * 63 + 127) / 255;
+        int b = (color[2] * 31 + 127) / 255;
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    void UnpackColor(uint16_t packed, int color[3])
+    {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+}
+
+/***********************************************************
+ *  Cook()
+ *
+ *  This method builds every mip level with a box filter,
+ *  then stores them back to back, compressing each level
+ *  when a block format is requested.
+ ***********************************************************/
+void TextureCooker::Cook(const unsigned char* pixels, int size, TEXTURE_FORMAT format, COOKED_TEXTURE& texture)
+{
+    texture.format = format;
+    texture.size = size;
+    texture.mipLevels = GetMipLevelCount(size);
+    texture.mappedFile.reset();
+    texture.storage.resize(GetChainBytes(format, size));
+
+    std::vector<unsigned char> level(pixels, pixels + (size_t)size * size * 4);
+    std::vector<unsigned char> nextLevel;
+    size_t offset = 0;
+
+    for (int mip = 0; mip < texture.mipLevels; ++mip)
+    {
+        int levelSize = std::max(1, size >> mip);
+        if (IsCompressed(format))
+            CompressLevel(level.data(), levelSize, format, &texture.storage[offset]);
+        else
+            memcpy(&texture.storage[offset], level.data(), level.size());
+        offset += GetLevelBytes(format, levelSize);
+
+        if (levelSize > 1)
+        {
+            Downsample(level.data(), levelSize, nextLevel);
+            level.swap(nextLevel);
+        }
+    }
+
+    texture.levels = texture.storage.data();
+    texture.levelsSize = texture.storage.size();
+}
+
+/***********************************************************
+ *  WriteCooked()
+ *
+ *  This method writes the file under a temporary name and
+ *  renames it into place, so a reader never maps a file that
+ *  is only partly written.
+ ***********************************************************/
+bool TextureCooker::WriteCooked(const std::string& filename, uint64_t sourceHash, const COOKED_TEXTURE& texture)
+{
+#ifdef _WIN32
+    _mkdir(COOKED_DIRECTORY);
+#else
+    mkdir(COOKED_DIRECTORY, 0755);
+#endif
+
+    COOKED_HEADER header;
+    memcpy(header.magic, COOKED_MAGIC, sizeof(header.magic));
+    header.version = COOKED_VERSION;
+    header.sourceHash = sourceHash;
+    header.format = (uint32_t)texture.format;
+    header.size = (uint32_t)texture.size;
+    header.mipLevels = (uint32_t)texture.mipLevels;
+    header.reserved = 0;
+    header.levelsSize = texture.levelsSize;
+
+    std::string temporaryFilename = filename + ".tmp";
+    {
+        std::ofstream file(temporaryFilename, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)texture.levels, (std::streamsize)texture.levelsSize);
+        if (!file)
+            return false;
+    }
+
+    std::remove(filename.c_str());
+    return std::rename(temporaryFilename.c_str(), filename.c_str()) == 0;
+}
+
+/***********************************************************
+ *  LoadCooked()
+ *
+ *  This method maps a cooked file and checks that it was
+ *  cooked from the same source contents, in the requested
+ *  format and size, and is complete. The levels are then
+ *  read straight from the mapping.
+ ***********************************************************/
+bool TextureCooker::LoadCooked(const std::string& filename, uint64_t sourceHash, TEXTURE_FORMAT format, int size, COOKED_TEXTURE& texture)
+{
+    std::unique_ptr<MappedFile> mappedFile(new MappedFile());
+    if (!mappedFile->Open(filename) || mappedFile->GetSize() < sizeof(COOKED_HEADER))
+        return false;
+
+    COOKED_HEADER header;
+    memcpy(&header, mappedFile->GetData(), sizeof(header));
+
+    size_t levelsSize = GetChainBytes(format, size);
+    if (memcmp(header.magic, COOKED_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != COOKED_VERSION ||
+        header.sourceHash != sourceHash ||
+        header.format != (uint32_t)format ||
+        header.size != (uint32_t)size ||
+        header.mipLevels != (uint32_t)GetMipLevelCount(size) ||
+        header.levelsSize != levelsSize ||
+        mappedFile->GetSize() < sizeof(COOKED_HEADER) + levelsSize)
+        return false;
+
+    texture.format = format;
+    texture.size = size;
+    texture.mipLevels = (int)header.mipLevels;
+    texture.storage.clear();
+    texture.levels = mappedFile->GetData() + sizeof(COOKED_HEADER);
+    texture.levelsSize = levelsSize;
+    texture.mappedFile = std::move(mappedFile);
+    return true;
+}
+
+/***********************************************************
+ *  GetCookedFilename()
+ ***********************************************************/
+std::string TextureCooker::GetCookedFilename(uint64_t sourceHash, TEXTURE_FORMAT format)
+{
+    static const char* const FORMAT_NAMES[] = { "rgba8", "bc1", "bc3" };
+
+    char name[48];
+    snprintf(name, sizeof(name), "%016llx_%s.ctex", (unsigned long long)sourceHash, FORMAT_NAMES[format]);
+    return std::string(COOKED_DIRECTORY) + "/" + name;
+}
+
+/***********************************************************
+ *  GetMipLevelCount()
+ ***********************************************************/
+int TextureCooker::GetMipLevelCount(int size)
+{
+    int levels = 1;
+    while (size > 1)
+    {
+        size /= 2;
+        ++levels;
+    }
+    return levels;
+}
+
+/***********************************************************
+ *  GetLevelBytes()
+ ***********************************************************/
+size_t TextureCooker::GetLevelBytes(TEXTURE_FORMAT format, int levelSize)
+{
+    size_t blocks = (size_t)((levelSize + 3) / 4);
+    switch (format)
+    {
+    case FORMAT_BC1:
+        return blocks * blocks * 8;
+    case FORMAT_BC3:
+        return blocks * blocks * 16;
+    default:
+        return (size_t)levelSize * levelSize * 4;
+    }
+}
+
+/***********************************************************
+ *  GetChainBytes()
+ ***********************************************************/
+size_t TextureCooker::GetChainBytes(TEXTURE_FORMAT format, int size)
+{
+    size_t bytes = 0;
+    int mipLevels = GetMipLevelCount(size);
+    for (int mip = 0; mip < mipLevels; ++mip)
+        bytes += GetLevelBytes(format, std::max(1, size >> mip));
+    return bytes;
+}
+
+/***********************************************************
+ *  GetInternalFormat()
+ ***********************************************************/
+GLenum TextureCooker::GetInternalFormat(TEXTURE_FORMAT format)
+{
+    switch (format)
+    {
+    case FORMAT_BC1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case FORMAT_BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    default:
+        return GL_RGBA8;
+    }
+}
+
+/***********************************************************
+ *  IsCompressed()
+ ***********************************************************/
+bool TextureCooker::IsCompressed(TEXTURE_FORMAT format)
+{
+    return format != FORMAT_RGBA8;
+}
+
+/***********************************************************
+ *  Downsample()
+ ***********************************************************/
+void TextureCooker::Downsample(const unsigned char* source, int sourceSize, std::vector<unsigned char>& destination)
+{
+    int size = std::max(1, sourceSize / 2);
+    destination.resize((size_t)size * size * 4);
+
+    for (int y = 0; y < size; ++y)
+    {
+        int y0 = std::min(y * 2, sourceSize - 1);
+        int y1 = std::min(y * 2 + 1, sourceSize - 1);
+        for (int x = 0; x < size; ++x)
+        {
+            int x0 = std::min(x * 2, sourceSize - 1);
+            int x1 = std::min(x * 2 + 1, sourceSize - 1);
+            for (int c = 0; c < 4; ++c)
+            {
+                int sum = source[((size_t)y0 * sourceSize + x0) * 4 + c] +
+                    source[((size_t)y0 * sourceSize + x1) * 4 + c] +
+                    source[((size_t)y1 * sourceSize + x0) * 4 + c] +
+                    source[((size_t)y1 * sourceSize + x1) * 4 + c];
+                destination[((size_t)y * size + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+/***********************************************************
+ *  CompressLevel()
+ *
+ *  This method compresses a level one 4 x 4 block at a time.
+ *  Levels smaller than a block repeat their edge pixels.
+ ***********************************************************/
+void TextureCooker::CompressLevel(const unsigned char* pixels, int levelSize, TEXTURE_FORMAT format, unsigned char* destination)
+{
+    int blocks = (levelSize + 3) / 4;
+    unsigned char block[64];
+
+    for (int blockY = 0; blockY < blocks; ++blockY)
+    {
+        for (int blockX = 0; blockX < blocks; ++blockX)
+        {
+            for (int y = 0; y < 4; ++y)
+            {
+                int sourceY = std::min(blockY * 4 + y, levelSize - 1);
+                for (int x = 0; x < 4; ++x)
+                {
+                    int sourceX = std::min(blockX * 4 + x, levelSize - 1);
+                    memcpy(&block[(y * 4 + x) * 4], &pixels[((size_t)sourceY * levelSize + sourceX) * 4], 4);
+                }
+            }
+
+            if (format == FORMAT_BC3)
+            {
+                CompressAlphaBlock(block, destination);
+                destination += 8;
+            }
+            CompressColorBlock(block, destination);
+            destination += 8;
+        }
+    }
+}
+
+/***********************************************************
+ *  CompressColorBlock()
+ *
+ *  This method encodes the colors of a block as BC1. The
+ *  endpoints are the corners of the block's color bounding
+ *  box, inset slightly, and every pixel takes the nearest
+ *  of the four palette colors.
+ ***********************************************************/
+void TextureCooker::CompressColorBlock(const unsigned char block[64], unsigned char* destination)
+{
+    int minimum[3] = { 255, 255, 255 };
+    int maximum[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            minimum[c] = std::min(minimum[c], (int)block[i * 4 + c]);
+            maximum[c] = std::max(maximum[c], (int)block[i * 4 + c]);
+        }
+    }
+    for (int c = 0; c < 3; ++c)
+    {
+        int inset = (maximum[c] - minimum[c]) / 16;
+        minimum[c] += inset;
+        maximum[c] -= inset;
+    }
+
+    uint16_t color0 = PackColor(maximum);
+    uint16_t color1 = PackColor(minimum);
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    int palette[4][3];
+    UnpackColor(color0, palette[0]);
+    UnpackColor(color1, palette[1]);
+    for (int c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    // equal endpoints select three-color mode, where index 0 is still exact
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            int bestIndex = 0;
+            int bestDistance = INT32_MAX;
+            for (int p = 0; p < 4; ++p)
+            {
+                int distance = 0;
+                for (int c = 0; c < 3; ++c)
+                {
+                    int difference = block[i * 4 + c] - palette[p][c];
+                    distance += difference * difference;
+                }
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    bestIndex = p;
+                }
+            }
+            indices |= (uint32_t)bestIndex << (i * 2);
+        }
+    }
+
+    destination[0] = (unsigned char)(color0 & 0xFF);
+    destination[1] = (unsigned char)(color0 >> 8);
+    destination[2] = (unsigned char)(color1 & 0xFF);
+    destination[3] = (unsigned char)(color1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        destination[4 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+/***********************************************************
+ *  CompressAlphaBlock()
+ *
+ *  This method encodes the alpha of a block as the first
+ *  half of a BC3 block, using the eight-value mode between
+ *  the block's lowest and highest alpha.
+ ***********************************************************/
+void TextureCooker::CompressAlphaBlock(const unsigned char block[64], unsigned char* destination)
+{
+    int alpha0 = 0;
+    int alpha1 = 255;
+    for (int i = 0; i < 16; ++i)
+    {
+        alpha0 = std::max(alpha0, (int)block[i * 4 + 3]);
+        alpha1 = std::min(alpha1, (int)block[i * 4 + 3]);
+    }
+
+    uint64_t indices = 0;
+    if (alpha0 != alpha1)
+    {
+        int palette[8];
+        palette[0] = alpha0;
+        palette[1] = alpha1;
+        for (int p = 1; p < 7; ++p)
+            palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+
+        for (int i = 0; i < 16; ++i)
+        {
+            int alpha = block[i * 4 + 3];
+            int bestIndex = 0;
+            int bestDistance = 256;
+            for (int p = 0; p < 8; ++p)
+            {
+                int distance = std::abs(alpha - palette[p]);
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    bestIndex = p;
+                }
+            }
+            indices |= (uint64_t)bestIndex << (i * 3);
+        }
+    }
+
+    destination[0] = (unsigned char)alpha0;
+    destination[1] = (unsigned char)alpha1;
+    for (int i = 0; i < 6; ++i)
+        destination[2 + i] = (unsigned char)(indices >> (i * 8));
+}
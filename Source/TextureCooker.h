@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureCooker.h
+// ===============
+// GPU-ready texture files with precomputed mipmap chains
+//
+//  The first load of an image cooks it into a small container file in the
+//  Cooked directory: a header naming the source hash, format and size,
+//  followed by every mip level in upload order, optionally block
+//  compressed. Later loads memory-map the cooked file and upload its
+//  levels directly, skipping image decoding and mipmap generation.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "MappedFile.h"
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  TextureCooker
+ *
+ *  This class builds, writes and validates cooked textures.
+ *  All cooked textures are square with power of two sizes.
+ ***********************************************************/
+class TextureCooker
+{
+public:
+    // storage formats of the cooked levels
+    enum TEXTURE_FORMAT
+    {
+        FORMAT_RGBA8 = 0,
+        FORMAT_BC1,
+        FORMAT_BC3
+    };
+
+    // every mip level of one texture, owned or memory-mapped
+    struct COOKED_TEXTURE
+    {
+        TEXTURE_FORMAT format;
+        int size;
+        int mipLevels;
+        const unsigned char* levels;
+        size_t levelsSize;
+        std::vector<unsigned char> storage;
+        std::unique_ptr<MappedFile> mappedFile;
+    };
+
+    // cook RGBA8 pixels of a square image into a full mip chain
+    static void Cook(const unsigned char* pixels, int size, TEXTURE_FORMAT format, COOKED_TEXTURE& texture);
+    // write a cooked texture to its file, tagged with the source hash
+    static bool WriteCooked(const std::string& filename, uint64_t sourceHash, const COOKED_TEXTURE& texture);
+    // map a cooked file, false if missing or not matching the request
+    static bool LoadCooked(const std::string& filename, uint64_t sourceHash, TEXTURE_FORMAT format, int size, COOKED_TEXTURE& texture);
+
+    // cooked file name for a source image hash and format
+    static std::string GetCookedFilename(uint64_t sourceHash, TEXTURE_FORMAT format);
+
+    // level layout and GL formats
+    static int GetMipLevelCount(int size);
+    static size_t GetLevelBytes(TEXTURE_FORMAT format, int levelSize);
+    static size_t GetChainBytes(TEXTURE_FORMAT format, int size);
+    static GLenum GetInternalFormat(TEXTURE_FORMAT format);
+    static bool IsCompressed(TEXTURE_FORMAT format);
+
+private:
+    // halve an RGBA8 level with a 2 x 2 box filter
+    static void Downsample(const unsigned char* source, int sourceSize, std::vector<unsigned char>& destination);
+    // block compress an RGBA8 level
+    static void CompressLevel(const unsigned char* pixels, int levelSize, TEXTURE_FORMAT format, unsigned char* destination);
+    static void CompressColorBlock(const unsigned char block[64], unsigned char* destination);
+    static void CompressAlphaBlock(const unsigned char block[64], unsigned char* destination);
+};
@@ -0,0 +1,424 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureStreamer.cpp
+// ===================
+// Background image decoding and staged texture uploads
+//
+//  Image files are decoded on a pool of worker threads, resampled to the
+//  layer size of the scene's texture array and cooked into a full mip
+//  chain, or read from a previously cooked file. The levels are copied on
+//  the render thread into a persistently mapped pixel buffer and uploaded
+//  from there, with a fence on each staging slot so a slot is only
+//  rewritten once the GPU has finished reading it.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureStreamer.h"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    // one uncompressed mip chain per staging slot, the largest format
+    const size_t STAGING_SLOT_BYTES = TextureCooker::GetChainBytes(TextureCooker::FORMAT_RGBA8, TextureStreamer::LAYER_SIZE);
+    const unsigned int MAX_WORKERS = 4;
+
+    // one source pixel contributing to a resampled pixel
+    struct FILTER_TAP
+    {
+        int index;
+        float weight;
+    };
+
+    /***********************************************************
+     *  BuildFilterTaps()
+     *
+     *  Source pixels and weights of each destination pixel
+     *  along one axis. Shrinking averages every source pixel
+     *  the destination pixel covers, weighted by how much of
+     *  it is covered, so detail finer than the destination
+     *  does not alias. Growing interpolates bilinearly.
+     ***********************************************************/
+    void BuildFilterTaps(int sourceSize, int size, std::vector<int>& offsets, std::vector<FILTER_TAP>& taps)
+    {
+        offsets.assign(1, 0);
+        taps.clear();
+
+        float scale = (float)sourceSize / size;
+        for (int i = 0; i < size; ++i)
+        {
+            if (sourceSize > size)
+            {
+                float start = i * scale;
+                float end = start + scale;
+                int last = std::min((int)std::ceil(end), sourceSize);
+                for (int source = (int)start; source < last; ++source)
+                {
+                    float covered = std::min(end, source + 1.0f) - std::max(start, (float)source);
+                    if (covered > 0.0f)
+                        taps.push_back({ source, covered / scale });
+                }
+            }
+            else
+            {
+                float source = std::max(0.0f, (i + 0.5f) * scale - 0.5f);
+                int first = std::min((int)source, sourceSize - 1);
+                int second = std::min(first + 1, sourceSize - 1);
+                float blend = source - first;
+                taps.push_back({ first, 1.0f - blend });
+                if (blend > 0.0f)
+                    taps.push_back({ second, blend });
+            }
+            offsets.push_back((int)taps.size());
+        }
+    }
+
+    /***********************************************************
+     *  ResampleImage()
+     *
+     *  Resample of an RGBA image to a square of the passed
+     *  size, box filtered along an axis that shrinks and
+     *  bilinear along one that grows. Texture coordinates are
+     *  normalized, so the change of aspect ratio is invisible
+     *  when sampling.
+     ***********************************************************/
+    void ResampleImage(const unsigned char* source, int width, int height, std::vector<unsigned char>& destination, int size)
+    {
+        destination.resize((size_t)size * size * 4);
+        if (width == size && height == size)
+        {
+            memcpy(destination.data(), source, destination.size());
+            return;
+        }
+
+        std::vector<int> columnOffsets, rowOffsets;
+        std::vector<FILTER_TAP> columnTaps, rowTaps;
+        BuildFilterTaps(width, size, columnOffsets, columnTaps);
+        BuildFilterTaps(height, size, rowOffsets, rowTaps);
+
+        // one destination row, summed over its source rows
+        std::vector<float> row((size_t)size * 4);
+        for (int y = 0; y < size; ++y)
+        {
+            std::fill(row.begin(), row.end(), 0.0f);
+            for (int r = rowOffsets[y]; r < rowOffsets[y + 1]; ++r)
+            {
+                const unsigned char* sourceRow = source + (size_t)rowTaps[r].index * width * 4;
+                for (int x = 0; x < size; ++x)
+                {
+                    float* out = &row[(size_t)x * 4];
+                    for (int c = columnOffsets[x]; c < columnOffsets[x + 1]; ++c)
+                    {
+                        const unsigned char* pixel = sourceRow + (size_t)columnTaps[c].index * 4;
+                        float weight = rowTaps[r].weight * columnTaps[c].weight;
+                        for (int channel = 0; channel < 4; ++channel)
+                            out[channel] += pixel[channel] * weight;
+                    }
+                }
+            }
+
+            unsigned char* out = &destination[(size_t)y * size * 4];
+            for (size_t i = 0; i < row.size(); ++i)
+                out[i] = (unsigned char)std::min(row[i] + 0.5f, 255.0f);
+        }
+    }
+}
+
+/***********************************************************
+ *  TextureStreamer()
+ ***********************************************************/
+TextureStreamer::TextureStreamer()
+{
+    m_stopping = false;
+    m_pending = 0;
+    m_format = TextureCooker::FORMAT_RGBA8;
+    m_stagingBuffer = 0;
+    m_stagingMemory = nullptr;
+    for (int i = 0; i < STAGING_SLOT_COUNT; ++i)
+    {
+        m_slots[i].offset = i * STAGING_SLOT_BYTES;
+        m_slots[i].fence = 0;
+    }
+    m_nextSlot = 0;
+}
+
+/***********************************************************
+ *  ~TextureStreamer()
+ ***********************************************************/
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_jobReady.notify_all();
+    for (std::thread& worker : m_workers)
+        worker.join();
+
+    for (STAGING_SLOT& slot : m_slots)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+    }
+    if (m_stagingBuffer)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_stagingBuffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &m_stagingBuffer);
+    }
+}
+
+/***********************************************************
+ *  Start()
+ *
+ *  This method starts the decode workers and creates the
+ *  staging buffer. Without buffer storage support (GL 4.4)
+ *  uploads fall back to reading from client memory.
+ ***********************************************************/
+void TextureStreamer::Start()
+{
+    // the flip setting is global in stb_image and read by every
+    // decode, so it is set once before any worker can run
+    stbi_set_flip_vertically_on_load(true);
+
+    unsigned int workerCount = std::max(1u, std::min(MAX_WORKERS, std::thread::hardware_concurrency() - 1));
+    for (unsigned int i = 0; i < workerCount; ++i)
+        m_workers.emplace_back(&TextureStreamer::WorkerLoop, this);
+
+    if (!GLEW_ARB_buffer_storage)
+        return;
+
+    GLsizeiptr size = STAGING_SLOT_COUNT * STAGING_SLOT_BYTES;
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &m_stagingBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_stagingBuffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+    m_stagingMemory = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (!m_stagingMemory)
+    {
+        std::cout << "Failed to map texture staging buffer, uploading directly" << std::endl;
+        glDeleteBuffers(1, &m_stagingBuffer);
+        m_stagingBuffer = 0;
+    }
+}
+
+/***********************************************************
+ *  SetFormat()
+ ***********************************************************/
+void TextureStreamer::SetFormat(TextureCooker::TEXTURE_FORMAT format)
+{
+    m_format = format;
+}
+
+/***********************************************************
+ *  QueueDecode()
+ ***********************************************************/
+void TextureStreamer::QueueDecode(int layer, const std::string& filename, uint64_t contentHash, std::vector<unsigned char>&& contents)
+{
+    if (m_workers.empty())
+        Start();
+
+    DECODE_JOB job;
+    job.layer = layer;
+    job.filename = filename;
+    job.contentHash = contentHash;
+    job.contents = std::move(contents);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_jobReady.notify_one();
+    ++m_pending;
+}
+
+/***********************************************************
+ *  WorkerLoop()
+ ***********************************************************/
+void TextureStreamer::WorkerLoop()
+{
+    for (;;)
+    {
+        DECODE_JOB job;
+        TextureCooker::TEXTURE_FORMAT format;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobReady.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+            if (m_stopping)
+                return;
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            format = m_format;
+        }
+
+        DECODED_IMAGE image;
+        LoadImage(job, format, image);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_decoded.push_back(std::move(image));
+    }
+}
+
+/***********************************************************
+ *  LoadImage()
+ *
+ *  This method maps the cooked file for the job's contents
+ *  when a valid one exists. Otherwise it decodes the image,
+ *  resamples it to the layer size, cooks the mip chain and
+ *  writes the cooked file for the next launch. The time
+ *  recorded is the full cost of the decode path.
+ ***********************************************************/
+void TextureStreamer::LoadImage(DECODE_JOB& job, TextureCooker::TEXTURE_FORMAT format, DECODED_IMAGE& image)
+{
+    image.layer = job.layer;
+    image.filename = job.filename;
+    image.loaded = false;
+    image.fromCookedFile = false;
+    image.decodeMilliseconds = 0.0;
+
+    std::string cookedFilename = TextureCooker::GetCookedFilename(job.contentHash, format);
+    if (TextureCooker::LoadCooked(cookedFilename, job.contentHash, format, LAYER_SIZE, image.texture))
+    {
+        image.loaded = true;
+        image.fromCookedFile = true;
+        return;
+    }
+
+    // every layer is RGBA, so decode with four channels
+    int width = 0, height = 0, colorChannels = 0;
+    std::chrono::steady_clock::time_point decodeStart = std::chrono::steady_clock::now();
+    unsigned char* pixels = stbi_load_from_memory(job.contents.data(), (int)job.contents.size(),
+        &width, &height, &colorChannels, 4);
+    if (!pixels)
+        return;
+
+    std::vector<unsigned char> layerPixels;
+    ResampleImage(pixels, width, height, layerPixels, LAYER_SIZE);
+    stbi_image_free(pixels);
+    TextureCooker::Cook(layerPixels.data(), LAYER_SIZE, format, image.texture);
+
+    std::chrono::duration<double, std::milli> decodeTime = std::chrono::steady_clock::now() - decodeStart;
+    image.decodeMilliseconds = decodeTime.count();
+    image.loaded = true;
+
+    if (!TextureCooker::WriteCooked(cookedFilename, job.contentHash, image.texture))
+        std::cout << "Failed to write cooked texture: " << cookedFilename << std::endl;
+}
+
+/***********************************************************
+ *  ProcessUploads()
+ *
+ *  This method uploads decoded images until none are left or
+ *  every staging slot is still in use by the GPU, so it never
+ *  waits on a decode or a previous upload.
+ ***********************************************************/
+int TextureStreamer::ProcessUploads(GLuint arrayTexture, std::vector<COMPLETED_UPLOAD>& completed)
+{
+    completed.clear();
+    if (m_pending == 0)
+        return 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_decoded.empty())
+    {
+        DECODED_IMAGE& image = m_decoded.front();
+        lock.unlock();
+
+        COMPLETED_UPLOAD upload;
+        upload.layer = image.layer;
+        upload.decodeMilliseconds = image.decodeMilliseconds;
+        upload.fromCookedFile = image.fromCookedFile;
+        upload.loaded = false;
+
+        if (!image.loaded)
+        {
+            std::cout << "Failed to load image: " << image.filename << std::endl;
+        }
+        else
+        {
+            if (!Upload(arrayTexture, image))
+                break;
+            std::cout << "Successfully loaded image: " << image.filename << std::endl;
+            upload.loaded = true;
+        }
+
+        completed.push_back(upload);
+        --m_pending;
+
+        lock.lock();
+        m_decoded.pop_front();
+    }
+
+    return m_pending;
+}
+
+/***********************************************************
+ *  Upload()
+ ***********************************************************/
+bool TextureStreamer::Upload(GLuint arrayTexture, const DECODED_IMAGE& image)
+{
+    const unsigned char* source = image.texture.levels;
+    STAGING_SLOT* slot = nullptr;
+
+    if (m_stagingMemory)
+    {
+        slot = &m_slots[m_nextSlot];
+        if (slot->fence)
+        {
+            if (glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+                return false;
+            glDeleteSync(slot->fence);
+            slot->fence = 0;
+        }
+
+        memcpy(m_stagingMemory + slot->offset, image.texture.levels, image.texture.levelsSize);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_stagingBuffer);
+        source = (const unsigned char*)slot->offset;
+        m_nextSlot = (m_nextSlot + 1) % STAGING_SLOT_COUNT;
+    }
+
+    UploadLevels(arrayTexture, image.layer, image.texture, source);
+
+    if (slot)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    return true;
+}
+
+/***********************************************************
+ *  UploadLevels()
+ *
+ *  This method uploads the levels of a cooked texture from
+ *  the passed source, which is an offset into the bound
+ *  pixel unpack buffer when one is bound. The array is the
+ *  only texture the scene binds to this target, so it is
+ *  left bound rather than querying and restoring the old
+ *  binding on every upload.
+ ***********************************************************/
+void TextureStreamer::UploadLevels(GLuint arrayTexture, int layer, const TextureCooker::COOKED_TEXTURE& texture, const unsigned char* source)
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrayTexture);
+
+    GLenum internalFormat = TextureCooker::GetInternalFormat(texture.format);
+    bool compressed = TextureCooker::IsCompressed(texture.format);
+    size_t offset = 0;
+
+    for (int mip = 0; mip < texture.mipLevels; ++mip)
+    {
+        int levelSize = std::max(1, texture.size >> mip);
+        size_t levelBytes = TextureCooker::GetLevelBytes(texture.format, levelSize);
+        if (compressed)
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, mip, 0, 0, layer, levelSize, levelSize, 1, internalFormat, (GLsizei)levelBytes, source + offset);
+        else
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, mip, 0, 0, layer, levelSize, levelSize, 1, GL_RGBA, GL_UNSIGNED_BYTE, source + offset);
+        offset += levelBytes;
+    }
+}
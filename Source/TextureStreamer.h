@@ -0,0 +1,120 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureStreamer.h
+// =================
+// Background image decoding and staged texture uploads
+//
+//  Image files are decoded on a pool of worker threads, resampled to the
+//  layer size of the scene's texture array and cooked into a full mip
+//  chain, or read from a previously cooked file. The levels are copied on
+//  the render thread into a persistently mapped pixel buffer and uploaded
+//  from there, with a fence on each staging slot so a slot is only
+//  rewritten once the GPU has finished reading it.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "TextureCooker.h"
+
+#include <GL/glew.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/***********************************************************
+ *  TextureStreamer
+ *
+ *  This class fills texture array layers with decoded images
+ *  without blocking the render thread. Decoding is queued
+ *  per layer; ProcessUploads() is called once per frame to
+ *  upload whatever has finished.
+ ***********************************************************/
+class TextureStreamer
+{
+public:
+    // width and height of every texture array layer
+    static const int LAYER_SIZE = 1024;
+
+    // result of one finished texture load
+    struct COMPLETED_UPLOAD
+    {
+        int layer;
+        bool loaded;
+        bool fromCookedFile;
+        double decodeMilliseconds;
+    };
+
+    // constructor
+    TextureStreamer();
+    // destructor
+    ~TextureStreamer();
+
+    // format of the cooked levels, set before the first decode
+    void SetFormat(TextureCooker::TEXTURE_FORMAT format);
+    // decode the file contents in the background into an array layer
+    void QueueDecode(int layer, const std::string& filename, uint64_t contentHash, std::vector<unsigned char>&& contents);
+    // upload finished decodes, returning how many loads are still pending
+    int ProcessUploads(GLuint arrayTexture, std::vector<COMPLETED_UPLOAD>& completed);
+
+    // upload every mip level of a cooked texture into an array layer
+    static void UploadLevels(GLuint arrayTexture, int layer, const TextureCooker::COOKED_TEXTURE& texture, const unsigned char* source);
+
+private:
+    // file contents waiting for a worker
+    struct DECODE_JOB
+    {
+        int layer;
+        std::string filename;
+        uint64_t contentHash;
+        std::vector<unsigned char> contents;
+    };
+
+    // cooked levels waiting for an upload
+    struct DECODED_IMAGE
+    {
+        int layer;
+        std::string filename;
+        bool loaded;
+        bool fromCookedFile;
+        TextureCooker::COOKED_TEXTURE texture;
+        double decodeMilliseconds;
+    };
+
+    // region of the staging buffer and the fence guarding it
+    struct STAGING_SLOT
+    {
+        size_t offset;
+        GLsync fence;
+    };
+
+    static const int STAGING_SLOT_COUNT = 4;
+
+    // worker pool, queues shared with the workers
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_jobReady;
+    std::deque<DECODE_JOB> m_jobs;
+    std::deque<DECODED_IMAGE> m_decoded;
+    bool m_stopping;
+
+    // loads queued and not yet uploaded, render thread only
+    int m_pending;
+    TextureCooker::TEXTURE_FORMAT m_format;
+
+    // persistently mapped staging buffer
+    GLuint m_stagingBuffer;
+    unsigned char* m_stagingMemory;
+    STAGING_SLOT m_slots[STAGING_SLOT_COUNT];
+    int m_nextSlot;
+
+    // start the workers and map the staging buffer on first use
+    void Start();
+    void WorkerLoop();
+    // read the cooked file for a job, or decode and cook the image
+    void LoadImage(DECODE_JOB& job, TextureCooker::TEXTURE_FORMAT format, DECODED_IMAGE& image);
+    // upload one image, false if no staging slot is free yet
+    bool Upload(GLuint arrayTexture, const DECODED_IMAGE& image);
+};
@@ -0,0 +1,439 @@
+///////////////////////////////////////////////////////////////////////////////
+// TransformBatch.cpp
+// ==================
+// Composes many scale, rotation and translation inputs into matrices at once
+//
+//  Inputs are stored as structure of arrays, one array per component, so
+//  the SSE and AVX2 kernels load four or eight objects per instruction and
+//  only transpose when writing the finished column-major matrices. The
+//  fastest kernel the processor supports is picked at runtime from CPUID;
+//  the scalar kernel is the fallback and the reference.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TransformBatch.h"
+
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TRANSFORM_BATCH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// GCC and Clang only emit wider instructions in functions that ask for them
+#if defined(TRANSFORM_BATCH_X86) && defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+namespace
+{
+    const float DEGREES_TO_RADIANS = 0.01745329251994329577f;
+
+#ifdef TRANSFORM_BATCH_X86
+    // pi / 2 split so that the reduction stays exact for scene-sized angles
+    const float TWO_OVER_PI = 0.63661977236758134308f;
+    const float HALF_PI_1 = 1.5703125f;
+    const float HALF_PI_2 = 4.837512969970703125e-4f;
+    const float HALF_PI_3 = 7.54978995489188216e-8f;
+
+    // minimax polynomials for sin and cos on [-pi / 4, pi / 4]
+    const float SIN_1 = -1.6666654611e-1f;
+    const float SIN_2 = 8.3321608736e-3f;
+    const float SIN_3 = -1.9515295891e-4f;
+    const float COS_1 = 4.166664568298827e-2f;
+    const float COS_2 = -1.388731625493765e-3f;
+    const float COS_3 = 2.443315711809948e-5f;
+
+    /***********************************************************
+     *  SinCos4()
+     *
+     *  Sine and cosine of four angles: reduce to a quadrant,
+     *  evaluate both polynomials, then swap and negate them
+     *  for the quadrant.
+     ***********************************************************/
+    TARGET_SSE2 inline void SinCos4(__m128 x, __m128& sine, __m128& cosine)
+    {
+        __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(TWO_OVER_PI)));
+        __m128 q = _mm_cvtepi32_ps(quadrant);
+        __m128 y = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(HALF_PI_1)));
+        y = _mm_sub_ps(y, _mm_mul_ps(q, _mm_set1_ps(HALF_PI_2)));
+        y = _mm_sub_ps(y, _mm_mul_ps(q, _mm_set1_ps(HALF_PI_3)));
+        __m128 z = _mm_mul_ps(y, y);
+
+        __m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_3), z), _mm_set1_ps(SIN_2));
+        s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(SIN_1));
+        s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), y), y);
+
+        __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_3), z), _mm_set1_ps(COS_2));
+        c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(COS_1));
+        c = _mm_mul_ps(_mm_mul_ps(c, z), z);
+        c = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(z, _mm_set1_ps(0.5f))), c);
+
+        const __m128i one = _mm_set1_epi32(1);
+        const __m128i two = _mm_set1_epi32(2);
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+        __m128 sineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30));
+        __m128 cosineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30));
+
+        sine = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+        cosine = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+        sine = _mm_xor_ps(sine, sineSign);
+        cosine = _mm_xor_ps(cosine, cosineSign);
+    }
+
+    /***********************************************************
+     *  SinCos8()
+     ***********************************************************/
+    TARGET_AVX2 inline void SinCos8(__m256 x, __m256& sine, __m256& cosine)
+    {
+        __m256i quadrant = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(TWO_OVER_PI)));
+        __m256 q = _mm256_cvtepi32_ps(quadrant);
+        __m256 y = _mm256_fnmadd_ps(q, _mm256_set1_ps(HALF_PI_1), x);
+        y = _mm256_fnmadd_ps(q, _mm256_set1_ps(HALF_PI_2), y);
+        y = _mm256_fnmadd_ps(q, _mm256_set1_ps(HALF_PI_3), y);
+        __m256 z = _mm256_mul_ps(y, y);
+
+        __m256 s = _mm256_fmadd_ps(_mm256_set1_ps(SIN_3), z, _mm256_set1_ps(SIN_2));
+        s = _mm256_fmadd_ps(s, z, _mm256_set1_ps(SIN_1));
+        s = _mm256_fmadd_ps(_mm256_mul_ps(s, z), y, y);
+
+        __m256 c = _mm256_fmadd_ps(_mm256_set1_ps(COS_3), z, _mm256_set1_ps(COS_2));
+        c = _mm256_fmadd_ps(c, z, _mm256_set1_ps(COS_1));
+        c = _mm256_fmadd_ps(_mm256_mul_ps(c, z), z, _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), _mm256_set1_ps(1.0f)));
+
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256i two = _mm256_set1_epi32(2);
+        __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, one), one));
+        __m256 sineSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, two), 30));
+        __m256 cosineSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, one), two), 30));
+
+        sine = _mm256_xor_ps(_mm256_blendv_ps(s, c, swap), sineSign);
+        cosine = _mm256_xor_ps(_mm256_blendv_ps(c, s, swap), cosineSign);
+    }
+
+    /***********************************************************
+     *  StoreColumn4()
+     *
+     *  Transposes one column held as four rows across four
+     *  objects and writes it into each object's matrix. The
+     *  rows come by reference, as 32-bit MSVC passes only the
+     *  first three vector arguments in registers.
+     ***********************************************************/
+    TARGET_SSE2 inline void StoreColumn4(float* first, int column,
+        const __m128& row0, const __m128& row1, const __m128& row2, const __m128& row3)
+    {
+        __m128 object0 = row0;
+        __m128 object1 = row1;
+        __m128 object2 = row2;
+        __m128 object3 = row3;
+        _MM_TRANSPOSE4_PS(object0, object1, object2, object3);
+        _mm_storeu_ps(first + column * 4, object0);
+        _mm_storeu_ps(first + 16 + column * 4, object1);
+        _mm_storeu_ps(first + 32 + column * 4, object2);
+        _mm_storeu_ps(first + 48 + column * 4, object3);
+    }
+
+    /***********************************************************
+     *  StoreColumn8()
+     ***********************************************************/
+    TARGET_AVX2 inline void StoreColumn8(float* first, int column,
+        const __m256& row0, const __m256& row1, const __m256& row2, const __m256& row3)
+    {
+        StoreColumn4(first, column,
+            _mm256_castps256_ps128(row0), _mm256_castps256_ps128(row1),
+            _mm256_castps256_ps128(row2), _mm256_castps256_ps128(row3));
+        StoreColumn4(first + 64, column,
+            _mm256_extractf128_ps(row0, 1), _mm256_extractf128_ps(row1, 1),
+            _mm256_extractf128_ps(row2, 1), _mm256_extractf128_ps(row3, 1));
+    }
+
+    /***********************************************************
+     *  ReadCPUID()
+     ***********************************************************/
+    void ReadCPUID(int leaf, int subleaf, unsigned int registers[4])
+    {
+#ifdef _MSC_VER
+        __cpuidex((int*)registers, leaf, subleaf);
+#else
+        __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+    }
+
+    /***********************************************************
+     *  ReadXCR0()
+     *
+     *  Register state the OS saves on context switches; AVX is
+     *  only usable when it preserves the YMM registers.
+     ***********************************************************/
+    unsigned long long ReadXCR0()
+    {
+#ifdef _MSC_VER
+        return _xgetbv(0);
+#else
+        unsigned int low, high;
+        __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        return ((unsigned long long)high << 32) | low;
+#endif
+    }
+#endif
+}
+
+/***********************************************************
+ *  Resize()
+ ***********************************************************/
+void TransformBatch::Resize(int count)
+{
+    m_scaleX.resize(count, 1.0f);
+    m_scaleY.resize(count, 1.0f);
+    m_scaleZ.resize(count, 1.0f);
+    m_rotationX.resize(count, 0.0f);
+    m_rotationY.resize(count, 0.0f);
+    m_rotationZ.resize(count, 0.0f);
+    m_positionX.resize(count, 0.0f);
+    m_positionY.resize(count, 0.0f);
+    m_positionZ.resize(count, 0.0f);
+}
+
+/***********************************************************
+ *  GetCount()
+ ***********************************************************/
+int TransformBatch::GetCount() const
+{
+    return (int)m_scaleX.size();
+}
+
+/***********************************************************
+ *  Set()
+ ***********************************************************/
+void TransformBatch::Set(int index, const glm::vec3& scale, const glm::vec3& rotationDegrees, const glm::vec3& position)
+{
+    m_scaleX[index] = scale.x;
+    m_scaleY[index] = scale.y;
+    m_scaleZ[index] = scale.z;
+    m_rotationX[index] = rotationDegrees.x;
+    m_rotationY[index] = rotationDegrees.y;
+    m_rotationZ[index] = rotationDegrees.z;
+    m_positionX[index] = position.x;
+    m_positionY[index] = position.y;
+    m_positionZ[index] = position.z;
+}
+
+/***********************************************************
+ *  Compose()
+ ***********************************************************/
+void TransformBatch::Compose(glm::mat4* matrices) const
+{
+    Compose(matrices, GetBestKernel());
+}
+
+/***********************************************************
+ *  Compose()
+ *
+ *  This method runs the vector kernel over whole groups of
+ *  objects and finishes the remainder with the scalar one.
+ ***********************************************************/
+void TransformBatch::Compose(glm::mat4* matrices, KERNEL kernel) const
+{
+    KERNEL best = GetBestKernel();
+    if (kernel > best)
+        kernel = best;
+
+    int composed = 0;
+    if (kernel == KERNEL_AVX2)
+        composed = ComposeAVX2(matrices);
+    else if (kernel == KERNEL_SSE2)
+        composed = ComposeSSE2(matrices);
+
+    ComposeScalar(matrices, composed, GetCount());
+}
+
+/***********************************************************
+ *  GetBestKernel()
+ ***********************************************************/
+TransformBatch::KERNEL TransformBatch::GetBestKernel()
+{
+    static const KERNEL kernel = DetectKernel();
+    return kernel;
+}
+
+/***********************************************************
+ *  GetKernelName()
+ ***********************************************************/
+const char* TransformBatch::GetKernelName(KERNEL kernel)
+{
+    switch (kernel)
+    {
+    case KERNEL_SSE2:
+        return "sse2";
+    case KERNEL_AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+/***********************************************************
+ *  ComposeScalar()
+ ***********************************************************/
+void TransformBatch::ComposeScalar(glm::mat4* matrices, int first, int end) const
+{
+    for (int i = first; i < end; ++i)
+    {
+        float cx = std::cos(m_rotationX[i] * DEGREES_TO_RADIANS), sx = std::sin(m_rotationX[i] * DEGREES_TO_RADIANS);
+        float cy = std::cos(m_rotationY[i] * DEGREES_TO_RADIANS), sy = std::sin(m_rotationY[i] * DEGREES_TO_RADIANS);
+        float cz = std::cos(m_rotationZ[i] * DEGREES_TO_RADIANS), sz = std::sin(m_rotationZ[i] * DEGREES_TO_RADIANS);
+
+        // columns of rotationX * rotationY * rotationZ, each scaled by its axis
+        glm::mat4& matrix = matrices[i];
+        matrix[0] = glm::vec4(cy * cz, cx * sz + sx * sy * cz, sx * sz - cx * sy * cz, 0.0f) * m_scaleX[i];
+        matrix[1] = glm::vec4(-cy * sz, cx * cz - sx * sy * sz, sx * cz + cx * sy * sz, 0.0f) * m_scaleY[i];
+        matrix[2] = glm::vec4(sy, -sx * cy, cx * cy, 0.0f) * m_scaleZ[i];
+        matrix[3] = glm::vec4(m_positionX[i], m_positionY[i], m_positionZ[i], 1.0f);
+    }
+}
+
+/***********************************************************
+ *  ComposeSSE2()
+ ***********************************************************/
+TARGET_SSE2 int TransformBatch::ComposeSSE2(glm::mat4* matrices) const
+{
+    int end = GetCount() & ~3;
+#ifdef TRANSFORM_BATCH_X86
+    const __m128 toRadians = _mm_set1_ps(DEGREES_TO_RADIANS);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    for (int i = 0; i < end; i += 4)
+    {
+        __m128 sx, cx, sy, cy, sz, cz;
+        SinCos4(_mm_mul_ps(_mm_loadu_ps(&m_rotationX[i]), toRadians), sx, cx);
+        SinCos4(_mm_mul_ps(_mm_loadu_ps(&m_rotationY[i]), toRadians), sy, cy);
+        SinCos4(_mm_mul_ps(_mm_loadu_ps(&m_rotationZ[i]), toRadians), sz, cz);
+        __m128 scaleX = _mm_loadu_ps(&m_scaleX[i]);
+        __m128 scaleY = _mm_loadu_ps(&m_scaleY[i]);
+        __m128 scaleZ = _mm_loadu_ps(&m_scaleZ[i]);
+        __m128 sxsy = _mm_mul_ps(sx, sy);
+        __m128 cxsy = _mm_mul_ps(cx, sy);
+
+        float* first = &matrices[i][0][0];
+        StoreColumn4(first, 0,
+            _mm_mul_ps(_mm_mul_ps(cy, cz), scaleX),
+            _mm_mul_ps(_mm_add_ps(_mm_mul_ps(cx, sz), _mm_mul_ps(sxsy, cz)), scaleX),
+            _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(sx, sz), _mm_mul_ps(cxsy, cz)), scaleX),
+            zero);
+        StoreColumn4(first, 1,
+            _mm_sub_ps(zero, _mm_mul_ps(_mm_mul_ps(cy, sz), scaleY)),
+            _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(cx, cz), _mm_mul_ps(sxsy, sz)), scaleY),
+            _mm_mul_ps(_mm_add_ps(_mm_mul_ps(sx, cz), _mm_mul_ps(cxsy, sz)), scaleY),
+            zero);
+        StoreColumn4(first, 2,
+            _mm_mul_ps(sy, scaleZ),
+            _mm_sub_ps(zero, _mm_mul_ps(_mm_mul_ps(sx, cy), scaleZ)),
+            _mm_mul_ps(_mm_mul_ps(cx, cy), scaleZ),
+            zero);
+        StoreColumn4(first, 3,
+            _mm_loadu_ps(&m_positionX[i]),
+            _mm_loadu_ps(&m_positionY[i]),
+            _mm_loadu_ps(&m_positionZ[i]),
+            one);
+    }
+    return end;
+#else
+    return 0;
+#endif
+}
+
+/***********************************************************
+ *  ComposeAVX2()
+ ***********************************************************/
+TARGET_AVX2 int TransformBatch::ComposeAVX2(glm::mat4* matrices) const
+{
+    int end = GetCount() & ~7;
+#ifdef TRANSFORM_BATCH_X86
+    const __m256 toRadians = _mm256_set1_ps(DEGREES_TO_RADIANS);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    for (int i = 0; i < end; i += 8)
+    {
+        __m256 sx, cx, sy, cy, sz, cz;
+        SinCos8(_mm256_mul_ps(_mm256_loadu_ps(&m_rotationX[i]), toRadians), sx, cx);
+        SinCos8(_mm256_mul_ps(_mm256_loadu_ps(&m_rotationY[i]), toRadians), sy, cy);
+        SinCos8(_mm256_mul_ps(_mm256_loadu_ps(&m_rotationZ[i]), toRadians), sz, cz);
+        __m256 scaleX = _mm256_loadu_ps(&m_scaleX[i]);
+        __m256 scaleY = _mm256_loadu_ps(&m_scaleY[i]);
+        __m256 scaleZ = _mm256_loadu_ps(&m_scaleZ[i]);
+        __m256 sxsy = _mm256_mul_ps(sx, sy);
+        __m256 cxsy = _mm256_mul_ps(cx, sy);
+
+        float* first = &matrices[i][0][0];
+        StoreColumn8(first, 0,
+            _mm256_mul_ps(_mm256_mul_ps(cy, cz), scaleX),
+            _mm256_mul_ps(_mm256_fmadd_ps(sxsy, cz, _mm256_mul_ps(cx, sz)), scaleX),
+            _mm256_mul_ps(_mm256_fnmadd_ps(cxsy, cz, _mm256_mul_ps(sx, sz)), scaleX),
+            zero);
+        StoreColumn8(first, 1,
+            _mm256_sub_ps(zero, _mm256_mul_ps(_mm256_mul_ps(cy, sz), scaleY)),
+            _mm256_mul_ps(_mm256_fnmadd_ps(sxsy, sz, _mm256_mul_ps(cx, cz)), scaleY),
+            _mm256_mul_ps(_mm256_fmadd_ps(cxsy, sz, _mm256_mul_ps(sx, cz)), scaleY),
+            zero);
+        StoreColumn8(first, 2,
+            _mm256_mul_ps(sy, scaleZ),
+            _mm256_sub_ps(zero, _mm256_mul_ps(_mm256_mul_ps(sx, cy), scaleZ)),
+            _mm256_mul_ps(_mm256_mul_ps(cx, cy), scaleZ),
+            zero);
+        StoreColumn8(first, 3,
+            _mm256_loadu_ps(&m_positionX[i]),
+            _mm256_loadu_ps(&m_positionY[i]),
+            _mm256_loadu_ps(&m_positionZ[i]),
+            one);
+    }
+    return end;
+#else
+    return 0;
+#endif
+}
+
+/***********************************************************
+ *  DetectKernel()
+ *
+ *  AVX2 needs the AVX2 and FMA CPUID bits and an OS that
+ *  saves the YMM registers; SSE2 is always there on x64.
+ ***********************************************************/
+TransformBatch::KERNEL TransformBatch::DetectKernel()
+{
+#ifdef TRANSFORM_BATCH_X86
+    unsigned int registers[4];
+    ReadCPUID(0, 0, registers);
+    unsigned int maxLeaf = registers[0];
+    if (maxLeaf < 1)
+        return KERNEL_SCALAR;
+
+    ReadCPUID(1, 0, registers);
+    bool sse2 = (registers[3] & (1u << 26)) != 0;
+    bool fma = (registers[2] & (1u << 12)) != 0;
+    bool osxsave = (registers[2] & (1u << 27)) != 0;
+    bool avx = (registers[2] & (1u << 28)) != 0;
+
+    bool avx2 = false;
+    if (maxLeaf >= 7)
+    {
+        ReadCPUID(7, 0, registers);
+        avx2 = (registers[1] & (1u << 5)) != 0;
+    }
+
+    if (avx && avx2 && fma && osxsave && (ReadXCR0() & 0x6) == 0x6)
+        return KERNEL_AVX2;
+    if (sse2)
+        return KERNEL_SSE2;
+#endif
+    return KERNEL_SCALAR;
+}
@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////////////
+// TransformBatch.h
+// ================
+// Composes many scale, rotation and translation inputs into matrices at once
+//
+//  Inputs are stored as structure of arrays, one array per component, so
+//  the SSE and AVX2 kernels load four or eight objects per instruction and
+//  only transpose when writing the finished column-major matrices. The
+//  fastest kernel the processor supports is picked at runtime from CPUID;
+//  the scalar kernel is the fallback and the reference.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/***********************************************************
+ *  TransformBatch
+ *
+ *  This class holds the inputs of a batch of transforms and
+ *  writes translation * rotationX * rotationY * rotationZ *
+ *  scale for each of them, the order SetTransformations has
+ *  always used. Rotations are in degrees.
+ ***********************************************************/
+class TransformBatch
+{
+public:
+    // composition kernels, slowest first
+    enum KERNEL
+    {
+        KERNEL_SCALAR = 0,
+        KERNEL_SSE2,
+        KERNEL_AVX2
+    };
+
+    // number of transforms in the batch
+    void Resize(int count);
+    int GetCount() const;
+
+    // set the inputs of one transform
+    void Set(int index, const glm::vec3& scale, const glm::vec3& rotationDegrees, const glm::vec3& position);
+
+    // write every matrix with the best supported kernel
+    void Compose(glm::mat4* matrices) const;
+    // write every matrix with a kernel, or the best one below it
+    void Compose(glm::mat4* matrices, KERNEL kernel) const;
+
+    // fastest kernel this processor and OS support
+    static KERNEL GetBestKernel();
+    static const char* GetKernelName(KERNEL kernel);
+
+private:
+    std::vector<float> m_scaleX;
+    std::vector<float> m_scaleY;
+    std::vector<float> m_scaleZ;
+    std::vector<float> m_rotationX;
+    std::vector<float> m_rotationY;
+    std::vector<float> m_rotationZ;
+    std::vector<float> m_positionX;
+    std::vector<float> m_positionY;
+    std::vector<float> m_positionZ;
+
+    // compose the transforms in [first, end) one at a time
+    void ComposeScalar(glm::mat4* matrices, int first, int end) const;
+    // compose in groups of four or eight, returning where they stopped
+    int ComposeSSE2(glm::mat4* matrices) const;
+    int ComposeAVX2(glm::mat4* matrices) const;
+
+    static KERNEL DetectKernel();
+};
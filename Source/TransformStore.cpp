@@ -0,0 +1,204 @@
+///////////////////////////////////////////////////////////////////////////////
+// TransformStore.cpp
+// ==================
+// Cached local and world matrices for the scene's objects
+//
+//  Transforms are kept as parallel arrays indexed by handle. Setting a
+//  transform only marks it dirty when a value actually changes, and the
+//  once per frame update recomposes just the dirty transforms and the
+//  children of changed parents. World matrices end up packed in one array
+//  in handle order.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TransformStore.h"
+
+#include <iostream>
+
+/***********************************************************
+ *  TransformStore()
+ ***********************************************************/
+TransformStore::TransformStore()
+{
+    m_lastUpdateCount = 0;
+}
+
+/***********************************************************
+ *  Create()
+ *
+ *  This method adds a transform, dirty so that the next
+ *  update computes its world matrix. A parent that does not
+ *  exist yet cannot be updated first and is refused.
+ ***********************************************************/
+int TransformStore::Create(int parent)
+{
+    int handle = (int)m_parents.size();
+    if (parent >= handle)
+    {
+        std::cout << "Transform parent " << parent << " must be created before its children" << std::endl;
+        parent = -1;
+    }
+
+    m_parents.push_back(parent);
+    m_scales.push_back(glm::vec3(1.0f));
+    m_rotations.push_back(glm::vec3(0.0f));
+    m_positions.push_back(glm::vec3(0.0f));
+    m_localMatrices.push_back(glm::mat4(1.0f));
+    m_worldMatrices.push_back(glm::mat4(1.0f));
+    m_flags.push_back(FLAG_LOCAL_DIRTY);
+    return handle;
+}
+
+/***********************************************************
+ *  Clear()
+ ***********************************************************/
+void TransformStore::Clear()
+{
+    m_parents.clear();
+    m_scales.clear();
+    m_rotations.clear();
+    m_positions.clear();
+    m_localMatrices.clear();
+    m_worldMatrices.clear();
+    m_flags.clear();
+    m_lastUpdateCount = 0;
+}
+
+/***********************************************************
+ *  SetLocal()
+ ***********************************************************/
+void TransformStore::SetLocal(int handle, const glm::vec3& scale, const glm::vec3& rotationDegrees, const glm::vec3& position)
+{
+    uint8_t& flags = m_flags[handle];
+    if (!(flags & FLAG_EXPLICIT_MATRIX) && m_scales[handle] == scale &&
+        m_rotations[handle] == rotationDegrees && m_positions[handle] == position)
+        return;
+
+    m_scales[handle] = scale;
+    m_rotations[handle] = rotationDegrees;
+    m_positions[handle] = position;
+    flags = (flags & ~FLAG_EXPLICIT_MATRIX) | FLAG_LOCAL_DIRTY;
+}
+
+/***********************************************************
+ *  SetLocalMatrix()
+ ***********************************************************/
+void TransformStore::SetLocalMatrix(int handle, const glm::mat4& local)
+{
+    uint8_t& flags = m_flags[handle];
+    if ((flags & FLAG_EXPLICIT_MATRIX) && m_localMatrices[handle] == local)
+        return;
+
+    m_localMatrices[handle] = local;
+    flags |= FLAG_EXPLICIT_MATRIX | FLAG_LOCAL_DIRTY;
+}
+
+/***********************************************************
+ *  UpdateWorldMatrices()
+ *
+ *  This method walks the transforms in handle order, which
+ *  visits every parent before its children. A transform is
+ *  recomputed when its own values changed or its parent's
+ *  world matrix did; everything else keeps its matrix.
+ ***********************************************************/
+int TransformStore::UpdateWorldMatrices()
+{
+    ComposeDirtyLocals();
+
+    m_lastUpdateCount = UpdateWorldRange(0, (int)m_parents.size());
+    return m_lastUpdateCount;
+}
+
+/***********************************************************
+ *  UpdateWorldRange()
+ *
+ *  This method only writes the transforms of its range and
+ *  only reads their parents, so disjoint ranges can update
+ *  at the same time once their parents are up to date.
+ ***********************************************************/
+int TransformStore::UpdateWorldRange(int first, int end)
+{
+    int updated = 0;
+    for (int i = first; i < end; ++i)
+    {
+        uint8_t flags = m_flags[i];
+        int parent = m_parents[i];
+        bool parentChanged = parent >= 0 && (m_flags[parent] & FLAG_WORLD_CHANGED);
+
+        if ((flags & FLAG_LOCAL_DIRTY) || parentChanged)
+        {
+            m_worldMatrices[i] = (parent >= 0) ? m_worldMatrices[parent] * m_localMatrices[i] : m_localMatrices[i];
+            flags |= FLAG_WORLD_CHANGED;
+            ++updated;
+        }
+        else
+        {
+            flags &= ~FLAG_WORLD_CHANGED;
+        }
+        m_flags[i] = flags & ~FLAG_LOCAL_DIRTY;
+    }
+    return updated;
+}
+
+/***********************************************************
+ *  GetWorldMatrix()
+ ***********************************************************/
+const glm::mat4& TransformStore::GetWorldMatrix(int handle) const
+{
+    return m_worldMatrices[handle];
+}
+
+/***********************************************************
+ *  GetWorldMatrices()
+ ***********************************************************/
+const glm::mat4* TransformStore::GetWorldMatrices() const
+{
+    return m_worldMatrices.data();
+}
+
+/***********************************************************
+ *  GetCount()
+ ***********************************************************/
+int TransformStore::GetCount() const
+{
+    return (int)m_parents.size();
+}
+
+/***********************************************************
+ *  GetLastUpdateCount()
+ ***********************************************************/
+int TransformStore::GetLastUpdateCount() const
+{
+    return m_lastUpdateCount;
+}
+
+/***********************************************************
+ *  ComposeDirtyLocals()
+ *
+ *  This method gathers the dirty transforms set from scale,
+ *  rotation and position into one batch, so they are all
+ *  composed by the vector kernels in a single call.
+ ***********************************************************/
+void TransformStore::ComposeDirtyLocals()
+{
+    m_dirtyLocals.clear();
+    for (int i = 0; i < (int)m_flags.size(); ++i)
+    {
+        if ((m_flags[i] & FLAG_LOCAL_DIRTY) && !(m_flags[i] & FLAG_EXPLICIT_MATRIX))
+            m_dirtyLocals.push_back(i);
+    }
+    if (m_dirtyLocals.empty())
+        return;
+
+    int count = (int)m_dirtyLocals.size();
+    m_batch.Resize(count);
+    for (int i = 0; i < count; ++i)
+    {
+        int handle = m_dirtyLocals[i];
+        m_batch.Set(i, m_scales[handle], m_rotations[handle], m_positions[handle]);
+    }
+
+    m_batchMatrices.resize(count);
+    m_batch.Compose(m_batchMatrices.data());
+    for (int i = 0; i < count; ++i)
+        m_localMatrices[m_dirtyLocals[i]] = m_batchMatrices[i];
+}
@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////
+// TransformStore.h
+// ================
+// Cached local and world matrices for the scene's objects
+//
+//  Transforms are kept as parallel arrays indexed by handle. Setting a
+//  transform only marks it dirty when a value actually changes, and the
+//  once per frame update recomposes just the dirty transforms and the
+//  children of changed parents. World matrices end up packed in one array
+//  in handle order.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "TransformBatch.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  TransformStore
+ *
+ *  This class owns every transform of the scene. A parent
+ *  must be created before its children, so one pass in
+ *  handle order updates the whole hierarchy.
+ ***********************************************************/
+class TransformStore
+{
+public:
+    // constructor
+    TransformStore();
+
+    // add an identity transform below a parent, -1 for none
+    int Create(int parent);
+    // remove every transform
+    void Clear();
+
+    // set scale, rotation in degrees about X, Y and Z, and position
+    void SetLocal(int handle, const glm::vec3& scale, const glm::vec3& rotationDegrees, const glm::vec3& position);
+    // set the local matrix directly
+    void SetLocalMatrix(int handle, const glm::mat4& local);
+
+    // recompute the world matrices of changed transforms
+    int UpdateWorldMatrices();
+    // the same update in two steps: compose the changed local matrices, then
+    // update the world matrices of a range whose parents all lie outside it
+    // and are up to date, which may run on several threads for disjoint ranges
+    void ComposeDirtyLocals();
+    int UpdateWorldRange(int first, int end);
+
+    // world matrix as of the last update
+    const glm::mat4& GetWorldMatrix(int handle) const;
+    // every world matrix in handle order
+    const glm::mat4* GetWorldMatrices() const;
+    int GetCount() const;
+
+    // world matrices recomputed by the last update
+    int GetLastUpdateCount() const;
+
+private:
+    enum TRANSFORM_FLAGS
+    {
+        FLAG_LOCAL_DIRTY = 1 << 0,
+        FLAG_EXPLICIT_MATRIX = 1 << 1,
+        FLAG_WORLD_CHANGED = 1 << 2
+    };
+
+    std::vector<int> m_parents;
+    std::vector<glm::vec3> m_scales;
+    std::vector<glm::vec3> m_rotations;
+    std::vector<glm::vec3> m_positions;
+    std::vector<glm::mat4> m_localMatrices;
+    std::vector<glm::mat4> m_worldMatrices;
+    std::vector<uint8_t> m_flags;
+
+    int m_lastUpdateCount;
+
+    // dirty local transforms gathered for composing in bulk
+    std::vector<int> m_dirtyLocals;
+    TransformBatch m_batch;
+    std::vector<glm::mat4> m_batchMatrices;
+};
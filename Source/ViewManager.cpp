@@ -8,12 +8,17 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "ViewManager.h"
+#include "Profiler.h"
 
 // GLM Math Header inclusions
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>    
 
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
 // declaration of the global variables and defines
 namespace
 {
@@ -31,16 +36,39 @@ namespace
     float gDeltaTime = 0.0f;
     float gLastFrame = 0.0f;
 
+    // set by input and animation, cleared when a frame is drawn on demand
+    bool gRedrawRequested = true;
+    // the window is redrawn only when out of date, see SetOnDemand
+    bool gOnDemand = false;
+    // toggled with the space bar
+    bool gAnimationPaused = false;
+
     bool bOrthographicProjection = false;
+
+    // keys that move the camera while they are held
+    const int MOVEMENT_KEYS[] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_Q, GLFW_KEY_E };
+
+    // fixed frame step used when there is no window to time frames
+    const float OFFSCREEN_FRAME_TIME = 1.0f / 60.0f;
+    // longest step the camera moves in one frame in on-demand mode,
+    // so the first frame after an idle wait does not jump
+    const float MAX_FRAME_TIME = 0.1f;
+
+    // scripted benchmark camera orbit around the fruit bowl
+    const glm::vec3 SCRIPTED_ORBIT_CENTER = glm::vec3(0.0f, 1.0f, -5.0f);
+    const float SCRIPTED_ORBIT_RADIUS = 14.0f;
+    const float SCRIPTED_ORBIT_HEIGHT = 5.0f;
 }
 
 /***********************************************************
  *  ViewManager()
  ***********************************************************/
-ViewManager::ViewManager(ShaderManager* pShaderManager)
+ViewManager::ViewManager(GLStateCache* pStateCache)
 {
-    m_pShaderManager = pShaderManager;
+    m_pStateCache = pStateCache;
     m_pWindow = nullptr;
+    m_view = glm::mat4(1.0f);
+    m_projection = glm::mat4(1.0f);
     g_pCamera = new Camera();
 
     // Default camera view parameters
@@ -55,7 +83,7 @@ ViewManager::ViewManager(ShaderManager* pShaderManager)
  ***********************************************************/
 ViewManager::~ViewManager()
 {
-    m_pShaderManager = nullptr;
+    m_pStateCache = nullptr;
     m_pWindow = nullptr;
     if (g_pCamera)
     {
@@ -81,16 +109,65 @@ GLFWwindow* ViewManager::CreateDisplayWindow(const char* windowTitle)
     // Register input callbacks
     glfwSetCursorPosCallback(window, &ViewManager::Mouse_Position_Callback);
     glfwSetScrollCallback(window, &ViewManager::Mouse_Scroll_Callback);
+    glfwSetKeyCallback(window, &ViewManager::Key_Callback);
+    glfwSetWindowRefreshCallback(window, &ViewManager::Window_Refresh_Callback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    // Enable blending for transparency
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // Blending for transparency, enabled only for the transparent pass
+    m_pStateCache->SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     m_pWindow = window;
     return window;
 }
 
+/***********************************************************
+ *  InitializeOffscreenView()
+ *
+ *  This method applies the same render state as the display
+ *  window for headless runs, where the caller has already
+ *  made an offscreen context current.
+ ***********************************************************/
+void ViewManager::InitializeOffscreenView()
+{
+    m_pWindow = nullptr;
+
+    // Blending for transparency, enabled only for the transparent pass
+    m_pStateCache->SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+/***********************************************************
+ *  SetScriptedCameraTime()
+ *
+ *  This method moves the camera along a fixed orbit around
+ *  the bowl so that headless benchmark runs are repeatable.
+ *  The orbit covers one full turn as t goes from 0 to 1.
+ ***********************************************************/
+void ViewManager::SetScriptedCameraTime(float t)
+{
+    if (!g_pCamera)
+        return;
+
+    float angle = glm::radians(360.0f * t);
+    g_pCamera->Position = SCRIPTED_ORBIT_CENTER + glm::vec3(
+        SCRIPTED_ORBIT_RADIUS * std::sin(angle),
+        SCRIPTED_ORBIT_HEIGHT,
+        SCRIPTED_ORBIT_RADIUS * std::cos(angle));
+    g_pCamera->Front = glm::normalize(SCRIPTED_ORBIT_CENTER - g_pCamera->Position);
+}
+
+/***********************************************************
+ *  GetDisplayWidth() / GetDisplayHeight()
+ ***********************************************************/
+int ViewManager::GetDisplayWidth()
+{
+    return WINDOW_WIDTH;
+}
+
+int ViewManager::GetDisplayHeight()
+{
+    return WINDOW_HEIGHT;
+}
+
 /***********************************************************
  *  Mouse_Position_Callback()
  ***********************************************************/
@@ -111,6 +188,7 @@ void ViewManager::Mouse_Position_Callback(GLFWwindow* window, double xpos, doubl
 
     if (g_pCamera)
         g_pCamera->ProcessMouseMovement(xoffset, yoffset);
+    RequestRedraw();
 }
 
 /***********************************************************
@@ -120,6 +198,66 @@ void ViewManager::Mouse_Scroll_Callback(GLFWwindow* window, double xoffset, doub
 {
     if (g_pCamera)
         g_pCamera->ProcessMouseScroll(static_cast<float>(yoffset));
+    RequestRedraw();
+}
+
+/***********************************************************
+ *  Key_Callback()
+ *
+ *  This method marks the frame out of date and toggles the
+ *  animation pause, the held keys are polled in
+ *  ProcessKeyboardEvents.
+ ***********************************************************/
+void ViewManager::Key_Callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
+        gAnimationPaused = !gAnimationPaused;
+    RequestRedraw();
+}
+
+/***********************************************************
+ *  Window_Refresh_Callback()
+ ***********************************************************/
+void ViewManager::Window_Refresh_Callback(GLFWwindow* window)
+{
+    RequestRedraw();
+}
+
+/***********************************************************
+ *  IsAnimationPaused()
+ ***********************************************************/
+bool ViewManager::IsAnimationPaused()
+{
+    return gAnimationPaused;
+}
+
+/***********************************************************
+ *  SetOnDemand()
+ ***********************************************************/
+void ViewManager::SetOnDemand(bool enable)
+{
+    gOnDemand = enable;
+}
+
+/***********************************************************
+ *  RequestRedraw()
+ ***********************************************************/
+void ViewManager::RequestRedraw()
+{
+    gRedrawRequested = true;
+}
+
+/***********************************************************
+ *  TakeRedrawRequest()
+ *
+ *  This method reports whether a redraw was requested since
+ *  the last call and clears the request.
+ ***********************************************************/
+bool ViewManager::TakeRedrawRequest()
+{
+    bool requested = gRedrawRequested;
+    gRedrawRequested = false;
+    return requested;
 }
 
 /***********************************************************
@@ -145,6 +283,13 @@ void ViewManager::ProcessKeyboardEvents()
     if (glfwGetKey(m_pWindow, GLFW_KEY_E) == GLFW_PRESS)
         g_pCamera->ProcessKeyboard(DOWN, gDeltaTime);
 
+    // a held movement key keeps the camera moving every frame
+    for (int key : MOVEMENT_KEYS)
+    {
+        if (glfwGetKey(m_pWindow, key) == GLFW_PRESS)
+            RequestRedraw();
+    }
+
     // Projection toggle
     if (glfwGetKey(m_pWindow, GLFW_KEY_P) == GLFW_PRESS)
         bOrthographicProjection = false;
@@ -157,14 +302,26 @@ void ViewManager::ProcessKeyboardEvents()
  ***********************************************************/
 void ViewManager::PrepareSceneView()
 {
+    PROFILE_GPU_SCOPE("PrepareSceneView");
+
     glm::mat4 view;
     glm::mat4 projection;
 
-    float currentFrame = glfwGetTime();
-    gDeltaTime = currentFrame - gLastFrame;
-    gLastFrame = currentFrame;
+    if (m_pWindow)
+    {
+        float currentFrame = glfwGetTime();
+        gDeltaTime = currentFrame - gLastFrame;
+        if (gOnDemand)
+            gDeltaTime = std::min(gDeltaTime, MAX_FRAME_TIME);
+        gLastFrame = currentFrame;
 
-    ProcessKeyboardEvents();
+        ProcessKeyboardEvents();
+    }
+    else
+    {
+        // no window to time frames or read keys from
+        gDeltaTime = OFFSCREEN_FRAME_TIME;
+    }
 
     view = g_pCamera->GetViewMatrix();
 
@@ -178,11 +335,30 @@ void ViewManager::PrepareSceneView()
         projection = glm::perspective(glm::radians(g_pCamera->Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
     }
 
-    if (m_pShaderManager)
+    m_view = view;
+    m_projection = projection;
+
+    // the cache drops these while the camera is still
+    if (m_pStateCache)
     {
-        m_pShaderManager->setMat4Value(g_ViewName, view);
-        m_pShaderManager->setMat4Value(g_ProjectionName, projection);
-        m_pShaderManager->setVec3Value("viewPosition", g_pCamera->Position);
+        m_pStateCache->SetMat4Value(g_ViewName, view);
+        m_pStateCache->SetMat4Value(g_ProjectionName, projection);
+        m_pStateCache->SetVec3Value("viewPosition", g_pCamera->Position);
     }
 }
 
+/***********************************************************
+ *  GetViewMatrix()
+ ***********************************************************/
+glm::mat4 ViewManager::GetViewMatrix() const
+{
+    return m_view;
+}
+
+/***********************************************************
+ *  GetProjectionMatrix()
+ ***********************************************************/
+glm::mat4 ViewManager::GetProjectionMatrix() const
+{
+    return m_projection;
+}
@@ -9,7 +9,7 @@
 
 #pragma once
 
-#include "ShaderManager.h"
+#include "GLStateCache.h"
 #include "camera.h"
 
 // GLFW library
@@ -21,16 +21,30 @@ class ViewManager
 {
 public:
     // constructor
-    ViewManager(ShaderManager* pShaderManager);
+    ViewManager(GLStateCache* pStateCache);
     // destructor
     ~ViewManager();
 
     // create the initial OpenGL display window
     GLFWwindow* CreateDisplayWindow(const char* windowTitle);
 
+    // set up the render state for offscreen rendering without a window
+    void InitializeOffscreenView();
+
+    // place the camera along the scripted benchmark path, t in [0, 1]
+    void SetScriptedCameraTime(float t);
+
+    // size of the display window and offscreen render target
+    static int GetDisplayWidth();
+    static int GetDisplayHeight();
+
     // prepare the conversion from 3D object display to 2D scene display
     void PrepareSceneView();
 
+    // matrices set by the last PrepareSceneView
+    glm::mat4 GetViewMatrix() const;
+    glm::mat4 GetProjectionMatrix() const;
+
     // process keyboard events for interaction with the 3D scene
     void ProcessKeyboardEvents();
 
@@ -40,14 +54,29 @@ public:
     // mouse scroll callback for adjusting movement speed
     static void Mouse_Scroll_Callback(GLFWwindow* window, double xoffset, double yoffset);
 
-    // keyboard callback for toggling projection mode
+    // keyboard callback for toggling projection mode and animation
     static void Key_Callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 
+    // window refresh callback for when the contents were damaged
+    static void Window_Refresh_Callback(GLFWwindow* window);
+
+    // mark the displayed frame out of date so the next one is drawn
+    static void RequestRedraw();
+    // true once after any redraw request, for on-demand rendering
+    static bool TakeRedrawRequest();
+    // limit the camera step after an idle wait, for on-demand rendering
+    static void SetOnDemand(bool enable);
+    // true while the space bar has the scene animation paused
+    static bool IsAnimationPaused();
+
 private:
-    // pointer to shader manager object
-    ShaderManager* m_pShaderManager;
+    // pointer to the shader state cache
+    GLStateCache* m_pStateCache;
     // active OpenGL display window
     GLFWwindow* m_pWindow;
+    // current view and projection matrices
+    glm::mat4 m_view;
+    glm::mat4 m_projection;
 
     // camera control variables
     static float cameraYaw;